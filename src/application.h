@@ -126,10 +126,15 @@ public:
 		CommandSync,	// Auto sync video time with gps sensor
 		CommandExtract,	// Extract gps sensor data from video
 		CommandClear,	// Clear cache directories
+		CommandImport,	// Import tiles directories in the tiles stores
+		CommandExport,	// Export the tiles stores as directories
+		CommandStats,	// Dump tiles cache statistics
+		CommandPrune,	// Evict tiles over the cache size limit
 		CommandMap,		// Download & build map
 		CommandTrack,	// Download, build map & draw track
 		CommandConvert, // Convert telemetry data
 		CommandCompute, // Compute telemetry data from gpx, csv...
+		CommandCache,	// Build computed telemetry cache files
 		CommandImage,	// Render alpha image with telemetry overlay
 		CommandVideo,	// Render video with telemtry overlay
 
@@ -0,0 +1,137 @@
+#include <OpenImageIO/imagebufalgo.h>
+
+#include "log.h"
+#include "oiioutils.h"
+#include "assetcache.h"
+
+
+std::mutex AssetCache::mutex_;
+std::map<AssetCache::Key, AssetPtr> AssetCache::assets_;
+
+uint64_t AssetCache::hits_ = 0;
+uint64_t AssetCache::misses_ = 0;
+
+
+AssetPtr AssetCache::load(const std::string &path) {
+	bool ok;
+
+	std::shared_ptr<OIIO::ImageBuf> buf;
+
+	// Open image
+	auto img = OIIO::ImageInput::open(path);
+
+	if (!img) {
+		log_warn("Open '%s' image failure!", path.c_str());
+		return NULL;
+	}
+
+	const OIIO::ImageSpec& spec = img->spec();
+	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
+	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+
+	// Alpha is associated by OIIO readers
+	buf = std::make_shared<OIIO::ImageBuf>(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type));
+	ok = img->read_image(type, buf->localpixels());
+
+	img->close();
+
+	if (!ok) {
+		log_warn("Read '%s' image (%dx%d) failure!", path.c_str(), spec.width, spec.height);
+		return NULL;
+	}
+
+	// Add alpha channel
+	if (spec.nchannels != 4) {
+		int channelorder[] = { 0, 1, 2, -1 /*use a float value*/ };
+		float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
+		std::string channelnames[] = { "", "", "", "A" };
+
+		// Gray (& alpha) images
+		if (spec.nchannels < 3) {
+			channelorder[1] = channelorder[2] = 0;
+			channelorder[3] = (spec.nchannels == 2) ? 1 : -1;
+		}
+
+		*buf = OIIO::ImageBufAlgo::channels(*buf, 4, channelorder, channelvalues, channelnames);
+	}
+
+	return buf;
+}
+
+
+AssetPtr AssetCache::get(const std::string &path) {
+	return get(path, 0, 0);
+}
+
+
+AssetPtr AssetCache::get(const std::string &path, int width, int height) {
+	AssetPtr source;
+	std::shared_ptr<OIIO::ImageBuf> buf;
+
+	Key key(path, width, height);
+	Key source_key(path, 0, 0);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = assets_.find(key);
+
+	if (it != assets_.end()) {
+		hits_++;
+		return it->second;
+	}
+
+	misses_++;
+
+	// Decoded image
+	it = assets_.find(source_key);
+
+	if (it != assets_.end())
+		source = it->second;
+	else {
+		source = load(path);
+		assets_[source_key] = source;
+	}
+
+	if ((width == 0) && (height == 0))
+		return source;
+
+	if (source == NULL) {
+		assets_[key] = NULL;
+		return NULL;
+	}
+
+	// Resized image
+	const OIIO::ImageSpec &spec = source->spec();
+
+	if ((width == spec.width) && (height == spec.height))
+		buf = std::make_shared<OIIO::ImageBuf>(*source);
+	else {
+		buf = std::make_shared<OIIO::ImageBuf>(OIIO::ImageSpec(width, height, spec.nchannels, spec.format));
+		OIIO::ImageBufAlgo::resize(*buf, *source);
+	}
+
+	assets_[key] = buf;
+
+	return buf;
+}
+
+
+uint64_t AssetCache::hits(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return hits_;
+}
+
+
+uint64_t AssetCache::misses(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return misses_;
+}
+
+
+void AssetCache::clear(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	assets_.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef __GPX2VIDEO__ASSETCACHE_H__
+#define __GPX2VIDEO__ASSETCACHE_H__
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+
+
+using AssetPtr = std::shared_ptr<const OIIO::ImageBuf>;
+
+
+// Process wide cache of image assets (pictos, markers...): each file is
+// decoded once as premultiplied RGBA, and each requested size resized once.
+// Cached buffers are shared & read-only, so any thread can use them.
+class AssetCache {
+public:
+	// Decoded image, NULL if it can't be read
+	static AssetPtr get(const std::string &path);
+
+	// Image resized to width x height
+	static AssetPtr get(const std::string &path, int width, int height);
+
+	static uint64_t hits(void);
+	static uint64_t misses(void);
+
+	static void clear(void);
+
+private:
+	typedef std::tuple<std::string, int, int> Key;
+
+	static AssetPtr load(const std::string &path);
+
+	static std::mutex mutex_;
+	static std::map<Key, AssetPtr> assets_;
+
+	static uint64_t hits_;
+	static uint64_t misses_;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include <OpenImageIO/imagebufalgo.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLEND_X86 1
+#endif
+
+#include "log.h"
+#include "macros.h"
+#include "blend.h"
+
+
+// dst = src + dst * (1 - alpha) in integer, where x / 255 and x / 65535 are
+// rounded to the nearest with the (t + (t >> n)) >> n trick. The SIMD
+// kernels give the exact same result as the scalar ones.
+
+static void over8_scalar(uint8_t *dst, const uint8_t *src, int npixels) {
+	int i, c;
+
+	for (i=0; i<npixels; i++, dst+=4, src+=4) {
+		uint32_t inv = 255 - src[3];
+
+		for (c=0; c<4; c++) {
+			uint32_t t = dst[c] * inv + 128;
+			uint32_t v = src[c] + ((t + (t >> 8)) >> 8);
+
+			dst[c] = (uint8_t) MIN(v, 255);
+		}
+	}
+}
+
+
+static void over16_scalar(uint16_t *dst, const uint16_t *src, int npixels) {
+	int i, c;
+
+	for (i=0; i<npixels; i++, dst+=4, src+=4) {
+		uint32_t inv = 65535 - src[3];
+
+		for (c=0; c<4; c++) {
+			uint32_t t = dst[c] * inv + 32768;
+			uint32_t v = src[c] + ((t + (t >> 16)) >> 16);
+
+			dst[c] = (uint16_t) MIN(v, 65535);
+		}
+	}
+}
+
+
+#ifdef BLEND_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i over8_sse41_half(__m128i s, __m128i d) {
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	// Broadcast alpha of both pixels
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(c255, a)), c128);
+
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+
+__attribute__((target("sse4.1")))
+static void over8_sse41(uint8_t *dst, const uint8_t *src, int npixels) {
+	int i;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+	// 4 pixels by loop
+	for (i=0; i+4<=npixels; i+=4, dst+=16, src+=16) {
+		__m128i s = _mm_loadu_si128((const __m128i *) src);
+
+		// Transparent
+		if (_mm_testz_si128(s, s))
+			continue;
+
+		// Opaque
+		if (_mm_testc_si128(s, alpha)) {
+			_mm_storeu_si128((__m128i *) dst, s);
+			continue;
+		}
+
+		__m128i d = _mm_loadu_si128((const __m128i *) dst);
+
+		__m128i lo = over8_sse41_half(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = over8_sse41_half(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+		_mm_storeu_si128((__m128i *) dst, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+	}
+
+	over8_scalar(dst, src, npixels - i);
+}
+
+
+__attribute__((target("sse4.1")))
+static inline __m128i over16_sse41_pixel(__m128i s, __m128i d) {
+	const __m128i c65535 = _mm_set1_epi32(65535);
+	const __m128i c32768 = _mm_set1_epi32(32768);
+
+	__m128i a = _mm_shuffle_epi32(s, 0xFF);
+
+	__m128i t = _mm_add_epi32(_mm_mullo_epi32(d, _mm_sub_epi32(c65535, a)), c32768);
+
+	t = _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 16)), 16);
+
+	return _mm_min_epu32(_mm_add_epi32(s, t), c65535);
+}
+
+
+__attribute__((target("sse4.1")))
+static void over16_sse41(uint16_t *dst, const uint16_t *src, int npixels) {
+	int i;
+
+	const __m128i alpha = _mm_set1_epi64x(0xFFFF000000000000LL);
+
+	// 2 pixels by loop
+	for (i=0; i+2<=npixels; i+=2, dst+=8, src+=8) {
+		__m128i s = _mm_loadu_si128((const __m128i *) src);
+
+		if (_mm_testz_si128(s, s))
+			continue;
+
+		if (_mm_testc_si128(s, alpha)) {
+			_mm_storeu_si128((__m128i *) dst, s);
+			continue;
+		}
+
+		__m128i d = _mm_loadu_si128((const __m128i *) dst);
+
+		__m128i lo = over16_sse41_pixel(_mm_cvtepu16_epi32(s), _mm_cvtepu16_epi32(d));
+		__m128i hi = over16_sse41_pixel(_mm_cvtepu16_epi32(_mm_srli_si128(s, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(d, 8)));
+
+		_mm_storeu_si128((__m128i *) dst, _mm_packus_epi32(lo, hi));
+	}
+
+	over16_scalar(dst, src, npixels - i);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i over8_avx2_half(__m256i s, __m256i d) {
+	const __m256i c255 = _mm256_set1_epi16(255);
+	const __m256i c128 = _mm256_set1_epi16(128);
+
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)), c128);
+
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+
+__attribute__((target("avx2")))
+static void over8_avx2(uint8_t *dst, const uint8_t *src, int npixels) {
+	int i;
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+
+	// 8 pixels by loop (unpack & pack work by 128 bits lane, order is kept)
+	for (i=0; i+8<=npixels; i+=8, dst+=32, src+=32) {
+		__m256i s = _mm256_loadu_si256((const __m256i *) src);
+
+		if (_mm256_testz_si256(s, s))
+			continue;
+
+		if (_mm256_testc_si256(s, alpha)) {
+			_mm256_storeu_si256((__m256i *) dst, s);
+			continue;
+		}
+
+		__m256i d = _mm256_loadu_si256((const __m256i *) dst);
+
+		__m256i lo = over8_avx2_half(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = over8_avx2_half(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+		_mm256_storeu_si256((__m256i *) dst, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+	}
+
+	over8_sse41(dst, src, npixels - i);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i over16_avx2_pixels(__m256i s, __m256i d) {
+	const __m256i c65535 = _mm256_set1_epi32(65535);
+	const __m256i c32768 = _mm256_set1_epi32(32768);
+
+	__m256i a = _mm256_shuffle_epi32(s, 0xFF);
+
+	__m256i t = _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_sub_epi32(c65535, a)), c32768);
+
+	t = _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 16)), 16);
+
+	return _mm256_min_epu32(_mm256_add_epi32(s, t), c65535);
+}
+
+
+__attribute__((target("avx2")))
+static void over16_avx2(uint16_t *dst, const uint16_t *src, int npixels) {
+	int i;
+
+	const __m256i alpha = _mm256_set1_epi64x(0xFFFF000000000000LL);
+
+	// 4 pixels by loop
+	for (i=0; i+4<=npixels; i+=4, dst+=16, src+=16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *) src);
+
+		if (_mm256_testz_si256(s, s))
+			continue;
+
+		if (_mm256_testc_si256(s, alpha)) {
+			_mm256_storeu_si256((__m256i *) dst, s);
+			continue;
+		}
+
+		__m256i d = _mm256_loadu_si256((const __m256i *) dst);
+
+		__m256i lo = over16_avx2_pixels(
+			_mm256_cvtepu16_epi32(_mm256_castsi256_si128(s)),
+			_mm256_cvtepu16_epi32(_mm256_castsi256_si128(d)));
+		__m256i hi = over16_avx2_pixels(
+			_mm256_cvtepu16_epi32(_mm256_extracti128_si256(s, 1)),
+			_mm256_cvtepu16_epi32(_mm256_extracti128_si256(d, 1)));
+
+		// packus works by lane: pixels 0, 2, 1, 3 => 0, 1, 2, 3
+		__m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+
+		_mm256_storeu_si256((__m256i *) dst, r);
+	}
+
+	over16_sse41(dst, src, npixels - i);
+}
+
+#endif
+
+
+static bool kernel_supported(Blend::Kernel kernel) {
+	switch (kernel) {
+	case Blend::KernelScalar:
+		return true;
+
+#ifdef BLEND_X86
+	case Blend::KernelSSE41:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.1");
+
+	case Blend::KernelAVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+#endif
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+
+static Blend::Kernel kernel_detect(void) {
+	if (kernel_supported(Blend::KernelAVX2))
+		return Blend::KernelAVX2;
+
+	if (kernel_supported(Blend::KernelSSE41))
+		return Blend::KernelSSE41;
+
+	return Blend::KernelScalar;
+}
+
+
+static Blend::Kernel kernel_ = kernel_detect();
+
+
+Blend::Kernel Blend::kernel(void) {
+	return kernel_;
+}
+
+
+const char * Blend::kernelName(Blend::Kernel kernel) {
+	switch (kernel) {
+	case KernelScalar:
+		return "scalar";
+	case KernelSSE41:
+		return "sse4.1";
+	case KernelAVX2:
+		return "avx2";
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+
+bool Blend::setKernel(Blend::Kernel kernel) {
+	if (!kernel_supported(kernel))
+		return false;
+
+	kernel_ = kernel;
+
+	return true;
+}
+
+
+void Blend::over8(uint8_t *dst, const uint8_t *src, int npixels) {
+	switch (kernel_) {
+#ifdef BLEND_X86
+	case KernelAVX2:
+		over8_avx2(dst, src, npixels);
+		break;
+
+	case KernelSSE41:
+		over8_sse41(dst, src, npixels);
+		break;
+#endif
+
+	default:
+		over8_scalar(dst, src, npixels);
+		break;
+	}
+}
+
+
+void Blend::over16(uint16_t *dst, const uint16_t *src, int npixels) {
+	switch (kernel_) {
+#ifdef BLEND_X86
+	case KernelAVX2:
+		over16_avx2(dst, src, npixels);
+		break;
+
+	case KernelSSE41:
+		over16_sse41(dst, src, npixels);
+		break;
+#endif
+
+	default:
+		over16_scalar(dst, src, npixels);
+		break;
+	}
+}
+
+
+bool Blend::isSupported(const OIIO::ImageBuf &dst, const OIIO::ImageBuf &src) {
+	const OIIO::ImageSpec &dspec = dst.spec();
+	const OIIO::ImageSpec &sspec = src.spec();
+
+	// Pixels in memory (not read from the image cache)
+	if ((dst.localpixels() == NULL) || (src.localpixels() == NULL))
+		return false;
+
+	// RGBA, alpha last
+	if ((dspec.nchannels != 4) || (sspec.nchannels != 4))
+		return false;
+
+	if ((dspec.alpha_channel != 3) || (sspec.alpha_channel != 3))
+		return false;
+
+	if (dspec.format != sspec.format)
+		return false;
+
+	return (dspec.format == OIIO::TypeDesc::UINT8) || (dspec.format == OIIO::TypeDesc::UINT16);
+}
+
+
+bool Blend::over(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi) {
+	int y;
+
+	if (!roi.defined())
+		roi = src.roi();
+
+	if (!isSupported(dst, src))
+		return OIIO::ImageBufAlgo::over(dst, src, dst, roi);
+
+	roi = OIIO::roi_intersection(roi, src.roi());
+	roi = OIIO::roi_intersection(roi, dst.roi());
+
+	if ((roi.width() <= 0) || (roi.height() <= 0))
+		return true;
+
+	for (y=roi.ybegin; y<roi.yend; y++) {
+		if (dst.spec().format == OIIO::TypeDesc::UINT8) {
+			over8((uint8_t *) dst.pixeladdr(roi.xbegin, y),
+				(const uint8_t *) src.pixeladdr(roi.xbegin, y),
+				roi.width());
+		}
+		else {
+			over16((uint16_t *) dst.pixeladdr(roi.xbegin, y),
+				(const uint16_t *) src.pixeladdr(roi.xbegin, y),
+				roi.width());
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef __GPX2VIDEO__BLEND_H__
+#define __GPX2VIDEO__BLEND_H__
+
+#include <stdint.h>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+
+
+// Premultiplied alpha "over" for RGBA uint8 & uint16 buffers, with SSE4.1 &
+// AVX2 kernels selected at runtime. Any other layout is handed to
+// ImageBufAlgo::over.
+class Blend {
+public:
+	enum Kernel {
+		KernelScalar,
+		KernelSSE41,
+		KernelAVX2,
+
+		KernelCount
+	};
+
+	typedef void (*over8_t)(uint8_t *dst, const uint8_t *src, int npixels);
+	typedef void (*over16_t)(uint16_t *dst, const uint16_t *src, int npixels);
+
+	static Kernel kernel(void);
+	static const char * kernelName(Kernel kernel);
+
+	// Force a kernel (benchmark), returns false if CPU doesn't support it
+	static bool setKernel(Kernel kernel);
+
+	// dst = src over dst, in roi
+	static bool over(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi=OIIO::ROI());
+
+	static void over8(uint8_t *dst, const uint8_t *src, int npixels);
+	static void over16(uint16_t *dst, const uint16_t *src, int npixels);
+
+private:
+	static bool isSupported(const OIIO::ImageBuf &dst, const OIIO::ImageBuf &src);
+};
+
+#endif
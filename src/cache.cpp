@@ -1,11 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include <map>
+
 #include "log.h"
 #include "utils.h"
+#include "mapsettings.h"
+#include "tilestore.h"
 #include "cache.h"
 
 
-Cache::Cache(GPXApplication &app) 
+// Store rewritten if its unused space is larger than its tiles & larger
+// than 64 MB
+#define COMPACT_MIN (64 * 1024 * 1024)
+
+
+CacheSettings::CacheSettings() {
+	max_size_ = 0;
+	policy_ = CacheSettings::PolicyLRU;
+}
+
+
+CacheSettings::~CacheSettings() {
+}
+
+
+const uint64_t& CacheSettings::maxSize(void) const {
+	return max_size_;
+}
+
+
+void CacheSettings::setMaxSize(const uint64_t &size) {
+	max_size_ = size;
+}
+
+
+const CacheSettings::Policy& CacheSettings::policy(void) const {
+	return policy_;
+}
+
+
+void CacheSettings::setPolicy(const CacheSettings::Policy &policy) {
+	policy_ = policy;
+}
+
+
+const std::string CacheSettings::getFriendlyName(const CacheSettings::Policy &policy) {
+	switch (policy) {
+	case CacheSettings::PolicyLRU:
+		return "lru";
+	case CacheSettings::PolicyLFU:
+		return "lfu";
+	case CacheSettings::PolicyCount:
+	default:
+		return "";
+	}
+
+	return "";
+}
+
+
+Cache::Cache(GPXApplication &app, const CacheSettings &settings) 
 	: Task(app) 
-	, app_(app) {
+	, app_(app)
+	, settings_(settings) {
 }
 
 
@@ -13,8 +72,8 @@ Cache::~Cache() {
 }
 
 
-Cache * Cache::create(GPXApplication &app) {
-	Cache *cache = new Cache(app);
+Cache * Cache::create(GPXApplication &app, const CacheSettings &settings) {
+	Cache *cache = new Cache(app, settings);
 
 	cache->init();
 
@@ -31,17 +90,309 @@ void Cache::init(void) {
 }
 
 
+bool Cache::importTiles(void) {
+	int n;
+	int source;
+
+	size_t count;
+
+	bool result = true;
+
+	DIR *dir;
+	struct dirent *entry;
+
+	TileStore *store;
+
+	log_call();
+
+	if ((dir = ::opendir(path_.c_str())) == NULL)
+		return false;
+
+	// Map source directories: <source>/<zoom>/tile_<y>_<x>.png
+	while ((entry = ::readdir(dir)) != NULL) {
+		std::string path = path_ + "/" + entry->d_name;
+
+		n = 0;
+
+		if ((sscanf(entry->d_name, "%d%n", &source, &n) != 1) || (entry->d_name[n] != '\0'))
+			continue;
+
+		if ((store = TileStore::open(TileStore::path(path_, source))) == NULL) {
+			result = false;
+			continue;
+		}
+
+		if (store->importDir(path, count)) {
+			log_notice("Import %lu tiles in '%s'", count, store->filename().c_str());
+
+			// Stored, the tile files are useless
+			rmpath(path);
+		}
+		else {
+			log_error("Import '%s' tiles failure", path.c_str());
+			result = false;
+		}
+
+		delete store;
+	}
+
+	::closedir(dir);
+
+	return result;
+}
+
+
+bool Cache::exportTiles(const std::string &path) {
+	int n;
+	int source;
+
+	size_t count;
+
+	bool result = true;
+
+	DIR *dir;
+	struct dirent *entry;
+
+	TileStore *store;
+
+	log_call();
+
+	if ((dir = ::opendir(path_.c_str())) == NULL)
+		return false;
+
+	// Map source stores: <source>.g2ts
+	while ((entry = ::readdir(dir)) != NULL) {
+		n = 0;
+
+		if ((sscanf(entry->d_name, "%d.g2ts%n", &source, &n) != 1) || (n == 0) || (entry->d_name[n] != '\0'))
+			continue;
+
+		std::string output = path + "/" + std::to_string(source);
+
+		if ((store = TileStore::open(TileStore::path(path_, source))) == NULL) {
+			result = false;
+			continue;
+		}
+
+		if (store->exportDir(output, count))
+			log_notice("Export %lu tiles in '%s'", count, output.c_str());
+		else {
+			log_error("Export '%s' tiles failure", store->filename().c_str());
+			result = false;
+		}
+
+		delete store;
+	}
+
+	::closedir(dir);
+
+	return result;
+}
+
+
+bool Cache::openStores(std::vector<TileStore *> &stores) {
+	int n;
+	int source;
+
+	bool result = true;
+
+	DIR *dir;
+	struct dirent *entry;
+
+	TileStore *store;
+
+	stores.clear();
+
+	if ((dir = ::opendir(path_.c_str())) == NULL)
+		return false;
+
+	// Map source stores: <source>.g2ts
+	while ((entry = ::readdir(dir)) != NULL) {
+		n = 0;
+
+		if ((sscanf(entry->d_name, "%d.g2ts%n", &source, &n) != 1) || (n == 0) || (entry->d_name[n] != '\0'))
+			continue;
+
+		if ((store = TileStore::open(TileStore::path(path_, source))) == NULL) {
+			result = false;
+			continue;
+		}
+
+		stores.push_back(store);
+	}
+
+	::closedir(dir);
+
+	return result;
+}
+
+
+bool Cache::pruneTiles(void) {
+	size_t count = 0;
+
+	bool result;
+	bool evicted;
+
+	uint64_t bytes = 0;
+
+	time_t accessed_at;
+
+	TileStore *oldest;
+	TileStore::Entry entry, next;
+	TileStore::Stats stats;
+
+	std::vector<TileStore *> stores;
+
+	// Next victim of each store, oldest access first
+	std::multimap<time_t, std::pair<TileStore *, TileStore::Entry> > victims;
+
+	log_call();
+
+	result = openStores(stores);
+
+	for (TileStore *store : stores) {
+		bytes += store->bytes();
+
+		if (store->victim(settings_.policy(), entry, accessed_at))
+			victims.insert(std::make_pair(accessed_at, std::make_pair(store, entry)));
+	}
+
+	// Evicted tiles only are read (k-way merge)
+	while ((bytes > settings_.maxSize()) && !victims.empty()) {
+		auto it = victims.begin();
+
+		oldest = it->second.first;
+		entry = it->second.second;
+
+		victims.erase(it);
+
+		// Tile accessed since (by another process), next victim
+		if ((evicted = oldest->evict(entry))) {
+			bytes -= TileStore::storedSize(entry);
+			count++;
+		}
+
+		// Still the same victim (write failure), store skipped
+		if (oldest->victim(settings_.policy(), next, accessed_at) && (evicted || (next.offset != entry.offset)))
+			victims.insert(std::make_pair(accessed_at, std::make_pair(oldest, next)));
+	}
+
+	log_notice("Prune %lu tiles, cache size: %lu MB (limit: %lu MB)", count,
+		(unsigned long) (bytes >> 20), (unsigned long) (settings_.maxSize() >> 20));
+
+	for (TileStore *store : stores) {
+		result = store->flush() && result;
+
+		// Mostly unused (replaced & evicted tiles), rewritten
+		if (store->stats(stats) && (stats.disk > 2 * stats.bytes) && (stats.disk - stats.bytes > COMPACT_MIN))
+			result = store->compact() && result;
+
+		delete store;
+	}
+
+	return result;
+}
+
+
+bool Cache::statsTiles(void) {
+	int source;
+
+	bool result;
+
+	TileStore::Stats stats, total;
+
+	std::vector<TileStore *> stores;
+
+	log_call();
+
+	memset(&total, 0, sizeof(total));
+
+	result = openStores(stores);
+
+	printf("%-28s %10s %12s %12s %10s\n", "Map source", "Tiles", "Size", "Disk", "Hit ratio");
+
+	for (TileStore *store : stores) {
+		if (store->stats(stats)) {
+			sscanf(store->filename().c_str() + path_.length() + 1, "%d", &source);
+
+			printf("%-28s %10lu %9.1f MB %9.1f MB %8.1f %%\n",
+				MapSettings::getFriendlyName((MapSettings::Source) source).c_str(),
+				(unsigned long) stats.tiles,
+				stats.bytes / 1048576.0,
+				stats.disk / 1048576.0,
+				(stats.hits + stats.misses) ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0.0);
+
+			total.tiles += stats.tiles;
+			total.bytes += stats.bytes;
+			total.disk += stats.disk;
+			total.hits += stats.hits;
+			total.misses += stats.misses;
+		}
+		else
+			result = false;
+
+		delete store;
+	}
+
+	printf("%-28s %10lu %9.1f MB %9.1f MB %8.1f %%\n", "Total",
+		(unsigned long) total.tiles,
+		total.bytes / 1048576.0,
+		total.disk / 1048576.0,
+		(total.hits + total.misses) ? 100.0 * total.hits / (total.hits + total.misses) : 0.0);
+
+	if (settings_.maxSize() > 0)
+		printf("Size limit: %lu MB, policy: %s\n", (unsigned long) (settings_.maxSize() >> 20),
+			CacheSettings::getFriendlyName(settings_.policy()).c_str());
+
+	return result;
+}
+
+
 bool Cache::run(void) {
 	log_call();
 
 	log_notice("Cache initialization...");
 
-	if (app_.command() != GPXApplication::CommandClear)
-		goto done;
+	switch (app_.command()) {
+	case GPXApplication::CommandClear:
+		rmpath(path_);
+		break;
+
+	case GPXApplication::CommandImport:
+		if (!importTiles())
+			log_error("Import tiles failure");
+		break;
+
+	case GPXApplication::CommandExport:
+		if (!exportTiles(app_.settings().outputfile()))
+			log_error("Export tiles failure");
+		break;
+
+	case GPXApplication::CommandStats:
+		if (!statsTiles())
+			log_error("Cache statistics failure");
+		break;
+
+	case GPXApplication::CommandPrune:
+		if (settings_.maxSize() == 0)
+			log_warn("No cache size limit, nothing to prune");
+		else if (!pruneTiles())
+			log_error("Prune tiles failure");
+		break;
+
+	case GPXApplication::CommandMap:
+	case GPXApplication::CommandTrack:
+	case GPXApplication::CommandImage:
+	case GPXApplication::CommandVideo:
+		// Size limit enforced before downloading new tiles
+		if ((settings_.maxSize() > 0) && !pruneTiles())
+			log_error("Prune tiles failure");
+		break;
 
-	rmpath(path_);
+	default:
+		break;
+	}
 
-done:
 	complete();
 
 	return true;
@@ -2,15 +2,24 @@
 #define __GPX2VIDEO__CACHE_H__
 
 #include <string>
+#include <vector>
 
+#include "cachesettings.h"
 #include "application.h"
 
 
+class TileStore;
+
+
 class Cache : public GPXApplication::Task {
 public:
 	virtual ~Cache();
 
-	static Cache * create(GPXApplication &app);
+	static Cache * create(GPXApplication &app, const CacheSettings &settings);
+
+	const CacheSettings& settings(void) const {
+		return settings_;
+	}
 
 	const std::string& path(void) const {
 		return path_;
@@ -21,10 +30,23 @@ public:
 private:
 	GPXApplication &app_;
 
-	Cache(GPXApplication &app);
+	Cache(GPXApplication &app, const CacheSettings &settings);
 
 	void init(void);
 
+	// Tiles stores of each map source
+	bool openStores(std::vector<TileStore *> &stores);
+
+	// Tiles directories (one file by tile) to the stores & back
+	bool importTiles(void);
+	bool exportTiles(const std::string &path);
+
+	// Evict tiles over the size limit, from all the stores
+	bool pruneTiles(void);
+	bool statsTiles(void);
+
+	CacheSettings settings_;
+
 	std::string path_;
 };
 
@@ -0,0 +1,37 @@
+#ifndef __GPX2VIDEO__CACHESETTINGS_H__
+#define __GPX2VIDEO__CACHESETTINGS_H__
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+
+class CacheSettings {
+public:
+	enum Policy {
+		PolicyLRU = 0,	// Least recently used tiles evicted first
+		PolicyLFU,		// Least frequently used tiles evicted first
+
+		PolicyCount
+	};
+
+	CacheSettings();
+	virtual ~CacheSettings();
+
+	// Tiles size limit (bytes), 0 if none
+	const uint64_t& maxSize(void) const;
+	void setMaxSize(const uint64_t &size);
+
+	const Policy& policy(void) const;
+	void setPolicy(const Policy &policy);
+
+	static const std::string getFriendlyName(const Policy &policy);
+
+private:
+	uint64_t max_size_;
+	enum Policy policy_;
+};
+
+
+#endif
@@ -11,7 +11,8 @@
 Decoder::Decoder()
 	: fmt_ctx_(NULL)
 	, codec_ctx_(NULL)
-	, sws_ctx_(NULL) {
+	, sws_ctx_(NULL)
+	, yuv_output_(false) {
 	pts_ = 0;
 }
 
@@ -214,6 +215,9 @@ bool Decoder::open(StreamPtr stream) {
 		native_pix_fmt_ = getNativePixelFormat(ideal_pix_fmt_);
 		native_nb_channels_ = getNativeNbChannels(ideal_pix_fmt_);
 
+		// Frame buffer pool
+		pool_ = FramePool::create();
+
 		if ((native_pix_fmt_ == VideoParams::FormatInvalid)
 			|| (native_nb_channels_ == 0)) {
 			av_log(NULL, AV_LOG_ERROR, "Failed to find valid native pixel format for %d\n", ideal_pix_fmt_);
@@ -337,6 +341,14 @@ int Decoder::getFrame(AVPacket *packet, AVFrame *frame) {
 
 
 void Decoder::close(void) {
+	if (pool_) {
+		log_info("Frame pool: %lu hits, %lu misses (hit rate: %.1f%%)",
+			pool_->hits(), pool_->misses(), pool_->hitRate());
+
+		// Frames still alive keep the pool until they are released
+		pool_ = NULL;
+	}
+
 	if (sws_ctx_) {
 		sws_freeContext(sws_ctx_);
 		sws_ctx_ = NULL;
@@ -359,6 +371,31 @@ const AVCodecID& Decoder::codec(void) const {
 }
 
 
+AVPixelFormat Decoder::pixelFormat(void) const {
+	return codec_ctx_->pix_fmt;
+}
+
+
+AVColorSpace Decoder::colorSpace(void) const {
+	return codec_ctx_->colorspace;
+}
+
+
+AVColorRange Decoder::colorRange(void) const {
+	return codec_ctx_->color_range;
+}
+
+
+bool Decoder::isYUVOutput(void) const {
+	return yuv_output_;
+}
+
+
+void Decoder::setYUVOutput(bool enable) {
+	yuv_output_ = enable;
+}
+
+
 FramePtr Decoder::retrieveAudio(const AudioParams &params, AVRational timecode, int duration) {
 	uint8_t *data;
 
@@ -467,14 +504,21 @@ uint8_t * Decoder::retrieveAudioFrameData(const AudioParams &params, const int64
 
 
 FramePtr Decoder::retrieveVideo(AVRational timecode) {
-	uint8_t *data;
+	uint8_t *data = NULL;
+	AVFrame *avframe = NULL;
 
 	VideoStreamPtr vs = std::static_pointer_cast<VideoStream>(stream());
 
 	int64_t target_ts = vs->getTimeInTimeBaseUnits(timecode);
 
-	// Retrieve frame data
-	if ((data = retrieveVideoFrameData(target_ts)) == NULL)
+	// Retrieve frame data (decoded YUV planes or RGB(A) buffer)
+	if (yuv_output_) {
+		if ((avframe = retrieveVideoAVFrame(target_ts)) == NULL)
+			return NULL;
+
+		pts_ = avframe->pts;
+	}
+	else if ((data = retrieveVideoFrameData(target_ts)) == NULL)
 		return NULL;
 
 	// Return the frame
@@ -489,10 +533,43 @@ FramePtr Decoder::retrieveVideo(AVRational timecode) {
 	// TODO : do better !!!
 	frame->setTimestamp(pts_);
 	frame->setData(data);
+	frame->setPool(pool_);
+	frame->setAVFrame(avframe);
 	
 	return frame;
 }
 
+AVFrame * Decoder::retrieveVideoAVFrame(const int64_t& target_ts) {
+	int result;
+
+	AVPacket *packet = av_packet_alloc();
+	AVFrame *frame = av_frame_alloc();
+
+	(void) target_ts;
+
+	// Pull from decoder
+	result = getFrame(packet, frame);
+
+	av_packet_free(&packet);
+
+	// Handle any errors (EOF too)
+	if (result < 0)
+		goto error;
+
+	// Decoder can still use the frame buffer as reference, overlay will
+	// be drawn in our own copy
+	if (av_frame_make_writable(frame) < 0)
+		goto error;
+
+	return frame;
+
+error:
+	av_frame_free(&frame);
+
+	return NULL;
+}
+
+
 uint8_t * Decoder::retrieveVideoFrameData(const int64_t& target_ts) {
 	int result;
 
@@ -518,13 +595,16 @@ uint8_t * Decoder::retrieveVideoFrameData(const int64_t& target_ts) {
 			break;
 		}
 
-		// Store data
+		// Store data (buffer recycled from the previous frames)
 		int linesize = Frame::generateLinesizeBytes(frame->width, native_pix_fmt_, native_nb_channels_);
-		size_t size = VideoParams::getBufferSize(linesize, frame->height, native_pix_fmt_, native_nb_channels_);
 //printf("linesize = [%d,%d,%d] / dst_linesize = %d / height = %d\n", 
 //		frame->linesize[0], frame->linesize[1], frame->linesize[2], linesize, frame->height);
-//printf("buffsize = %ld\n", size);
-		data = (uint8_t *) malloc(size * sizeof(uint8_t));
+		data = pool_->acquire(frame->width, frame->height, native_pix_fmt_, native_nb_channels_);
+
+		if (data == NULL) {
+			log_error("Allocate video frame buffer failure");
+			break;
+		}
 
 		sws_scale(sws_ctx_,
 			(const uint8_t * const *) frame->data,
@@ -12,6 +12,7 @@ extern "C" {
 }
 
 #include "frame.h"
+#include "framepool.h"
 #include "stream.h"
 #include "media.h"
 
@@ -35,6 +36,14 @@ public:
 
 	FramePtr retrieveVideo(AVRational timecode);
 	uint8_t * retrieveVideoFrameData(const int64_t& target_ts);
+	AVFrame * retrieveVideoAVFrame(const int64_t& target_ts);
+
+	AVPixelFormat pixelFormat(void) const;
+	AVColorSpace colorSpace(void) const;
+	AVColorRange colorRange(void) const;
+
+	bool isYUVOutput(void) const;
+	void setYUVOutput(bool enable);
 
 protected:
 	StreamPtr stream(void) const {
@@ -66,6 +75,10 @@ private:
 	SwsContext *sws_ctx_;
 
 	int64_t pts_;
+
+	FramePoolPtr pool_;
+
+	bool yuv_output_;
 };
 
 #endif
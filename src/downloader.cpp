@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include <fstream>
+
+#include "log.h"
+#include "downloader.h"
+
+
+Downloader::Downloader(struct event_base *evbase)
+	: evbase_(evbase)
+	, max_per_host_(2)
+	, retries_(4)
+	, retry_delay_(500) {
+	log_call();
+
+	evcurl_ = EVCurl::init(evbase);
+
+	// Connections are reused, HTTP/2 requests multiplexed
+	evcurl_->setOption(CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	evcurl_->setOption(CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_per_host_);
+}
+
+
+Downloader::~Downloader() {
+	log_call();
+
+	// No more callback
+	delete evcurl_;
+
+	for (Request *request : requests_) {
+		if (request->timer != NULL)
+			event_free(request->timer);
+
+		if (request->fp != NULL) {
+			::fclose(request->fp);
+			::unlink(request->tmpfile.c_str());
+		}
+
+		delete request;
+	}
+}
+
+
+Downloader * Downloader::create(struct event_base *evbase) {
+	Downloader *downloader;
+
+	log_call();
+
+	downloader = new Downloader(evbase);
+
+	return downloader;
+}
+
+
+void Downloader::setMaxPerHost(int max) {
+	max_per_host_ = (max > 0) ? max : 1;
+
+	evcurl_->setOption(CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_per_host_);
+}
+
+
+void Downloader::setUserAgent(const std::string &agent) {
+	user_agent_ = agent;
+}
+
+
+void Downloader::setRetries(int retries, int delay_ms) {
+	retries_ = retries;
+	retry_delay_ = delay_ms;
+}
+
+
+std::string Downloader::host(const std::string &url) {
+	size_t begin, end;
+
+	begin = url.find("://");
+	begin = (begin == std::string::npos) ? 0 : begin + 3;
+
+	end = url.find_first_of("/?#", begin);
+
+	return url.substr(begin, (end == std::string::npos) ? std::string::npos : end - begin);
+}
+
+
+bool Downloader::download(const std::string &url, const std::string &filename,
+	Downloader::callback_t cb, Downloader::progress_t progress, void *userdata) {
+	struct stat st;
+
+	Request *request;
+
+	log_call();
+
+	if (url.empty())
+		return false;
+
+	request = new Request();
+
+	request->url = url;
+	request->filename = filename;
+	request->mtime = 0;
+	request->sidecar = true;
+	request->cb = cb;
+	request->progress = progress;
+	request->userdata = userdata;
+
+	// Validators of the existing file
+	if ((::stat(filename.c_str(), &st) == 0) && (st.st_size > 0)) {
+		std::ifstream stream(filename + ".etag");
+
+		request->mtime = st.st_mtime;
+
+		if (stream.is_open())
+			std::getline(stream, request->etag);
+	}
+
+	return queue(request);
+}
+
+
+bool Downloader::download(const std::string &url, const std::string &filename,
+	const std::string &etag, time_t mtime,
+	Downloader::callback_t cb, Downloader::progress_t progress, void *userdata) {
+	Request *request;
+
+	log_call();
+
+	if (url.empty())
+		return false;
+
+	request = new Request();
+
+	request->url = url;
+	request->filename = filename;
+	request->etag = etag;
+	request->mtime = mtime;
+	request->sidecar = false;
+	request->cb = cb;
+	request->progress = progress;
+	request->userdata = userdata;
+
+	return queue(request);
+}
+
+
+bool Downloader::queue(Request *request) {
+	request->downloader = this;
+	request->host = host(request->url);
+	request->tmpfile = request->filename + ".part";
+	request->attempts = 0;
+	request->fp = NULL;
+	request->timer = NULL;
+
+	requests_.insert(request);
+
+	queues_[request->host].push_back(request);
+
+	schedule(request->host);
+
+	return true;
+}
+
+
+void Downloader::schedule(const std::string &host) {
+	Request *request;
+
+	std::deque<Request *> &queue = queues_[host];
+
+	while (!queue.empty() && (running_[host] < max_per_host_)) {
+		request = queue.front();
+		queue.pop_front();
+
+		if (!start(request)) {
+			log_error("Download '%s' failure, can't start request", request->url.c_str());
+			done(request, ResultError);
+		}
+	}
+}
+
+
+bool Downloader::start(Request *request) {
+	EVCurlTask *evtaskh;
+
+	log_call();
+
+	evtaskh = evcurl_->download(request->url.c_str(), downloadComplete, request);
+
+	if (evtaskh == NULL)
+		return false;
+
+	request->attempts++;
+	request->new_etag.clear();
+
+	evtaskh->setOption(CURLOPT_NOPROGRESS, 0L);
+	evtaskh->setOption(CURLOPT_XFERINFOFUNCTION, downloadProgress);
+	evtaskh->setOption(CURLOPT_XFERINFODATA, request);
+
+	evtaskh->setOption(CURLOPT_WRITEFUNCTION, downloadWrite);
+	evtaskh->setOption(CURLOPT_WRITEDATA, request);
+
+	evtaskh->setOption(CURLOPT_HEADERFUNCTION, downloadHeader);
+	evtaskh->setOption(CURLOPT_HEADERDATA, request);
+
+	evtaskh->setOption(CURLOPT_FOLLOWLOCATION, 1L);
+
+	// Keep alive & wait for a connection to multiplex on
+	evtaskh->setOption(CURLOPT_TCP_KEEPALIVE, 1L);
+	evtaskh->setOption(CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+	evtaskh->setOption(CURLOPT_PIPEWAIT, 1L);
+
+	// Revalidate the existing file
+	if (!request->etag.empty())
+		evtaskh->setHeader(("If-None-Match: " + request->etag).c_str());
+
+	if (request->mtime > 0) {
+		evtaskh->setOption(CURLOPT_TIMECONDITION, (long) CURL_TIMECOND_IFMODSINCE);
+		evtaskh->setOption(CURLOPT_TIMEVALUE, (long) request->mtime);
+	}
+
+	if (!user_agent_.empty())
+		evtaskh->setHeader(("User-Agent: " + user_agent_).c_str());
+
+	if (evtaskh->perform() != 0) {
+		evtaskh->cancel();
+		return false;
+	}
+
+	running_[request->host]++;
+
+	return true;
+}
+
+
+void Downloader::done(Request *request, Result result) {
+	callback_t cb = request->cb;
+	void *userdata = request->userdata;
+
+	std::string etag;
+
+	// Received ETag, or the revalidated one
+	if (result != ResultError)
+		etag = (request->new_etag.empty() && (result == ResultNotModified)) ? request->etag : request->new_etag;
+
+	requests_.erase(request);
+
+	delete request;
+
+	if (cb != NULL)
+		cb(result, etag, userdata);
+}
+
+
+size_t Downloader::downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata) {
+	Request *request = (Request *) userdata;
+
+	if (ptr == NULL)
+		return 0;
+
+	// Open output file
+	if (request->fp == NULL) {
+		request->fp = ::fopen(request->tmpfile.c_str(), "wb");
+
+		if (request->fp == NULL)
+			return 0;
+	}
+
+	return fwrite(ptr, size, nmemb, request->fp) * size;
+}
+
+
+size_t Downloader::downloadHeader(char *ptr, size_t size, size_t nitems, void *userdata) {
+	size_t begin, end;
+
+	Request *request = (Request *) userdata;
+
+	std::string header(ptr, size * nitems);
+
+	// New response (redirect)
+	if (header.compare(0, 5, "HTTP/") == 0)
+		request->new_etag.clear();
+	else if (strncasecmp(header.c_str(), "ETag:", 5) == 0) {
+		begin = header.find_first_not_of(" \t", 5);
+		end = header.find_last_not_of(" \t\r\n");
+
+		if ((begin != std::string::npos) && (end >= begin))
+			request->new_etag = header.substr(begin, end - begin + 1);
+	}
+
+	return size * nitems;
+}
+
+
+int Downloader::downloadProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+	Request *request = (Request *) clientp;
+
+	(void) ultotal;
+	(void) ulnow;
+
+	if (request->progress != NULL)
+		request->progress(dltotal, dlnow, request->userdata);
+
+	return 0;
+}
+
+
+void Downloader::downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata) {
+	int delay;
+
+	long code = 0;
+
+	bool retry;
+
+	Request *request = (Request *) userdata;
+	Downloader *downloader = request->downloader;
+
+	std::string host = request->host;
+
+	log_call();
+
+	evtaskh->getInfo(CURLINFO_RESPONSE_CODE, &code);
+
+	downloader->running_[host]--;
+
+	if (request->fp != NULL) {
+		::fclose(request->fp);
+		request->fp = NULL;
+	}
+
+	// Existing file is still valid, reset its age
+	if ((result == CURLE_OK) && (code == 304)) {
+		::unlink(request->tmpfile.c_str());
+
+		if (request->sidecar)
+			::utime(request->filename.c_str(), NULL);
+
+		downloader->schedule(host);
+		downloader->done(request, ResultNotModified);
+		return;
+	}
+
+	// Downloaded
+	if ((result == CURLE_OK) && (::rename(request->tmpfile.c_str(), request->filename.c_str()) == 0)) {
+		std::string etagfile = request->filename + ".etag";
+
+		// ETag for the next revalidation
+		if (request->sidecar) {
+			if (request->new_etag.empty())
+				::unlink(etagfile.c_str());
+			else {
+				std::ofstream stream(etagfile, std::ios::trunc);
+
+				stream << request->new_etag << std::endl;
+			}
+		}
+
+		downloader->schedule(host);
+		downloader->done(request, ResultOk);
+		return;
+	}
+
+	::unlink(request->tmpfile.c_str());
+
+	// Network errors, timeout, rate limit & server errors are retried
+	retry = (result != CURLE_OK) && ((result != CURLE_HTTP_RETURNED_ERROR)
+		|| (code == 408) || (code == 429) || (code >= 500));
+
+	if (retry && (request->attempts <= downloader->retries_)) {
+		struct timeval tv;
+
+		delay = downloader->retry_delay_ << (request->attempts - 1);
+
+		log_warn("Download '%s' failure (%s, HTTP %ld), retry in %d ms",
+			request->url.c_str(), curl_easy_strerror(result), code, delay);
+
+		tv.tv_sec = delay / 1000;
+		tv.tv_usec = (delay % 1000) * 1000;
+
+		request->timer = evtimer_new(downloader->evbase_, downloadRetry, request);
+		evtimer_add(request->timer, &tv);
+
+		downloader->schedule(host);
+		return;
+	}
+
+	log_error("Download '%s' failure (%s, HTTP %ld)",
+		request->url.c_str(), curl_easy_strerror(result), code);
+
+	downloader->schedule(host);
+	downloader->done(request, ResultError);
+}
+
+
+void Downloader::downloadRetry(evutil_socket_t fd, short what, void *arg) {
+	Request *request = (Request *) arg;
+	Downloader *downloader = request->downloader;
+
+	(void) fd;
+	(void) what;
+
+	event_free(request->timer);
+	request->timer = NULL;
+
+	// Retried before the waiting requests
+	downloader->queues_[request->host].push_front(request);
+	downloader->schedule(request->host);
+}
@@ -0,0 +1,122 @@
+#ifndef __GPX2VIDEO__DOWNLOADER_H__
+#define __GPX2VIDEO__DOWNLOADER_H__
+
+#include <stdio.h>
+#include <time.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+#include <event2/event.h>
+
+#include "evcurl.h"
+
+
+// Download scheduler on top of evcurl: requests are queued by host, with at
+// most 'max per host' downloads in flight. Connections are kept alive &
+// reused (HTTP/2 multiplexing if the server supports it). A failed download
+// (network error, 408, 429 or 5xx) is retried with an exponential backoff.
+//
+// Data is written to a '.part' file, renamed once complete. An existing
+// file is revalidated (If-None-Match with its ETag, If-Modified-Since with
+// its mtime), and kept as is if the server replies 304. The validators can
+// also be given by the caller (data stored elsewhere).
+class Downloader {
+public:
+	enum Result {
+		ResultOk,
+		ResultNotModified,
+		ResultError,
+	};
+
+	typedef void (*callback_t)(Downloader::Result result, const std::string &etag, void *userdata);
+	typedef void (*progress_t)(curl_off_t dltotal, curl_off_t dlnow, void *userdata);
+
+	virtual ~Downloader();
+
+	static Downloader * create(struct event_base *evbase);
+
+	void setMaxPerHost(int max);
+	void setUserAgent(const std::string &agent);
+
+	// Retries of a failed download, the delay is doubled at each retry
+	void setRetries(int retries, int delay_ms);
+
+	// Download url to filename, cb is called once done (with the ETag)
+	bool download(const std::string &url, const std::string &filename,
+		callback_t cb, progress_t progress, void *userdata);
+
+	// Same, revalidated with etag & mtime (if any), no '.etag' file
+	bool download(const std::string &url, const std::string &filename,
+		const std::string &etag, time_t mtime,
+		callback_t cb, progress_t progress, void *userdata);
+
+	// Downloads queued, in flight or waiting for a retry
+	size_t pending(void) const {
+		return requests_.size();
+	}
+
+	static std::string host(const std::string &url);
+
+private:
+	class Request {
+	public:
+		Downloader *downloader;
+
+		std::string url;
+		std::string host;
+		std::string filename;
+		std::string tmpfile;
+
+		// Validators of the existing file & received ETag
+		std::string etag;
+		time_t mtime;
+		std::string new_etag;
+
+		// ETag saved in a '.etag' file
+		bool sidecar;
+
+		int attempts;
+
+		FILE *fp;
+		struct event *timer;
+
+		callback_t cb;
+		progress_t progress;
+		void *userdata;
+	};
+
+	Downloader(struct event_base *evbase);
+
+	bool queue(Request *request);
+
+	void schedule(const std::string &host);
+	bool start(Request *request);
+	void done(Request *request, Result result);
+
+	static size_t downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata);
+	static size_t downloadHeader(char *ptr, size_t size, size_t nitems, void *userdata);
+	static int downloadProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+	static void downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata);
+	static void downloadRetry(evutil_socket_t fd, short what, void *arg);
+
+	struct event_base *evbase_;
+
+	EVCurl *evcurl_;
+
+	int max_per_host_;
+	int retries_;
+	int retry_delay_;
+
+	std::string user_agent_;
+
+	std::set<Request *> requests_;
+
+	// Waiting requests & downloads in flight, by host
+	std::map<std::string, std::deque<Request *> > queues_;
+	std::map<std::string, int> running_;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "log.h"
+#include "macros.h"
 #include "ffmpegutils.h"
 #include "encoder.h"
 
@@ -144,8 +145,15 @@ Encoder::Encoder(const EncoderSettings &settings) :
 	video_codec_(NULL),
 	audio_stream_(NULL),
 	audio_codec_(NULL),
-	hw_device_ctx_(NULL) {
+	hw_device_ctx_(NULL),
+	yuv_sws_ctx_(NULL),
+	video_frame_index_(0),
+	video_frame_hits_(0),
+	video_frame_misses_(0) {
 	log_call();
+
+	for (size_t i=0; i<ARRAY_SIZE(video_frames_); i++)
+		video_frames_[i] = NULL;
 }
 
 
@@ -279,6 +287,11 @@ void Encoder::close(void) {
 		sws_ctx_ = NULL;
 	}
 
+	if (yuv_sws_ctx_) {
+		sws_freeContext(yuv_sws_ctx_);
+		yuv_sws_ctx_ = NULL;
+	}
+
 	if (video_codec_) {
 		avcodec_free_context(&video_codec_);
 		video_codec_ = NULL;
@@ -294,6 +307,16 @@ void Encoder::close(void) {
 		hw_device_ctx_ = NULL;
 	}
 
+	if ((video_frame_hits_ + video_frame_misses_) > 0) {
+		log_info("Encoder frame ring: %lu hits, %lu misses", video_frame_hits_, video_frame_misses_);
+
+		video_frame_hits_ = 0;
+		video_frame_misses_ = 0;
+	}
+
+	for (size_t i=0; i<ARRAY_SIZE(video_frames_); i++)
+		av_frame_free(&video_frames_[i]);
+
 	if (fmt_ctx_) {
 		avformat_free_context(fmt_ctx_);
 		fmt_ctx_ = NULL;
@@ -519,12 +542,23 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 	int input_linesize;
 	const uint8_t *input_data;
 
-	AVFrame *encoded_frame = av_frame_alloc();
+	AVFrame *encoded_frame;
+	AVFrame *yuv_frame = frame->avFrame();
+
+	if ((yuv_frame != NULL) && (yuv_frame->format == settings().videoParams().pixelFormat())) {
+		// YUV compositing: decoded planes are sent as is
+		encoded_frame = yuv_frame;
+		encoded_frame->pict_type = AV_PICTURE_TYPE_NONE;
+	}
+	else {
+		// Frame must be video (reuse an encoded buffer)
+		encoded_frame = getVideoFrame(frame->videoParams().width(), frame->videoParams().height());
 
-	// Frame must be video
-	encoded_frame->width = frame->videoParams().width();
-	encoded_frame->height = frame->videoParams().height();
-	encoded_frame->format = settings().videoParams().pixelFormat();
+		if (encoded_frame == NULL) {
+			av_log(NULL, AV_LOG_ERROR, "Failed to create AVFrame buffer\n");
+			return false;
+		}
+	}
 
 //	// TODO / FIXME !!!
 //	encoded_frame->linesize[0] = 2752;
@@ -534,6 +568,9 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 //printf("width x height: %d x %d\n", encoded_frame->width, encoded_frame->height);
 //printf("format = %d\n", encoded_frame->format);
 	// Set interlacing
+	encoded_frame->interlaced_frame = 0;
+	encoded_frame->top_field_first = 0;
+
 	if (frame->videoParams().interlacing() != VideoParams::InterlaceNone) {
 		encoded_frame->interlaced_frame = 1;
 
@@ -543,33 +580,52 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 			encoded_frame->top_field_first = 0;
 	}
 
-	// Create encoded buffer
-	result = av_frame_get_buffer(encoded_frame, 0);
-	if (result < 0) {
-		av_log(NULL, AV_LOG_ERROR, "Failed to create AVFrame buffer\n");
-		goto fail;
-	}
-
 	// We may need to convert this frame to a frame that swscale will understand
 	// TODO...
 //	if (frame->videoParams().format() != video_conversion_fmt_) {
 //		av_log(NULL, AV_LOG_ERROR, "NEED TO CONVERT THIS FRAME\n");
 //	}
 
-	// Use swscale context to convert formats/linesizes
-	input_data = frame->constData();
-	input_linesize = frame->linesizeBytes();
+	if (encoded_frame == yuv_frame) {
+		// No conversion
+		result = 0;
+	}
+	else if (yuv_frame != NULL) {
+		// Convert YUV planes to the encoder pixel format
+		yuv_sws_ctx_ = sws_getCachedContext(yuv_sws_ctx_,
+			yuv_frame->width, yuv_frame->height, (AVPixelFormat) yuv_frame->format,
+			encoded_frame->width, encoded_frame->height, settings().videoParams().pixelFormat(),
+			0, NULL, NULL, NULL);
+
+		if (yuv_sws_ctx_ == NULL) {
+			av_log(NULL, AV_LOG_ERROR, "Failed to create scale context\n");
+			goto fail;
+		}
 
-	result = sws_scale(sws_ctx_,
-//	result = sws_scale((frame->videoParams().nbChannels() == VideoParams::RGBAChannelCount) ? alpha_sws_ctx_ : noalpha_sws_ctx_,
-			reinterpret_cast<const uint8_t * const *>(&input_data),
-			&input_linesize,
+		result = sws_scale(yuv_sws_ctx_,
+			(const uint8_t * const *) yuv_frame->data,
+			yuv_frame->linesize,
 			0,
-			frame->videoParams().height(),
+			yuv_frame->height,
 			encoded_frame->data,
 			encoded_frame->linesize);
+	}
+	else {
+		// Use swscale context to convert formats/linesizes
+		input_data = frame->constData();
+		input_linesize = frame->linesizeBytes();
+
+		result = sws_scale(sws_ctx_,
+//	result = sws_scale((frame->videoParams().nbChannels() == VideoParams::RGBAChannelCount) ? alpha_sws_ctx_ : noalpha_sws_ctx_,
+				reinterpret_cast<const uint8_t * const *>(&input_data),
+				&input_linesize,
+				0,
+				frame->videoParams().height(),
+				encoded_frame->data,
+				encoded_frame->linesize);
 //printf("linesize = [%d,%d,%d] / dst_linesize = %d / height = %d\n", 
 //		encoded_frame->linesize[0], encoded_frame->linesize[1], encoded_frame->linesize[2], input_linesize, encoded_frame->height);
+	}
 
 	if (result < 0) {
 		av_log(NULL, AV_LOG_ERROR, "Failed to scale frame\n");
@@ -587,21 +643,66 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 		hw_frame = av_frame_alloc();
 		av_hwframe_get_buffer(video_codec_->hw_frames_ctx, hw_frame, 0);
 		av_hwframe_transfer_data(hw_frame, encoded_frame, 0);
-		av_frame_free(&encoded_frame);
+		hw_frame->pts = encoded_frame->pts;
 
-		encoded_frame = hw_frame;
-	}
+		// Write to encoder
+		success = writeAVFrame(hw_frame, video_codec_, video_stream_);
 
-	// Write to encoder
-	success = writeAVFrame(encoded_frame, video_codec_, video_stream_);
+		av_frame_free(&hw_frame);
+	}
+	else {
+		// Write to encoder
+		success = writeAVFrame(encoded_frame, video_codec_, video_stream_);
+	}
 
 fail:
-	av_frame_free(&encoded_frame);
-
 	return success;
 }
 
 
+AVFrame * Encoder::getVideoFrame(int width, int height) {
+	AVFrame *frame;
+
+	AVFrame **slot = &video_frames_[video_frame_index_];
+
+	video_frame_index_ = (video_frame_index_ + 1) % ARRAY_SIZE(video_frames_);
+
+	frame = *slot;
+
+	// Size changed, drop the old buffer
+	if ((frame != NULL) && ((frame->width != width) || (frame->height != height)))
+		av_frame_free(slot);
+
+	if (*slot == NULL) {
+		frame = av_frame_alloc();
+
+		frame->width = width;
+		frame->height = height;
+		frame->format = settings().videoParams().pixelFormat();
+
+		if (av_frame_get_buffer(frame, 0) < 0) {
+			av_frame_free(&frame);
+			return NULL;
+		}
+
+		video_frame_misses_++;
+
+		*slot = frame;
+	}
+	else if (!av_frame_is_writable(frame)) {
+		// Buffer still referenced by the codec, a new one is allocated
+		if (av_frame_make_writable(frame) < 0)
+			return NULL;
+
+		video_frame_misses_++;
+	}
+	else
+		video_frame_hits_++;
+
+	return frame;
+}
+
+
 bool Encoder::writeAVFrame(AVFrame *frame, AVCodecContext *codec_ctx, AVStream *stream) {
 	int result;
 
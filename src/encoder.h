@@ -128,6 +128,8 @@ private:
 
 	bool writeAVFrame(AVFrame *frame, AVCodecContext *codec_ctx, AVStream *stream);
 
+	AVFrame * getVideoFrame(int width, int height);
+
 	EncoderSettings settings_;
 
 	bool open_;
@@ -146,6 +148,15 @@ private:
 	VideoParams::Format video_conversion_fmt_;
 
 	AVBufferRef *hw_device_ctx_;
+
+	// YUV compositing input conversion (if pixel formats differ)
+	SwsContext *yuv_sws_ctx_;
+
+	// Small ring of video frames reused by writeFrame
+	AVFrame *video_frames_[4];
+	unsigned int video_frame_index_;
+	uint64_t video_frame_hits_;
+	uint64_t video_frame_misses_;
 };
 
 #endif
@@ -97,6 +97,9 @@ public:
 	template <typename T> CURLcode setOption(CURLoption option, T arg) {
 		return evcurl_setopt(evtaskh, option, arg);
 	}
+	template <typename T> CURLcode getInfo(CURLINFO info, T arg) {
+		return evcurl_getinfo(evtaskh, info, arg);
+	}
 
 	int cancel(void);
 	int perform(void);
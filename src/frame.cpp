@@ -10,12 +10,22 @@
 
 
 Frame::Frame() :
-	data_(NULL) {
+	data_(NULL),
+	avframe_(NULL) {
 }
 
 
 Frame::~Frame() {
-	if (data_ != NULL)
+	if (avframe_ != NULL)
+		av_frame_free(&avframe_);
+
+	if (data_ == NULL)
+		return;
+
+	// Give the buffer back to the pool it comes from
+	if (pool_)
+		pool_->release(data_);
+	else
 		free(data_);
 }
 
@@ -72,17 +82,48 @@ void Frame::setData(uint8_t *data) {
 }
 
 
+const FramePoolPtr& Frame::pool(void) const {
+	return pool_;
+}
+
+
+void Frame::setPool(FramePoolPtr pool) {
+	pool_ = pool;
+}
+
+
+AVFrame * Frame::avFrame(void) const {
+	return avframe_;
+}
+
+
+void Frame::setAVFrame(AVFrame *frame) {
+	avframe_ = frame;
+}
+
+
 OIIO::ImageBuf Frame::toImageBuf(void) const {
-	// OIIO Convert frame to imagebuf
-	OIIO::ImageBuf buffer(OIIO::ImageSpec(this->width(), this->height(), 
-		this->nbChannels(), OIIOUtils::getOIIOBaseTypeFromFormat(this->format())));
-	OIIOUtils::frameToBuffer(this, &buffer);
+	int bpp = VideoParams::getBytesPerPixel(this->format(), this->nbChannels());
+
+	// Each line is padded to linesizeBytes(), so the buffer is wrapped as an
+	// image of (linesize / bpp) pixels width. Only full_width is the real
+	// frame width, use roi_full() to process the picture.
+	OIIO::ImageSpec spec(this->linesizeBytes() / bpp, this->height(),
+		this->nbChannels(), OIIOUtils::getOIIOBaseTypeFromFormat(this->format()));
+	spec.full_width = this->width();
+
+	// OIIO Wrap frame data (no copy)
+	OIIO::ImageBuf buffer(spec, data_);
 
 	return buffer;
 }
 
 
 void Frame::fromImageBuf(OIIO::ImageBuf &buffer) {
+	// Nothing to do if the buffer wraps the frame data
+	if (buffer.localpixels() == data_)
+		return;
+
 	OIIOUtils::bufferToFrame(&buffer, this);
 }
 
@@ -14,6 +14,7 @@ extern "C" {
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 
+#include "framepool.h"
 #include "videoparams.h"
 
 
@@ -65,6 +66,12 @@ public:
 
 	void setData(uint8_t *data);
 
+	const FramePoolPtr& pool(void) const;
+	void setPool(FramePoolPtr pool);
+
+	AVFrame * avFrame(void) const;
+	void setAVFrame(AVFrame *frame);
+
 private:
 	VideoParams video_params_;
 
@@ -73,6 +80,10 @@ private:
 	int64_t timestamp_;
 
 	uint8_t *data_;
+
+	FramePoolPtr pool_;
+
+	AVFrame *avframe_;
 };
 
 #endif
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+
+#include "log.h"
+#include "frame.h"
+#include "framepool.h"
+
+
+// Buffer alignment (AVX-512)
+#define BUFFER_ALIGN 64
+
+
+FramePool::FramePool(size_t max_buffers)
+	: max_buffers_(max_buffers)
+	, hits_(0)
+	, misses_(0) {
+}
+
+
+FramePool::~FramePool() {
+	clear();
+}
+
+
+FramePoolPtr FramePool::create(size_t max_buffers) {
+	FramePoolPtr pool;
+
+	pool = std::make_shared<FramePool>(max_buffers);
+
+	return pool;
+}
+
+
+size_t FramePool::getBufferSize(int width, int height, VideoParams::Format format, int nb_channels) {
+	return (size_t) Frame::generateLinesizeBytes(width, format, nb_channels) * height;
+}
+
+
+uint8_t * FramePool::acquire(int width, int height, VideoParams::Format format, int nb_channels) {
+	uint8_t *data = NULL;
+
+	Key key(width, height, format, nb_channels);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::vector<uint8_t *> &buffers = buffers_[key];
+
+	if (!buffers.empty()) {
+		data = buffers.back();
+		buffers.pop_back();
+
+		hits_++;
+	}
+	else {
+		if (posix_memalign((void **) &data, BUFFER_ALIGN, getBufferSize(width, height, format, nb_channels)) != 0)
+			return NULL;
+
+		misses_++;
+	}
+
+	used_[data] = key;
+
+	return data;
+}
+
+
+void FramePool::release(uint8_t *data) {
+	if (data == NULL)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Released under its acquire key (not the stream video params)
+	auto it = used_.find(data);
+
+	if (it == used_.end()) {
+		free(data);
+		return;
+	}
+
+	std::vector<uint8_t *> &buffers = buffers_[it->second];
+
+	used_.erase(it);
+
+	if (buffers.size() >= max_buffers_) {
+		free(data);
+		return;
+	}
+
+	buffers.push_back(data);
+}
+
+
+uint64_t FramePool::hits(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return hits_;
+}
+
+
+uint64_t FramePool::misses(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return misses_;
+}
+
+
+double FramePool::hitRate(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if ((hits_ + misses_) == 0)
+		return 0.0;
+
+	return 100.0 * hits_ / (hits_ + misses_);
+}
+
+
+void FramePool::clear(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto &it : buffers_) {
+		for (uint8_t *data : it.second)
+			free(data);
+	}
+
+	buffers_.clear();
+}
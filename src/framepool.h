@@ -0,0 +1,55 @@
+#ifndef __GPX2VIDEO__FRAMEPOOL_H__
+#define __GPX2VIDEO__FRAMEPOOL_H__
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "videoparams.h"
+
+
+class FramePool;
+
+using FramePoolPtr = std::shared_ptr<FramePool>;
+
+
+// Recycle video frame buffers instead of a malloc/free for each frame.
+// Buffers are keyed by width, height, format & channels (the acquire key,
+// kept till release) & aligned for SIMD; acquire() and release() can be
+// called from any thread.
+class FramePool {
+public:
+	FramePool(size_t max_buffers=16);
+	virtual ~FramePool();
+
+	static FramePoolPtr create(size_t max_buffers=16);
+
+	static size_t getBufferSize(int width, int height, VideoParams::Format format, int nb_channels);
+
+	uint8_t * acquire(int width, int height, VideoParams::Format format, int nb_channels);
+	void release(uint8_t *data);
+
+	uint64_t hits(void);
+	uint64_t misses(void);
+	double hitRate(void);
+
+	void clear(void);
+
+private:
+	typedef std::tuple<int, int, int, int> Key;
+
+	size_t max_buffers_;
+
+	uint64_t hits_;
+	uint64_t misses_;
+
+	std::mutex mutex_;
+	std::map<Key, std::vector<uint8_t *> > buffers_;
+
+	// Buffers in use & their key
+	std::map<uint8_t *, Key> used_;
+};
+
+#endif
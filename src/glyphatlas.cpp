@@ -0,0 +1,327 @@
+#include <codecvt>
+#include <limits>
+#include <locale>
+
+#include "log.h"
+#include "macros.h"
+#include "glyphatlas.h"
+
+
+static FT_Library ft_library = NULL;
+
+std::mutex GlyphAtlas::atlases_mutex_;
+std::map<GlyphAtlas::Key, GlyphAtlasPtr> GlyphAtlas::atlases_;
+
+
+GlyphAtlas::GlyphAtlas(int px, int shadow)
+	: face_(NULL)
+	, px_(px)
+	, shadow_(shadow) {
+}
+
+
+GlyphAtlas::~GlyphAtlas() {
+	if (face_ != NULL)
+		FT_Done_Face(face_);
+}
+
+
+GlyphAtlasPtr GlyphAtlas::get(const std::string &font, int px, int shadow) {
+	GlyphAtlasPtr atlas;
+
+	Key key(font, px, shadow);
+
+	std::lock_guard<std::mutex> lock(atlases_mutex_);
+
+	auto it = atlases_.find(key);
+
+	if (it != atlases_.end())
+		return it->second;
+
+	if (ft_library == NULL) {
+		if (FT_Init_FreeType(&ft_library)) {
+			log_error("Could not initialize FreeType for font rendering");
+			ft_library = NULL;
+			goto done;
+		}
+	}
+
+	atlas = std::make_shared<GlyphAtlas>(px, shadow);
+
+	if (!atlas->open(font)) {
+		log_warn("Glyph atlas: can't load '%s' font, fallback to OIIO text rendering", font.c_str());
+		atlas = NULL;
+	}
+
+done:
+	// Failures are cached too, to not retry on each string
+	atlases_[key] = atlas;
+
+	return atlas;
+}
+
+
+bool GlyphAtlas::open(const std::string &font) {
+	if (FT_New_Face(ft_library, font.c_str(), 0, &face_)) {
+		face_ = NULL;
+		return false;
+	}
+
+	if (FT_Set_Pixel_Sizes(face_, 0, px_))
+		return false;
+
+	return true;
+}
+
+
+const GlyphAtlas::Glyph & GlyphAtlas::glyph(char32_t ch) {
+	int i, j, k;
+	int width, height;
+
+	auto it = glyphs_.find(ch);
+
+	if (it != glyphs_.end())
+		return it->second;
+
+	Glyph &glyph = glyphs_[ch];
+
+	FT_GlyphSlot slot = face_->glyph;
+
+	glyph.valid = false;
+
+	if (FT_Load_Char(face_, ch, FT_LOAD_RENDER))
+		return glyph;
+
+	glyph.valid = true;
+	glyph.index = FT_Get_Char_Index(face_, ch);
+	glyph.left = slot->bitmap_left;
+	glyph.top = slot->bitmap_top;
+	glyph.width = slot->bitmap.width;
+	glyph.height = slot->bitmap.rows;
+	glyph.advance = slot->advance.x >> 6;
+	glyph.offset = pixels_.size();
+
+	// Coverage, padded by the shadow radius
+	width = glyph.width + 2 * shadow_;
+	height = glyph.height + 2 * shadow_;
+
+	pixels_.resize(pixels_.size() + 2 * width * height, 0);
+
+	uint8_t *coverage = pixels_.data() + glyph.offset;
+	uint8_t *alpha = coverage + width * height;
+
+	for (j=0; j<glyph.height; j++) {
+		for (i=0; i<glyph.width; i++)
+			coverage[(j + shadow_) * width + (i + shadow_)] = slot->bitmap.buffer[slot->bitmap.pitch * j + i];
+	}
+
+	// Shadow: dilate the coverage with a (2 * shadow + 1) box, max filter
+	// is separable (horizontal then vertical pass)
+	std::vector<uint8_t> tmp(width * height, 0);
+
+	for (j=0; j<height; j++) {
+		for (i=0; i<width; i++) {
+			uint8_t value = 0;
+
+			for (k=MAX(i - shadow_, 0); k<=MIN(i + shadow_, width - 1); k++)
+				value = MAX(value, coverage[j * width + k]);
+
+			tmp[j * width + i] = value;
+		}
+	}
+
+	for (j=0; j<height; j++) {
+		for (i=0; i<width; i++) {
+			uint8_t value = 0;
+
+			for (k=MAX(j - shadow_, 0); k<=MIN(j + shadow_, height - 1); k++)
+				value = MAX(value, tmp[k * width + i]);
+
+			alpha[j * width + i] = value;
+		}
+	}
+
+	return glyph;
+}
+
+
+int GlyphAtlas::kerning(FT_UInt left, FT_UInt right) {
+	FT_Vector delta;
+
+	if ((left == 0) || (right == 0) || !FT_HAS_KERNING(face_))
+		return 0;
+
+	std::pair<FT_UInt, FT_UInt> key(left, right);
+
+	auto it = kernings_.find(key);
+
+	if (it != kernings_.end())
+		return it->second;
+
+	if (FT_Get_Kerning(face_, left, right, FT_KERNING_DEFAULT, &delta))
+		delta.x = 0;
+
+	kernings_[key] = delta.x >> 6;
+
+	return delta.x >> 6;
+}
+
+
+OIIO::ROI GlyphAtlas::layout(const std::string &text, std::vector<Layout> &glyphs) {
+	int x = 0;
+
+	FT_UInt previous = 0;
+
+	OIIO::ROI roi;
+
+	std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv_utf8_utf32;
+
+	std::u32string u32string = conv_utf8_utf32.from_bytes(text);
+
+	// Same metrics as ImageBufAlgo::text_size
+	roi.xbegin = roi.ybegin = std::numeric_limits<int>::max();
+	roi.xend = roi.yend = std::numeric_limits<int>::min();
+
+	for (char32_t ch : u32string) {
+		const Glyph &glyph = this->glyph(ch);
+
+		if (!glyph.valid)
+			continue;
+
+		x += kerning(previous, glyph.index);
+		previous = glyph.index;
+
+		roi.ybegin = MIN(roi.ybegin, -glyph.top);
+		roi.yend = MAX(roi.yend, glyph.height - glyph.top + 1);
+		roi.xbegin = MIN(roi.xbegin, x + glyph.left);
+		roi.xend = MAX(roi.xend, x + glyph.width + glyph.left + 1);
+
+		glyphs.push_back({ &glyph, x });
+
+		x += glyph.advance;
+	}
+
+	return roi;
+}
+
+
+OIIO::ROI GlyphAtlas::textSize(const std::string &text) {
+	std::vector<Layout> glyphs;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return layout(text, glyphs);
+}
+
+
+bool GlyphAtlas::draw(OIIO::ImageBuf &buf, int x, int y, const std::string &text, const float color[4]) {
+	int i, j, c;
+	int width, height;
+
+	std::vector<Layout> glyphs;
+
+	const OIIO::ImageSpec &spec = buf.spec();
+
+	int nchannels = spec.nchannels;
+	int alpha_channel = spec.alpha_channel;
+
+	float textalpha = 1.0;
+	float pixel[4];
+
+	if ((spec.depth > 1) || (nchannels > 4))
+		return false;
+
+	// Alpha of the text color (same guess as render_text_shadow)
+	if (alpha_channel >= 0)
+		textalpha = color[alpha_channel];
+	else {
+		textalpha = color[3];
+		alpha_channel = 3;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	OIIO::ROI textroi = layout(text, glyphs);
+
+	if (glyphs.empty())
+		return true;
+
+	// Text box, padded for shadowing
+	textroi.xbegin += x - shadow_;
+	textroi.xend += x + shadow_;
+	textroi.ybegin += y - shadow_;
+	textroi.yend += y + shadow_;
+
+	width = textroi.width();
+	height = textroi.height();
+
+	// Blit pre-shadowed glyphs
+	std::vector<uint8_t> coverage(width * height, 0);
+	std::vector<uint8_t> alpha(width * height, 0);
+
+	for (const Layout &item : glyphs) {
+		const Glyph &glyph = *item.glyph;
+
+		int gw = glyph.width + 2 * shadow_;
+		int gh = glyph.height + 2 * shadow_;
+		int gx = x + item.x + glyph.left - shadow_ - textroi.xbegin;
+		int gy = y - glyph.top - shadow_ - textroi.ybegin;
+
+		const uint8_t *src_coverage = pixels_.data() + glyph.offset;
+		const uint8_t *src_alpha = src_coverage + gw * gh;
+
+		for (j=0; j<gh; j++) {
+			uint8_t *dst_coverage = &coverage[(gy + j) * width + gx];
+			uint8_t *dst_alpha = &alpha[(gy + j) * width + gx];
+
+			for (i=0; i<gw; i++) {
+				dst_coverage[i] = MAX(dst_coverage[i], src_coverage[j * gw + i]);
+				dst_alpha[i] = MAX(dst_alpha[i], src_alpha[j * gw + i]);
+			}
+		}
+	}
+
+	// Composite text (premultiplied) over the buffer
+	OIIO::ROI roi = OIIO::roi_intersection(textroi, buf.roi());
+
+	bool direct = (buf.localpixels() != NULL) && (spec.format == OIIO::TypeDesc::UINT8);
+
+	for (int py=roi.ybegin; py<roi.yend; py++) {
+		for (int px=roi.xbegin; px<roi.xend; px++) {
+			int k = (py - textroi.ybegin) * width + (px - textroi.xbegin);
+
+			float val = coverage[k] / 255.0f;
+			float a = (alpha[k] / 255.0f) * textalpha;
+
+			if (a == 0.0)
+				continue;
+
+			if (direct) {
+				uint8_t *p = (uint8_t *) buf.pixeladdr(px, py);
+
+				for (c=0; c<nchannels; c++)
+					pixel[c] = p[c] / 255.0f;
+			}
+			else
+				buf.getpixel(px, py, pixel, nchannels);
+
+			for (c=0; c<nchannels; c++) {
+				if (c == alpha_channel)
+					pixel[c] = a + (1.0f - a) * pixel[c];
+				else
+					pixel[c] = (val * a * color[c]) + (1.0f - a) * pixel[c];
+			}
+
+			if (direct) {
+				uint8_t *p = (uint8_t *) buf.pixeladdr(px, py);
+
+				for (c=0; c<nchannels; c++)
+					p[c] = (uint8_t) MIN(MAX(pixel[c] * 255.0f + 0.5f, 0.0f), 255.0f);
+			}
+			else
+				buf.setpixel(px, py, pixel, nchannels);
+		}
+	}
+
+	return true;
+}
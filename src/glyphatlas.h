@@ -0,0 +1,89 @@
+#ifndef __GPX2VIDEO__GLYPHATLAS_H__
+#define __GPX2VIDEO__GLYPHATLAS_H__
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+
+
+class GlyphAtlas;
+
+using GlyphAtlasPtr = std::shared_ptr<GlyphAtlas>;
+
+
+// Glyphs of a font face rasterized once for a pixel size & shadow radius:
+// each glyph keeps its coverage and its dilated (drop shadow) alpha, so
+// strings are laid out from cached metrics and blitted, without FreeType.
+// Output matches ImageBufAlgo::render_text_shadow (left / baseline).
+class GlyphAtlas {
+public:
+	GlyphAtlas(int px, int shadow);
+	virtual ~GlyphAtlas();
+
+	// Shared atlas, NULL if the font can't be loaded
+	static GlyphAtlasPtr get(const std::string &font, int px, int shadow);
+
+	OIIO::ROI textSize(const std::string &text);
+
+	bool draw(OIIO::ImageBuf &buf, int x, int y, const std::string &text, const float color[4]);
+
+private:
+	typedef std::tuple<std::string, int, int> Key;
+
+	class Glyph {
+	public:
+		bool valid;
+
+		FT_UInt index;
+
+		int left;
+		int top;
+		int width;
+		int height;
+		int advance;
+
+		// Coverage, then alpha, (width + 2 * shadow) x (height + 2 * shadow)
+		size_t offset;
+	};
+
+	class Layout {
+	public:
+		const Glyph *glyph;
+
+		int x;
+	};
+
+	bool open(const std::string &font);
+
+	const Glyph & glyph(char32_t ch);
+	int kerning(FT_UInt left, FT_UInt right);
+
+	OIIO::ROI layout(const std::string &text, std::vector<Layout> &glyphs);
+
+	static std::mutex atlases_mutex_;
+	static std::map<Key, GlyphAtlasPtr> atlases_;
+
+	std::mutex mutex_;
+
+	FT_Face face_;
+
+	int px_;
+	int shadow_;
+
+	std::map<char32_t, Glyph> glyphs_;
+	std::map<std::pair<FT_UInt, FT_UInt>, int> kernings_;
+
+	std::vector<uint8_t> pixels_;
+};
+
+#endif
@@ -7,6 +7,8 @@
 
 #include "macros.h"
 #include "oiioutils.h"
+#include "assetcache.h"
+#include "blend.h"
 #include "imagerenderer.h"
 
 
@@ -134,7 +136,9 @@ bool ImageRenderer::start(void) {
 		// Image over
 		buf->specmod().x = widget->x();
 		buf->specmod().y = widget->y();
-		OIIO::ImageBufAlgo::over(*overlay_, *buf, *overlay_, buf->roi());
+		Blend::over(*overlay_, *buf, buf->roi());
+
+		addOverlayROI(buf->roi());
 	}
 
 	return true;
@@ -208,13 +212,13 @@ bool ImageRenderer::run(void) {
 		std::unique_ptr<OIIO::ImageOutput> out = OIIO::ImageOutput::create(filename);
 
 		// Read GPX data
-		type = source_->retrieveNext(data_, (start_time * 1000) + (time_factor * timecode_ms));
+		type = source_->retrieveFrame(data_, (start_time * 1000) + (time_factor * timecode_ms));
 
 		if (type == TelemetrySource::DataEof)
 			goto done;
 
 		// Draw overlay
-		OIIO::ImageBufAlgo::over(image_buffer, *overlay_, image_buffer, OIIO::ROI());
+		drawOverlay(image_buffer);
 
 		// Draw each widget, map...
 		for (VideoWidget *widget : widgets_) {
@@ -236,7 +240,7 @@ bool ImageRenderer::run(void) {
 					// Image over
 					buf->specmod().x = widget->x();
 					buf->specmod().y = widget->y();
-					OIIO::ImageBufAlgo::over(image_buffer, *buf, image_buffer, buf->roi());
+					Blend::over(image_buffer, *buf, buf->roi());
 				}
 			}
 
@@ -249,7 +253,7 @@ bool ImageRenderer::run(void) {
 			// Image over
 			buf->specmod().x = widget->x();
 			buf->specmod().y = widget->y();
-			OIIO::ImageBufAlgo::over(image_buffer, *buf, image_buffer, buf->roi());
+			Blend::over(image_buffer, *buf, buf->roi());
 		}
 
 		// Write image file
@@ -338,9 +342,13 @@ bool ImageRenderer::stop(void) {
 	else
 		printf("None frame proceed\n");
 
+	log_info("Asset cache: %lu hits, %lu misses", AssetCache::hits(), AssetCache::misses());
+
 	if (overlay_)
 		delete overlay_;
 
+	overlay_rois_.clear();
+
 	overlay_ = NULL;
 
 	return true;
@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <iterator>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,15 +15,18 @@
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/filesystem.h>
 
 #include <cairo.h>
 
 #include "utils.h"
 #include "log.h"
-#include "evcurl.h"
+#include "downloader.h"
+#include "tilestore.h"
 #include "oiioutils.h"
 #include "videoparams.h"
 #include "telemetrymedia.h"
+#include "blend.h"
 #include "map.h"
 
 
@@ -34,6 +39,9 @@
 #define OSM_MAX_ZOOM        20
 #define OSM_IMAGE_FORMAT    "png"
 
+// Cached tiles older than 7 days are revalidated
+#define TILE_MAX_AGE (7 * 24 * 3600)
+
 #define URI_MARKER_X    "#X"
 #define URI_MARKER_Y    "#Y"
 #define URI_MARKER_Z    "#Z"
@@ -47,6 +55,7 @@
 
 MapSettings::MapSettings() {
 	divider_ = 2.0;
+	max_downloads_ = 2;
 	source_ = MapSettings::SourceNull;
 }
 
@@ -80,6 +89,16 @@ void MapSettings::setDivider(const double &divider) {
 }
 
 
+const int& MapSettings::maxDownloads(void) const {
+	return max_downloads_;
+}
+
+
+void MapSettings::setMaxDownloads(const int &max) {
+	max_downloads_ = max;
+}
+
+
 const std::string MapSettings::getFriendlyName(const MapSettings::Source &source) {
 	switch (source) {
 	case MapSettings::SourceNull:
@@ -272,27 +291,35 @@ Map::Map(GPXApplication &app, const MapSettings &settings, struct event_base *ev
 
 	bg_buf_ = NULL;
 	fg_buf_ = NULL;
-	mapbuf_ = NULL;
+	view_buf_ = NULL;
 
-	evcurl_ = EVCurl::init(evbase);
-	
-	evcurl_->setOption(CURLMOPT_MAXCONNECTS, 1);
-	evcurl_->setOption(CURLMOPT_MAX_HOST_CONNECTIONS, 1);
-	evcurl_->setOption(CURLMOPT_MAX_PIPELINE_LENGTH, 1);
+	max_tiles_ = 0;
+
+	store_ = NULL;
+
+	downloader_ = Downloader::create(evbase);
+
+	downloader_->setMaxPerHost(settings_.maxDownloads());
+	downloader_->setUserAgent("gpx2video");
 }
 
 
 Map::~Map() {
 	log_call();
 
-	if (mapbuf_ != NULL)
-		delete mapbuf_;
+	for (TileEntry &entry : lru_tiles_)
+		delete entry.second;
 	if (bg_buf_)
 		delete bg_buf_;
 	if (fg_buf_)
 		delete fg_buf_;
+	if (view_buf_)
+		delete view_buf_;
+
+	delete downloader_;
 
-	delete evcurl_;
+	if (store_)
+		delete store_;
 }
 
 
@@ -375,14 +402,16 @@ std::string Map::buildURI(int zoom, int x, int y) {
 }
 
 
+// Downloaded tile, till stored
 std::string Map::buildPath(int zoom, int x, int y) {
 	std::ostringstream stream;
 
+	(void) zoom;
 	(void) x;
 	(void) y;
 
 	stream << std::getenv("HOME");
-	stream << "/.gpx2video/cache/" << settings().source() << "/" << zoom;
+	stream << "/.gpx2video/cache/tmp";
 
 	return stream.str();
 }
@@ -391,14 +420,20 @@ std::string Map::buildPath(int zoom, int x, int y) {
 std::string Map::buildFilename(int zoom, int x, int y) {
 	std::ostringstream stream;
 
-	(void) zoom;
-
-	stream << "tile_" << y << "_" << x << ".png";
+	// Unique between gpx2video processes
+	stream << "tile_" << settings().source() << "_" << zoom << "_" << y << "_" << x << "." << getpid() << ".png";
 
 	return stream.str();
 }
 
 
+std::string Map::buildStorePath(void) {
+	std::string path = std::getenv("HOME") + std::string("/.gpx2video/cache");
+
+	return TileStore::path(path, settings().source());
+}
+
+
 void Map::init(bool zoomfit) {
 	int zoom;
 
@@ -489,6 +524,12 @@ void Map::download(void) {
 
 	log_notice("Download map from %s...", MapSettings::getFriendlyName(settings().source()).c_str());
 
+	if ((store_ == NULL) && ((store_ = TileStore::open(buildStorePath())) == NULL)) {
+		log_error("Download map failure, can't open tiles store");
+		complete();
+		return;
+	}
+
 	nbr_downloads_ = 1;
 
 	// Build & download each tile
@@ -547,32 +588,15 @@ void Map::build(void) {
 
 	// Collapse echo tile
 	for (Tile *tile : tiles_) {
-		std::string filename = tile->path() + "/" + tile->filename();
+		OIIO::ImageBuf outbuf;
 
-		// Open tile image
-		auto img = OIIO::ImageInput::open(filename.c_str());
-
-		if (img == NULL) {
-			log_warn("Can't open '%s' tile", filename.c_str());
+		if (readTile(tile->x(), tile->y(), outbuf) == false) {
+			log_warn("Can't read tile %d/%d/%d", settings().zoom(), tile->x(), tile->y());
 			continue;
 		}
 
-		const OIIO::ImageSpec& spec = img->spec();
-		OIIO::TypeDesc::BASETYPE type = (OIIO::TypeDesc::BASETYPE) spec.format.basetype;
-
-		// Create tile buffer
-		OIIO::ImageBuf buf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type));
-		img->read_image(type, buf.localpixels());
-
-		// Add alpha channel
-		int channelorder[] = { 0, 1, 2, -1 /*use a float value*/ };
-		float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
-		std::string channelnames[] = { "", "", "", "A" };
-
-		OIIO::ImageBuf outbuf = OIIO::ImageBufAlgo::channels(buf, 4, channelorder, channelvalues, channelnames);
-
 		// Image over
-		out->write_tile((tile->x() - x1_) * TILESIZE, (tile->y() - y1_) * TILESIZE, 0, type, outbuf.localpixels());
+		out->write_tile((tile->x() - x1_) * TILESIZE, (tile->y() - y1_) * TILESIZE, 0, OIIO::TypeDesc::UINT8, outbuf.localpixels());
 	}
 
 	out->close();
@@ -601,16 +625,29 @@ void Map::draw(void) {
 
 	log_notice("Draw track...");
 
-	// Load map
-	load();
+	// Load track
+	if (load() == false)
+		return;
+
+	// Open map
+	auto img = OIIO::ImageInput::open(filename_);
+
+	if (img == NULL) {
+		log_warn("Can't load '%s' map file", filename_.c_str());
+		return;
+	}
 
-	// Create output image buffer
-	OIIO::ImageBuf buf(mapbuf_->spec());
+	const OIIO::ImageSpec& spec = img->spec();
+
+	OIIO::ImageBuf mapbuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, OIIO::TypeDesc::UINT8));
+	img->read_image(OIIO::TypeDesc::UINT8, mapbuf.localpixels());
+
+	// Create output image buffer & draw map
+	OIIO::ImageBuf buf(OIIO::ImageSpec(spec.width * divider_, spec.height * divider_, spec.nchannels, OIIO::TypeDesc::UINT8));
+	OIIO::ImageBufAlgo::resize(buf, mapbuf);
 
-	// Draw map
-	OIIO::ImageBufAlgo::over(buf, *mapbuf_, buf);
 	// Draw track
-	OIIO::ImageBufAlgo::over(buf, *trackbuf_, buf);
+	path(buf);
 
 	// Draw markers
 	drawPicto(buf, x_end_, y_end_, OIIO::ROI(), "./assets/marker/end.png", marker_size);
@@ -633,38 +670,259 @@ error:
 
 
 bool Map::load(void) {
-	if (Track::load() == false)
-		return false;
+	int size;
+	int width = settings().width();
+	int height = settings().height();
 
-	if (mapbuf_)
+	if (max_tiles_ > 0)
 		return true;
 
-	double divider = divider_; //settings().divider();
+	log_call();
 
-	std::string filename = app_.settings().inputfile();
+	if (loadPath() == false)
+		return false;
 
-	log_call();
+	// Twice the tiles of a viewport
+	size = std::max(1, (int) (TILESIZE * divider_));
 
-	// Open map
-	auto img = OIIO::ImageInput::open(filename_);
+	max_tiles_ = 2 * (width / size + 2) * (height / size + 2);
 
-	if (img == NULL) {
-		log_warn("Can't load '%s' map file", filename_.c_str());
+	return true;
+}
+
+
+int Map::tileOffset(int index) {
+	return (int) floor(index * TILESIZE * divider_);
+}
+
+
+bool Map::readTile(int x, int y, OIIO::ImageBuf &buf) {
+	int fd;
+
+	void *proxy;
+
+	const char *name;
+	const uint8_t *data = NULL;
+
+	TileStore::Entry entry;
+
+	OIIO::ImageInput::unique_ptr img;
+
+	if ((store_ != NULL) && store_->find(settings().zoom(), x, y, entry))
+		data = store_->data(entry);
+
+	if (data == NULL)
+		return false;
+
+	// Tiles are png or jpeg images
+	name = ((entry.length >= 2) && (data[0] == 0xff) && (data[1] == 0xd8)) ? "tile.jpg" : "tile.png";
+
+	OIIO::Filesystem::IOMemReader reader((void *) data, entry.length);
+
+	OIIO::ImageSpec spec;
+	OIIO::ImageSpec config;
+
+	proxy = &reader;
+	config.attribute("oiio:ioproxy", OIIO::TypeDesc::PTR, &proxy);
+
+	img = OIIO::ImageInput::create(name);
+
+	if (img == NULL)
 		return false;
+
+	// Read in place, else from a tmp file
+	if (img->supports("ioproxy")) {
+		if (img->open(name, spec, config) == false)
+			return false;
 	}
+	else {
+		char tmpname[] = "/tmp/tile-XXXXXX";
 
-	const OIIO::ImageSpec& spec = img->spec();
-	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
-	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+		if ((fd = mkstemp(tmpname)) < 0)
+			return false;
+
+		if (write(fd, data, entry.length) != (ssize_t) entry.length) {
+			close(fd);
+			unlink(tmpname);
+			return false;
+		}
+
+		close(fd);
+
+		img = OIIO::ImageInput::open(tmpname);
+
+		unlink(tmpname);
+
+		if (img == NULL)
+			return false;
+
+		spec = img->spec();
+	}
+
+	// Create tile buffer
+	OIIO::ImageBuf tilebuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, OIIO::TypeDesc::UINT8));
+	img->read_image(OIIO::TypeDesc::UINT8, tilebuf.localpixels());
+	img->close();
+
+	// Add alpha channel
+	int channelorder[] = { 0, 1, 2, -1 /*use a float value*/ };
+	float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
+	std::string channelnames[] = { "", "", "", "A" };
+
+	buf = OIIO::ImageBufAlgo::channels(tilebuf, 4, channelorder, channelvalues, channelnames);
+
+	return true;
+}
+
+
+OIIO::ImageBuf * Map::loadTile(int x, int y) {
+	int width, height;
+
+	OIIO::ImageBuf *buf;
+	OIIO::ImageBuf tilebuf;
+
+	// Tile size in the map
+	width = tileOffset(x - x1_ + 1) - tileOffset(x - x1_);
+	height = tileOffset(y - y1_ + 1) - tileOffset(y - y1_);
+
+	buf = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8));
+
+	if (readTile(x, y, tilebuf) == false) {
+		log_warn("Can't read tile %d/%d/%d", settings().zoom(), x, y);
+	}
+	else {
+		// Resize tile
+		if ((tilebuf.spec().width == width) && (tilebuf.spec().height == height))
+			buf->copy_pixels(tilebuf);
+		else
+			OIIO::ImageBufAlgo::resize(*buf, tilebuf);
+	}
+
+	// Draw track
+	path(*buf, tileOffset(x - x1_), tileOffset(y - y1_));
+
+	return buf;
+}
 
-	OIIO::ImageBuf buf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	img->read_image(type, buf.localpixels());
 
-	// Resize map
-	mapbuf_ = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	OIIO::ImageBufAlgo::resize(*mapbuf_, buf);
+void Map::drawTiles(OIIO::ROI roi) {
+	int i, j;
+	int i1, j1, i2, j2;
 
-	return (mapbuf_ != NULL);
+	double size = TILESIZE * divider_;
+
+	// Tiles in the area
+	i1 = std::max(0, (int) floor(roi.xbegin / size));
+	j1 = std::max(0, (int) floor(roi.ybegin / size));
+	i2 = std::min(x2_ - x1_, (int) floor(roi.xend / size) + 1);
+	j2 = std::min(y2_ - y1_, (int) floor(roi.yend / size) + 1);
+
+	OIIO::ImageBufAlgo::zero(*view_buf_, roi);
+
+	// Map & track tiles over
+	for (j=j1; j<j2; j++) {
+		for (i=i1; i<i2; i++) {
+			OIIO::ImageBuf *buf = tile(x1_ + i, y1_ + j);
+
+			buf->specmod().x = tileOffset(i);
+			buf->specmod().y = tileOffset(j);
+			Blend::over(*view_buf_, *buf, roi);
+		}
+	}
+}
+
+
+void Map::scroll(int offsetX, int offsetY, int width, int height) {
+	int row;
+	int dx, dy;
+	int count;
+
+	size_t stride;
+
+	uint8_t *data;
+
+	// First viewport
+	if (view_buf_ == NULL) {
+		view_buf_ = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8));
+
+		view_buf_->specmod().x = offsetX;
+		view_buf_->specmod().y = offsetY;
+
+		drawTiles(OIIO::ROI(offsetX, offsetX + width, offsetY, offsetY + height));
+		return;
+	}
+
+	dx = offsetX - view_buf_->spec().x;
+	dy = offsetY - view_buf_->spec().y;
+
+	if ((dx == 0) && (dy == 0))
+		return;
+
+	view_buf_->specmod().x = offsetX;
+	view_buf_->specmod().y = offsetY;
+
+	// Moved out of the previous viewport, full redraw
+	if ((abs(dx) >= width) || (abs(dy) >= height)) {
+		drawTiles(OIIO::ROI(offsetX, offsetX + width, offsetY, offsetY + height));
+		return;
+	}
+
+	// Shift the previous viewport by (-dx, -dy)
+	data = (uint8_t *) view_buf_->localpixels();
+	stride = (size_t) width * 4;
+	count = width - abs(dx);
+
+	if (dy >= 0) {
+		for (row=0; row<height-dy; row++)
+			memmove(data + row * stride + std::max(0, -dx) * 4, data + (row + dy) * stride + std::max(0, dx) * 4, count * 4);
+	}
+	else {
+		for (row=height-1; row>=-dy; row--)
+			memmove(data + row * stride + std::max(0, -dx) * 4, data + (row + dy) * stride + std::max(0, dx) * 4, count * 4);
+	}
+
+	// Draw the new strips only
+	if (dx > 0)
+		drawTiles(OIIO::ROI(offsetX + width - dx, offsetX + width, offsetY, offsetY + height));
+	else if (dx < 0)
+		drawTiles(OIIO::ROI(offsetX, offsetX - dx, offsetY, offsetY + height));
+
+	if (dy > 0)
+		drawTiles(OIIO::ROI(offsetX, offsetX + width, offsetY + height - dy, offsetY + height));
+	else if (dy < 0)
+		drawTiles(OIIO::ROI(offsetX, offsetX + width, offsetY, offsetY - dy));
+}
+
+
+OIIO::ImageBuf * Map::tile(int x, int y) {
+	OIIO::ImageBuf *buf;
+
+	TileKey key(settings().zoom(), x, y);
+
+	auto it = lru_index_.find(key);
+
+	// Cached tile, now the most recent
+	if (it != lru_index_.end()) {
+		lru_tiles_.splice(lru_tiles_.begin(), lru_tiles_, it->second);
+		return it->second->second;
+	}
+
+	buf = loadTile(x, y);
+
+	// Drop the least recently used tiles
+	while (!lru_tiles_.empty() && (lru_tiles_.size() >= max_tiles_)) {
+		TileEntry &entry = lru_tiles_.back();
+
+		lru_index_.erase(entry.first);
+		delete entry.second;
+
+		lru_tiles_.pop_back();
+	}
+
+	lru_tiles_.push_front(TileEntry(key, buf));
+	lru_index_[key] = lru_tiles_.begin();
+
+	return buf;
 }
 
 
@@ -703,8 +961,8 @@ OIIO::ImageBuf * Map::render(const TelemetryData &data, bool &is_update) {
 
 	int border = this->border();
 
-	// Check map & track buffers
-	if ((mapbuf_ == NULL) || (trackbuf_ == NULL)) {
+	// Check map & track
+	if (max_tiles_ == 0) {
 		log_warn("Map renderer failure");
 		return NULL;
 	}
@@ -728,6 +986,15 @@ OIIO::ImageBuf * Map::render(const TelemetryData &data, bool &is_update) {
 	posX *= divider;
 	posY *= divider;
 
+	// Marker on the same pixel (per frame interpolation)
+	if ((fg_buf_ != NULL) && (posX == x_pos_) && (posY == y_pos_)) {
+		is_update = false;
+		goto skip;
+	}
+
+	x_pos_ = posX;
+	y_pos_ = posY;
+
 	offsetX = posX - (width / 2);
 	offsetY = posY - (height / 2);
 
@@ -740,24 +1007,28 @@ OIIO::ImageBuf * Map::render(const TelemetryData &data, bool &is_update) {
 	if (offsetY > lim_y2_)
 		offsetY = lim_y2_;
 
-	// Image buffer
-	if (fg_buf_ != NULL)
+	// Map & track in the viewport
+	scroll(offsetX, offsetY, width, height);
+
+	// Image buffer, created again if the renderer resized or rotated it
+	// (only the viewport is kept between frames)
+	if ((fg_buf_ != NULL) && ((fg_buf_->spec().width != this->width()) || (fg_buf_->spec().height != this->height())
+			|| (fg_buf_->spec().x != 0) || (fg_buf_->spec().y != 0))) {
 		delete fg_buf_;
+		fg_buf_ = NULL;
+	}
 
-	this->createBox(&fg_buf_, this->width(), this->height());
+	if (fg_buf_ == NULL)
+		this->createBox(&fg_buf_, this->width(), this->height());
 
-	// Map image over
-	mapbuf_->specmod().x = x - offsetX;
-	mapbuf_->specmod().y = y - offsetY;
-	OIIO::ImageBufAlgo::over(*fg_buf_, *mapbuf_, *fg_buf_, OIIO::ROI(x, x + width, y, y + height));
+	// Viewport copy at (x, y), markers are redrawn over
+	OIIO::ImageSpec viewspec = view_buf_->spec();
+	viewspec.x = x;
+	viewspec.y = y;
 
-	// Track image over
-	trackbuf_->specmod().x = x - offsetX;
-	trackbuf_->specmod().y = y - offsetY;
-	OIIO::ImageBufAlgo::over(*fg_buf_, *trackbuf_, *fg_buf_, OIIO::ROI(x, x + width, y, y + height));
+	OIIO::ImageBuf view(viewspec, view_buf_->localpixels());
 
-	// Draw track
-	// ...
+	fg_buf_->copy_pixels(view);
 
 	// Draw picto
 	if (marker_size > 0) {
@@ -819,6 +1090,15 @@ void Map::downloadComplete(Map::Tile &tile) {
 
 	printf("\n");
 
+	// Index the new tiles
+	map.store_->flush();
+
+	// Video rendering reads the tiles in the viewport only
+	if ((map.app_.command() != GPXApplication::CommandMap) && (map.app_.command() != GPXApplication::CommandTrack)) {
+		map.complete();
+		return;
+	}
+
 	// Now build full map)
 	map.build();
 }
@@ -829,9 +1109,6 @@ Map::Tile::Tile(Map &map, int zoom, int x, int y)
 	, zoom_(zoom)
 	, x_(x)
 	, y_(y) {
-	fp_ = NULL;
-	evtaskh_ = NULL;
-
 	last_update_ = 0;
 
 	uri_ = map_.buildURI(zoom_, x_, y_);
@@ -864,117 +1141,71 @@ const std::string& Map::Tile::filename(void) {
 }
 
 
-int Map::Tile::downloadDebug(CURL *curl, curl_infotype type, char *ptr, size_t size, void *userdata) {
-	(void) curl;
-	(void) type;
-	(void) userdata;
-
-	fwrite(ptr, size, 1, stdout);
-
-	return 0;
-}
-
-
-int Map::Tile::downloadProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
-	Map::Tile *tile = (Map::Tile *) clientp;
-
-	(void) ultotal;
-	(void) ulnow;
+void Map::Tile::downloadProgress(curl_off_t dltotal, curl_off_t dlnow, void *userdata) {
+	Map::Tile *tile = (Map::Tile *) userdata;
 
 	Map::downloadProgress(*tile, dltotal, dlnow);
-
-	return 0;
 }
 
 
-size_t Map::Tile::downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata) {
+void Map::Tile::downloadComplete(Downloader::Result result, const std::string &etag, void *userdata) {
 	Map::Tile *tile = (Map::Tile *) userdata;
 
-	if (ptr == NULL)
-		return 0;
-
-	std::string output = tile->path_ + "/" + tile->filename_;
+	TileStore *store = tile->map().store();
 
-	// Open output tile file
-	if (tile->fp_ == NULL) {
-		tile->fp_ = std::fopen(output.c_str(), "w+");
-
-		if (tile->fp_ == NULL)
-			return 0;
-	}
-
-	fwrite(ptr, size, nmemb, tile->fp_);
-
-	return size * nmemb;
-}
-
-
-void Map::Tile::downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata) {
-	Map::Tile *tile = (Map::Tile *) userdata;
+	std::string output = tile->path() + "/" + tile->filename();
 
 	log_call();
 
-	(void) evtaskh;
-	(void) result;
-
-	if (tile->fp_)
-		std::fclose(tile->fp_);
+	// Downloaded, moved to the store
+	if (result == Downloader::ResultOk) {
+		std::ifstream stream(output, std::ios::binary);
+		std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
 
-	if (result != CURLE_OK) {
-		std::string output = tile->path_ + "/" + tile->filename_;
+		if (store->put(tile->zoom_, tile->x_, tile->y_, data.data(), data.length(), etag, time(NULL)) == false)
+			log_error("\nStore tile failure: %s", tile->uri().c_str());
 
-		log_error("\nDownload tile failure: %s", tile->uri().c_str());
-
-		unlink(output.c_str());
+		::unlink(output.c_str());
 	}
-
-	tile->fp_ = NULL;
-	tile->evtaskh_ = NULL;
+	// Stored tile is still valid
+	else if (result == Downloader::ResultNotModified)
+		store->touch(tile->zoom_, tile->x_, tile->y_, time(NULL));
+	// Stored tile (if any) is kept
+	else
+		log_error("\nDownload tile failure: %s", tile->uri().c_str());
 
 	Map::downloadComplete(*tile);
 }
 
 
 bool Map::Tile::download(void) {
-	struct stat st;
+	time_t mtime = 0;
 
+	std::string etag;
 	std::string output = path_ + "/" + filename_;
 
+	TileStore::Entry entry;
+	TileStore *store = map_.store();
+
 	log_call();
 
 	::mkpath(path_, 0700);
 
-	// Check if file exists in cache
-	if (access(output.c_str(), F_OK) == 0) {
-		// Check file content
-		stat(output.c_str(), &st);
-
-		if (st.st_size > 0) {
+	// Check if tile is in the store (& is recent)
+	if (store->find(zoom_, x_, y_, entry)) {
+		if (time(NULL) - entry.fetched_at < TILE_MAX_AGE) {
+			store->access(zoom_, x_, y_, true);
 			Map::downloadComplete(*this);
 			return true;
 		}
-	}
-	
-	// Download
-	evtaskh_ = map_.evcurl()->download(uri_.c_str(), downloadComplete, this);
-
-//	evtaskh_->setOption(CURLOPT_VERBOSE, 1L);
-//	evtaskh_->setOption(CURLOPT_DEBUGFUNCTION, downloadDebug);
-//	evtaskh_->setOption(CURLOPT_DEBUGDATA, this);
 
-	evtaskh_->setOption(CURLOPT_NOPROGRESS, 0L);
-	evtaskh_->setOption(CURLOPT_XFERINFOFUNCTION, downloadProgress);
-	evtaskh_->setOption(CURLOPT_XFERINFODATA, this);
-	
-	evtaskh_->setOption(CURLOPT_WRITEFUNCTION, downloadWrite);
-	evtaskh_->setOption(CURLOPT_WRITEDATA, this);
-
-	evtaskh_->setOption(CURLOPT_FOLLOWLOCATION, 1L);
-
-	evtaskh_->setHeader("User-Agent: gpx2video");
+		etag = store->etag(entry);
+		mtime = entry.fetched_at;
+	}
 
-	evtaskh_->perform();
+	// Access time, for the cache eviction
+	store->access(zoom_, x_, y_, false);
 
-	return true;
+	// Download (or revalidate)
+	return map_.downloader()->download(uri_, output, etag, mtime, downloadComplete, downloadProgress, this);
 }
-
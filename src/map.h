@@ -7,6 +7,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <list>
+#include <map>
+#include <tuple>
 
 #include <stdlib.h>
 
@@ -15,7 +17,8 @@
 #include <OpenImageIO/imagebufalgo.h>
 
 #include "log.h"
-#include "evcurl.h"
+#include "downloader.h"
+#include "tilestore.h"
 #include "track.h"
 #include "mapsettings.h"
 #include "videowidget.h"
@@ -45,10 +48,8 @@ public:
 		bool download(void);
 
 	protected:
-		static int downloadDebug(CURL *curl, curl_infotype type, char *ptr, size_t size, void *userdata);
-		static int downloadProgress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
-		static size_t downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata);
-		static void downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata);
+		static void downloadProgress(curl_off_t dltotal, curl_off_t dlnow, void *userdata);
+		static void downloadComplete(Downloader::Result result, const std::string &etag, void *userdata);
 
 	private:
 		Map &map_;
@@ -57,8 +58,6 @@ public:
 		std::string uri_;
 		std::string path_;
 		std::string filename_;
-		std::FILE *fp_;
-		EVCurlTask *evtaskh_;
 	};
 
 	virtual ~Map();
@@ -90,14 +89,33 @@ public:
 	static void downloadComplete(Tile &tile);
 
 protected:
-	EVCurl *evcurl(void) {
-		return evcurl_;
+	Downloader *downloader(void) {
+		return downloader_;
+	}
+
+	TileStore *store(void) {
+		return store_;
 	}
 
 	void init(bool zoomfit=false);
 	void limits(void);
 	bool load(void);
 
+	// Decoded tile (map & track path, divider applied)
+	OIIO::ImageBuf * tile(int x, int y);
+	OIIO::ImageBuf * loadTile(int x, int y);
+
+	// Tile image from the store (RGBA)
+	bool readTile(int x, int y, OIIO::ImageBuf &buf);
+
+	// Tile position in the map (divider applied)
+	int tileOffset(int index);
+
+	// Draw the tiles in roi (map position) of the viewport
+	void drawTiles(OIIO::ROI roi);
+	// Move the viewport to (x, y), the still visible part is reused
+	void scroll(int x, int y, int width, int height);
+
 	// Download each tule
 	void download(void);
 	// Draw the full map
@@ -107,19 +125,32 @@ private:
 	OIIO::ImageBuf *bg_buf_;
 	OIIO::ImageBuf *fg_buf_;
 
+	// Last viewport (map & track), at its map position
+	OIIO::ImageBuf *view_buf_;
+
 	Map(GPXApplication &app, const MapSettings &settings, struct event_base *evbase);
 
 	std::string buildURI(int zoom, int x, int y);
 	std::string buildPath(int zoom, int x, int y);
 	std::string buildFilename(int zoom, int x, int y);
+	std::string buildStorePath(void);
 
 	MapSettings settings_;
 
-	EVCurl *evcurl_;
+	Downloader *downloader_;
+
+	// Tiles of the map source
+	TileStore *store_;
+
+	// Decoded tiles LRU, keyed by (zoom, x, y), the most recent first
+	typedef std::tuple<int, int, int> TileKey;
+	typedef std::pair<TileKey, OIIO::ImageBuf *> TileEntry;
 
-	OIIO::ImageBuf *mapbuf_;
+	size_t max_tiles_;
+	std::list<TileEntry> lru_tiles_;
+	std::map<TileKey, std::list<TileEntry>::iterator> lru_index_;
 
-	// Map filename to tmp save
+	// Map filename (map & track commands)
 	std::string filename_;
 
 	// Bounding box (track area)
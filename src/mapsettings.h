@@ -43,6 +43,10 @@ public:
 	const double& divider(void) const;
 	void setDivider(const double &divier);
 
+	// Tile downloads in flight
+	const int& maxDownloads(void) const;
+	void setMaxDownloads(const int &max);
+
 	static const std::string getFriendlyName(const Source &source);
 	static const std::string getCopyright(const Source &source);
 	static int getMinZoom(const Source &source);
@@ -52,6 +56,8 @@ public:
 private:
 	double divider_;
 
+	int max_downloads_;
+
 	enum Source source_;
 };
 
@@ -32,6 +32,8 @@
 #include "widgets/text.h"
 #include "widgets/time.h"
 #include "widgets/temperature.h"
+#include "blend.h"
+#include "telemetrycache.h"
 #include "renderer.h"
 
 
@@ -56,12 +58,22 @@ bool Renderer::init(MediaContainer *container) {
 
 	TelemetrySettings::Method telemetry_method = telemetrySettings().telemetryMethod();
 
+	TelemetryTimelinePtr timeline;
+
 	log_call();
 
 	if (telemetry_method == TelemetrySettings::MethodNone)
 		telemetry_method = TelemetrySettings::MethodSample;
 
-	source_ = TelemetryMedia::open(app_.settings().inputfile(), telemetry_method);
+	// Computed telemetry data, if cached (see 'gpxtools cache')
+	timeline = TelemetryCache::load(app_.settings().inputfile(),
+		telemetry_method, telemetrySettings().telemetryRate(), telemetrySettings().telemetryDistance(),
+		app_.settings().from(), app_.settings().to());
+
+	if (timeline != NULL)
+		source_ = TelemetryMedia::open(timeline, telemetry_method);
+	else
+		source_ = TelemetryMedia::open(app_.settings().inputfile(), telemetry_method);
 
 	// Media
 	container_ = container;
@@ -72,6 +84,8 @@ bool Renderer::init(MediaContainer *container) {
 	// Telemetry data initialization
 	if (source_) {
 		// Telemetry data limits
+		source_->setDistance(telemetrySettings().telemetryDistance());
+		source_->setInterpolation(telemetrySettings().telemetryInterpolation());
 		source_->setFrom(app_.settings().from());
 		source_->setTo(app_.settings().to());
 
@@ -218,6 +232,8 @@ bool Renderer::loadMap(layout::Map *m) {
 	TelemetryData p1, p2;
 	source->getBoundingBox(&p1, &p2);
 
+	delete source;
+
 	// Alignment
 	s = (const char *) m->align();
 	align = VideoWidget::string2align(s);
@@ -319,6 +335,8 @@ bool Renderer::loadTrack(layout::Track *t) {
 	TelemetryData p1, p2;
 	source->getBoundingBox(&p1, &p2);
 
+	delete source;
+
 	// Alignment
 	s = (const char *) t->align();
 	align = VideoWidget::string2align(s);
@@ -1067,7 +1085,97 @@ void Renderer::resize(OIIO::ImageBuf *buf, int width, int height) {
 	OIIO::ImageBuf out(OIIO::ImageSpec(width, height, spec.nchannels, type));
 	OIIO::ImageBufAlgo::resize(out, *buf);
 
-	*buf = out;
+	buf->swap(out);
+}
+
+
+void Renderer::transform(OIIO::ImageBuf *buf, int width, int height, int orientation) {
+	float sx, sy;
+
+	const OIIO::ImageSpec& spec = buf->spec();
+	OIIO::TypeDesc::BASETYPE type = (OIIO::TypeDesc::BASETYPE) spec.format.basetype;
+
+	Imath::M33f M;
+
+	orientation = ((orientation % 360) + 360) % 360;
+
+	// Only one of resize or rotate, no need to resample twice
+	if (orientation == 0) {
+		resize(buf, width, height);
+		return;
+	}
+
+	if ((width == spec.width) && (height == spec.height)) {
+		rotate(buf, orientation);
+		return;
+	}
+
+	// Fuse resize & rotate in a single warp, from the widget buffer
+	// to the final on-frame geometry (same rotations as rotate())
+	sx = (float) width / spec.width;
+	sy = (float) height / spec.height;
+
+	switch (orientation) {
+	case 90:
+		M = Imath::M33f(0, -sx, 0, sy, 0, 0, 0, width, 1);
+		std::swap(width, height);
+		break;
+
+	case 270:
+		M = Imath::M33f(0, sx, 0, -sy, 0, 0, height, 0, 1);
+		std::swap(width, height);
+		break;
+
+	case 180:
+		M = Imath::M33f(-sx, 0, 0, 0, -sy, 0, width, height, 1);
+		break;
+
+	default:
+		resize(buf, width, height);
+		rotate(buf, orientation);
+		return;
+	}
+
+	OIIO::ImageBuf out(OIIO::ImageSpec(width, height, spec.nchannels, type));
+	OIIO::ImageBufAlgo::warp(out, *buf, M);
+
+	buf->swap(out);
+}
+
+
+void Renderer::addOverlayROI(const OIIO::ROI &roi) {
+	bool merged;
+
+	OIIO::ROI dirty = OIIO::roi_intersection(roi, overlay_->roi());
+
+	if (!dirty.defined() || (dirty.npixels() == 0))
+		return;
+
+	// Blending twice the same pixel isn't idempotent, so overlapping
+	// areas are merged in their bounding box
+	do {
+		merged = false;
+
+		for (std::vector<OIIO::ROI>::iterator it = overlay_rois_.begin(); it != overlay_rois_.end(); ++it) {
+			OIIO::ROI inter = OIIO::roi_intersection(dirty, *it);
+
+			if (inter.defined() && (inter.npixels() > 0)) {
+				dirty = OIIO::roi_union(dirty, *it);
+				overlay_rois_.erase(it);
+				merged = true;
+				break;
+			}
+		}
+	} while (merged);
+
+	overlay_rois_.push_back(dirty);
+}
+
+
+void Renderer::drawOverlay(OIIO::ImageBuf &buf) {
+	// Only blend overlay areas where static widgets have been drawn
+	for (const OIIO::ROI &roi : overlay_rois_)
+		Blend::over(buf, *overlay_, roi);
 }
 
 
@@ -38,7 +38,9 @@ public:
 			int32_t video_crf=-1,
 			int64_t video_bit_rate=0,
 			int64_t video_min_bit_rate=0,
-			int64_t video_max_bit_rate=0)
+			int64_t video_max_bit_rate=0,
+			int video_threads=0,
+			bool video_yuv=false)
 		: media_file_(media_file)
 		, layout_file_(layout_file)
 		, time_factor_auto_(time_factor_auto)
@@ -49,7 +51,9 @@ public:
 		, video_crf_(video_crf)
 		, video_bit_rate_(video_bit_rate)
 		, video_min_bit_rate_(video_min_bit_rate)
-		, video_max_bit_rate_(video_max_bit_rate) {
+		, video_max_bit_rate_(video_max_bit_rate)
+		, video_threads_(video_threads)
+		, video_yuv_(video_yuv) {
 	}
 	virtual ~RendererSettings() {
 	}
@@ -98,6 +102,14 @@ public:
 		return video_max_bit_rate_;
 	}
 
+	const int& videoThreads(void) const {
+		return video_threads_;
+	}
+
+	const bool& isVideoYUV(void) const {
+		return video_yuv_;
+	}
+
 private:
 	std::string media_file_;
 	std::string layout_file_;
@@ -112,6 +124,8 @@ private:
 	int64_t video_bit_rate_;
 	int64_t video_min_bit_rate_;
 	int64_t video_max_bit_rate_;
+	int video_threads_;
+	bool video_yuv_;
 };
 
 
@@ -147,6 +161,9 @@ protected:
 
 	OIIO::ImageBuf *overlay_;
 
+	// Areas of the overlay with static widgets (never overlapping)
+	std::vector<OIIO::ROI> overlay_rois_;
+
 	Renderer(GPXApplication &app, 
 			RendererSettings &rendererSettings, TelemetrySettings &telemetrySettings); //, Map *map);
 
@@ -159,6 +176,9 @@ protected:
 
 	void rotate(OIIO::ImageBuf *buf, int orientation);
 	void resize(OIIO::ImageBuf *buf, int width, int height);
+	void transform(OIIO::ImageBuf *buf, int width, int height, int orientation);
+	void addOverlayROI(const OIIO::ROI &roi);
+	void drawOverlay(OIIO::ImageBuf &buf);
 	void add(OIIO::ImageBuf *frame, int x, int y, const char *picto, const char *label, const char *value, double divider=1.9);
 };
 
@@ -14,10 +14,14 @@
 TelemetrySettings::TelemetrySettings(
 		TelemetrySettings::Method method,
 		int rate,
-		TelemetrySettings::Format format)
+		TelemetrySettings::Format format,
+		TelemetrySettings::Distance distance,
+		TelemetrySettings::Interpolation interpolation)
 		: telemetry_format_(format)
 		, telemetry_method_(method)
-		, telemetry_rate_(rate) {
+		, telemetry_rate_(rate)
+		, telemetry_distance_(distance)
+		, telemetry_interpolation_(interpolation) {
 }
 
 
@@ -40,6 +44,16 @@ const int& TelemetrySettings::telemetryRate(void) const {
 }
 
 
+const TelemetrySettings::Distance& TelemetrySettings::telemetryDistance(void) const {
+	return telemetry_distance_;
+}
+
+
+const TelemetrySettings::Interpolation& TelemetrySettings::telemetryInterpolation(void) const {
+	return telemetry_interpolation_;
+}
+
+
 const std::string TelemetrySettings::getFriendlyName(const TelemetrySettings::Method &method) {
 	switch (method) {
 	case MethodNone:
@@ -90,6 +104,9 @@ void Telemetry::init(void) {
 
 	source_ = TelemetryMedia::open(app_.settings().inputfile(), settings().telemetryMethod());
 
+	if (source_ != NULL)
+		source_->setDistance(settings().telemetryDistance());
+
 	output_format_ = settings().telemetryFormat();
 
 	if (settings().telemetryFormat() == TelemetrySettings::FormatAuto) {
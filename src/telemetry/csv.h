@@ -1,23 +1,39 @@
 #ifndef __GPX2VIDEO__CSV_H__
 #define __GPX2VIDEO__CSV_H__
 
-#include <fstream>
-#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "log.h"
 #include "telemetrymedia.h"
 
 
+// CSV reader: the file is memory mapped, lines & columns are tokenized in
+// place (no copy) and numbers parsed with std::from_chars.
 class CSV : public TelemetrySource {
 public:
 	CSV(const std::string &filename)
-		: TelemetrySource(filename) {
+		: TelemetrySource(filename)
+		, data_(NULL)
+		, size_(0) {
+		int fd;
+
+		struct stat st;
+
 		line_ = 0;
 
 		sep_ = ',';
 
+		pos_ = end_ = NULL;
+
 		// Column index
 		index_timestamp_ = -1;
 		index_total_duration_ = -1;
@@ -47,19 +63,38 @@ public:
 			goto failure;
 		}
 
+		if ((fd = ::open(filename.c_str(), O_RDONLY)) < 0)
+			goto failure;
+
+		if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+			data_ = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data_ == MAP_FAILED) {
+				log_error("Map '%s' CSV file failure", filename.c_str());
+				data_ = NULL;
+			}
+			else {
+				size_ = st.st_size;
+				madvise((void *) data_, size_, MADV_SEQUENTIAL);
+			}
+		}
+
+		::close(fd);
+
 failure:
 		return;
 	}
 
 	virtual ~CSV() {
+		if (data_ != NULL)
+			munmap((void *) data_, size_);
 	}
-	
-	void reset() {
-		std::string line;
 
+	void reset() {
 		log_call();
 
-		stream_.seekg(0, stream_.beg);
+		pos_ = data_;
+		end_ = data_ + size_;
 
 		line_ = 0;
 
@@ -70,83 +105,75 @@ failure:
 	}
 
 	enum TelemetrySource::Data read(TelemetrySource::Point &point) {
-		std::string line;
-
-		std::vector<std::string> columns;
-
-		enum TelemetrySource::Data type = TelemetrySource::DataUnknown;
+		std::string_view line;
 
 		log_call();
 
-		type = readLine(line);
-		parseLine(columns, line);
+		// Skip empty lines
+		do {
+			if (readLine(line) == TelemetrySource::DataEof)
+				return TelemetrySource::DataEof;
+		} while (line.find_first_not_of(" \t\r") == std::string_view::npos);
 
-		if (type == TelemetrySource::DataEof)
-			goto eof;
+		parseLine(columns_, line);
 
-		writePoint(columns, point);
+		writePoint(columns_, point);
 
-eof:
-		return type;
+		return TelemetrySource::DataAgain;
 	}
 
 	bool readAndParseHeader() {
-		std::string line;
-
-		std::vector<std::string> columns;
-
-		enum TelemetrySource::Data type = TelemetrySource::DataUnknown;
+		std::string_view line;
 
 		log_call();
 
-		type = readLine(line);
-		parseFormat(line);
-		parseLine(columns, line);
-
-		if (type == TelemetrySource::DataEof)
+		if (readLine(line) == TelemetrySource::DataEof)
 			goto eof;
 
-		// Timestamp, Time, Total duration, Partial duration, RideTime, 
-		// Data, 
-		// Lat, Lon, Ele, 
-		// Grade, Distance, Speed, MaxSpeed, Average, Ride Average, 
+		parseFormat(line);
+		parseLine(columns_, line);
+
+		// Timestamp, Time, Total duration, Partial duration, RideTime,
+		// Data,
+		// Lat, Lon, Ele,
+		// Grade, Distance, Speed, MaxSpeed, Average, Ride Average,
 		// Cadence, Heartrate, Lap
-		for (size_t i=0; i<columns.size(); i++) {
-			if (columns[i] == "Timestamp")
+		for (size_t i=0; i<columns_.size(); i++) {
+			if (columns_[i] == "Timestamp")
 				index_timestamp_ = i;
-			else if (columns[i] == "Total duration")
+			else if (columns_[i] == "Total duration")
 				index_total_duration_ = i;
-			else if (columns[i] == "Partial duration")
+			else if (columns_[i] == "Partial duration")
 				index_partial_duration_ = i;
-			else if (columns[i] == "RideTime")
+			else if (columns_[i] == "RideTime")
 				index_ridetime_ = i;
-			else if (columns[i] == "Data")
+			else if (columns_[i] == "Data")
 				index_data_ = i;
-			else if ((columns[i] == "Lat") || (columns[i] == "Latitude"))
+			else if ((columns_[i] == "Lat") || (columns_[i] == "Latitude"))
 				index_latitude_ = i;
-			else if ((columns[i] == "Lon") || (columns[i] == "Longitude"))
+			else if ((columns_[i] == "Lon") || (columns_[i] == "Longitude"))
 				index_longitude_ = i;
-			else if ((columns[i] == "Ele") || (columns[i] == "Elevation"))
+			else if ((columns_[i] == "Ele") || (columns_[i] == "Elevation"))
 				index_elevation_ = i;
-			else if (columns[i] == "Grade")
+			else if (columns_[i] == "Grade")
 				index_grade_ = i;
-			else if (columns[i] == "Distance")
+			else if (columns_[i] == "Distance")
 				index_distance_ = i;
-			else if (columns[i] == "Speed")
+			else if (columns_[i] == "Speed")
 				index_speed_ = i;
-			else if (columns[i] == "MaxSpeed")
+			else if (columns_[i] == "MaxSpeed")
 				index_maxspeed_ = i;
-			else if (columns[i] == "Average")
+			else if (columns_[i] == "Average")
 				index_avgspeed_ = i;
-			else if (columns[i] == "Ride Average")
+			else if (columns_[i] == "Ride Average")
 				index_avgridespeed_ = i;
-			else if (columns[i] == "Cadence")
+			else if (columns_[i] == "Cadence")
 				index_cadence_ = i;
-			else if (columns[i] == "Heartrate")
+			else if (columns_[i] == "Heartrate")
 				index_heartrate_ = i;
-			else if (columns[i] == "Temperature")
+			else if (columns_[i] == "Temperature")
 				index_temperature_ = i;
-			else if (columns[i] == "Lap")
+			else if (columns_[i] == "Lap")
 				index_lap_ = i;
 		}
 
@@ -156,28 +183,37 @@ eof:
 		return false;
 	}
 
-	enum TelemetrySource::Data readLine(std::string &line) {
+	enum TelemetrySource::Data readLine(std::string_view &line) {
+		const char *eol;
+
 		log_call();
 
-		if (!std::getline(stream_, line))
+		if ((pos_ == NULL) || (pos_ >= end_))
 			return TelemetrySource::DataEof;
 
+		eol = (const char *) memchr(pos_, '\n', end_ - pos_);
+
+		if (eol == NULL)
+			eol = end_;
+
+		line = std::string_view(pos_, eol - pos_);
+
+		pos_ = (eol < end_) ? eol + 1 : end_;
+
+		line_++;
+
 		return TelemetrySource::DataAgain;
 	}
 
-	bool parseFormat(std::string line) {
-		auto pos = line.find(";");
-
+	bool parseFormat(std::string_view line) {
 		// ';' as column separator
-		if (pos < line.length()) {
+		if (line.find(';') != std::string_view::npos) {
 			sep_ = ';';
 			return true;
 		}
 
 		// ',' as column separator
-		pos = line.find(",");
-
-		if (pos < line.length()) {
+		if (line.find(',') != std::string_view::npos) {
 			sep_ = ',';
 			return true;
 		}
@@ -185,120 +221,145 @@ eof:
 		return false;
 	}
 
-	bool parseLine(std::vector<std::string> &columns, std::string line) {
-		std::string column;
-
-		bool loop = true;
-		bool withQ = false;
-		std::string part{""};
+	bool parseLine(std::vector<std::string_view> &columns, std::string_view line) {
+		size_t i, begin;
 
-		std::stringstream ss(line);
+		bool escaped;
 
 		log_call();
 
-		line_++;
+		columns.clear();
 
-		while ((loop == true) && !ss.eof()) {
-			while (std::getline(ss, column, sep_)) {
-				for (; column.length() > 0;) {
-					auto pos = column.find("\"");
+		// Unescaped columns never exceed the line, so the views stay valid
+		unescaped_.clear();
+		unescaped_.reserve(line.length());
 
-					// " found
-					if (pos < column.length()) {
-						part += column.substr(0, pos);
+		for (i=0; i<=line.length(); i++) {
+			// Skip leading spaces
+			for (; (i < line.length()) && isSpace(line[i]); i++);
 
-						column = column.substr(pos + 1, column.length());
+			begin = i;
 
-						if (withQ && (column[0] == '"')) {
-							part += '"';
-							column = column.substr(1, column.length());
-						}
-						else 
-							withQ = !withQ;
-					}
+			// Quoted column, may contain the separator
+			if ((i < line.length()) && (line[i] == '"')) {
+				begin = ++i;
+				escaped = false;
 
-					if (!withQ) {
-						column = trim(part + column);
-						columns.emplace_back(std::move(column));
-						part = "";
-						loop = false;
-					} 
-					else if (column.find("\"") < column.length()) {
-					}
-					else {
-						part += column + ",";
-						column = "";
+				for (; i < line.length(); i++) {
+					if (line[i] != '"')
+						continue;
+
+					// Escaped quote
+					if ((i + 1 < line.length()) && (line[i + 1] == '"')) {
+						escaped = true;
+						i++;
 					}
+					else
+						break;
 				}
+
+				if (escaped)
+					columns.emplace_back(trim(unescape(line.substr(begin, i - begin))));
+				else
+					columns.emplace_back(trim(line.substr(begin, i - begin)));
+
+				// Skip up to the separator
+				for (; (i < line.length()) && (line[i] != sep_); i++);
+			}
+			else {
+				for (; (i < line.length()) && (line[i] != sep_); i++);
+
+				columns.emplace_back(trim(line.substr(begin, i - begin)));
 			}
 		}
 
 		return true;
 	}
 
-	void writePoint(std::vector<std::string> &columns, TelemetrySource::Point &point) {
-		// 0: Timestamp, 1: Time, 2: Total duration, 3: Partial duration, 4: RideTime, 
-		// 5: Data, 
-		// 6: Lat, 7: Lon, 8: Ele, 
-		// 9:Grade, 10: Distance, 11: Speed, 12: MaxSpeed, 13: Average, 14: Ride Average, 
+	void writePoint(std::vector<std::string_view> &columns, TelemetrySource::Point &point) {
+		int value;
+
+		uint64_t timestamp;
+
+		// 0: Timestamp, 1: Time, 2: Total duration, 3: Partial duration, 4: RideTime,
+		// 5: Data,
+		// 6: Lat, 7: Lon, 8: Ele,
+		// 9:Grade, 10: Distance, 11: Speed, 12: MaxSpeed, 13: Average, 14: Ride Average,
 		// 15: Cadence, 16: Heartrate, 17: Lap
 		point.setLine(line_);
 
 		if (index_data_ != -1)
-			point.setType(columns[index_data_]);
+			point.setType(std::string(column(columns, index_data_)));
+
+		if ((index_timestamp_ != -1) && (index_latitude_ != -1) && (index_longitude_ != -1)) {
+			timestamp = 0;
+
+			str2int(column(columns, index_timestamp_), timestamp);
 
-		if ((index_timestamp_ != -1) && (index_latitude_ != -1) && (index_longitude_ != -1))
 			point.setPosition(
-				strtoul(columns[index_timestamp_].c_str(), NULL, 0) * 1000,
-				strtod(columns[index_latitude_].c_str(), NULL),
-				strtod(columns[index_longitude_].c_str(), NULL)
+				timestamp * 1000,
+				str2double(column(columns, index_latitude_)),
+				str2double(column(columns, index_longitude_))
 			);
+		}
 
 		if (index_elevation_ != -1)
-			point.setElevation(str2double(columns[index_elevation_]));
+			point.setElevation(str2double(column(columns, index_elevation_)));
 
 		if (index_total_duration_ != -1)
-			point.setDuration(strtod(columns[index_total_duration_].c_str(), NULL));
+			point.setDuration(str2double(column(columns, index_total_duration_)));
 
 		if (index_partial_duration_ != -1)
-			point.setElapsedTime(strtod(columns[index_partial_duration_].c_str(), NULL));
+			point.setElapsedTime(str2double(column(columns, index_partial_duration_)));
 
 		if (index_grade_ != -1)
-			point.setGrade(strtod(columns[index_grade_].c_str(), NULL));
+			point.setGrade(str2double(column(columns, index_grade_)));
 
 		if (index_distance_ != -1)
-			point.setDistance(strtod(columns[index_distance_].c_str(), NULL));
+			point.setDistance(str2double(column(columns, index_distance_)));
 
 		if (index_speed_ != -1)
-			point.setSpeed(strtod(columns[index_speed_].c_str(), NULL));
+			point.setSpeed(str2double(column(columns, index_speed_)));
 
 		if (index_maxspeed_ != -1)
-			point.setMaxSpeed(strtod(columns[index_maxspeed_].c_str(), NULL));
+			point.setMaxSpeed(str2double(column(columns, index_maxspeed_)));
 
 		if (index_avgspeed_ != -1)
-			point.setAverageSpeed(strtod(columns[index_avgspeed_].c_str(), NULL));
+			point.setAverageSpeed(str2double(column(columns, index_avgspeed_)));
 
 		if (index_avgridespeed_ != -1)
-			point.setAverageRideSpeed(strtod(columns[index_avgridespeed_].c_str(), NULL));
+			point.setAverageRideSpeed(str2double(column(columns, index_avgridespeed_)));
 
-		if (index_cadence_ != -1)
-			point.setCadence(std::stoi(columns[index_cadence_]));
+		if ((index_cadence_ != -1) && str2int(column(columns, index_cadence_), value))
+			point.setCadence(value);
 
-		if (index_heartrate_ != -1)
-			point.setHeartrate(std::stoi(columns[index_heartrate_]));
+		if ((index_heartrate_ != -1) && str2int(column(columns, index_heartrate_), value))
+			point.setHeartrate(value);
 
-		if (index_temperature_ != -1)
-			point.setTemperature(std::stoi(columns[index_temperature_]));
+		if ((index_temperature_ != -1) && str2int(column(columns, index_temperature_), value))
+			point.setTemperature(value);
 
-		if (index_lap_ != -1)
-			point.setLap(std::stoi(columns[index_lap_]));
+		if ((index_lap_ != -1) && str2int(column(columns, index_lap_), value))
+			point.setLap(value);
 	}
 
 private:
+	const char *data_;
+	size_t size_;
+
+	const char *pos_;
+	const char *end_;
+
 	uint32_t line_;
 
 	char sep_;
 
+	// Columns of the current line (views on the mapped file)
+	std::vector<std::string_view> columns_;
+
+	// Quoted columns with escaped quotes ("") of the current line
+	std::string unescaped_;
+
 	int index_timestamp_;
 	int index_total_duration_;
 	int index_partial_duration_;
@@ -322,29 +383,73 @@ private:
 	int index_temperature_;
 	int index_lap_;
 
-	std::string trim(std::string str) {
-		size_t position;
-
-		const std::string whitespaces = " \t\n\t\f\v";
+	static bool isSpace(char c) {
+		return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\f') || (c == '\v');
+	}
 
-		position = str.find_first_not_of(whitespaces);
-		str.erase(0, position);
+	static std::string_view trim(std::string_view str) {
+		while (!str.empty() && isSpace(str.front()))
+			str.remove_prefix(1);
 
-		position = str.find_last_not_of(whitespaces);
-		str.erase(position + 1);
+		while (!str.empty() && isSpace(str.back()))
+			str.remove_suffix(1);
 
 		return str;
 	}
 
-	double str2double(std::string str) {
-		auto pos = str.find(",");
+	std::string_view unescape(std::string_view str) {
+		size_t i;
+		size_t begin = unescaped_.length();
+
+		for (i=0; i<str.length(); i++) {
+			unescaped_.push_back(str[i]);
+
+			if ((str[i] == '"') && (i + 1 < str.length()) && (str[i + 1] == '"'))
+				i++;
+		}
+
+		return std::string_view(unescaped_).substr(begin);
+	}
+
+	static std::string_view column(const std::vector<std::string_view> &columns, int index) {
+		if ((size_t) index >= columns.size())
+			return std::string_view();
+
+		return columns[index];
+	}
+
+	template<typename T>
+	static bool str2int(std::string_view str, T &value) {
+		// Skip '+' sign, not supported by from_chars
+		if (!str.empty() && (str.front() == '+'))
+			str.remove_prefix(1);
+
+		auto result = std::from_chars(str.data(), str.data() + str.length(), value);
+
+		return (result.ec == std::errc());
+	}
+
+	double str2double(std::string_view str) {
+		char buf[64];
+
+		double value = 0.0;
+
+		if (!str.empty() && (str.front() == '+'))
+			str.remove_prefix(1);
 
-		if (pos < str.length())
-			str.replace(pos, 1, ".");
+		auto result = std::from_chars(str.data(), str.data() + str.length(), value);
 
-		return strtod(str.c_str(), NULL);
+		// Decimal comma (with ';' as column separator)
+		if ((result.ec == std::errc()) && (result.ptr < str.data() + str.length())
+			&& (*result.ptr == ',') && (str.length() < sizeof(buf))) {
+			memcpy(buf, str.data(), str.length());
+			buf[result.ptr - str.data()] = '.';
+
+			std::from_chars(buf, buf + str.length(), value);
+		}
+
+		return value;
 	}
 };
 
 #endif
-
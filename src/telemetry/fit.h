@@ -0,0 +1,447 @@
+#ifndef __GPX2VIDEO__FIT_H__
+#define __GPX2VIDEO__FIT_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "log.h"
+#include "telemetrymedia.h"
+
+
+// FIT (Garmin, Wahoo...) reader: the file is memory mapped and 'record'
+// messages are decoded in place into points. The decode state has a
+// fixed size (16 local message definitions), nothing is allocated.
+class FIT : public TelemetrySource {
+public:
+	FIT(const std::string &filename)
+		: TelemetrySource(filename)
+		, data_(NULL)
+		, size_(0)
+		, timestamp_(0)
+		, records_(0) {
+		int fd;
+
+		struct stat st;
+
+		next_ = pos_ = end_ = NULL;
+
+		if (!stream_.is_open()) {
+			log_error("Open '%s' FIT file failure, please check that file is readable", filename.c_str());
+			goto failure;
+		}
+
+		if ((fd = ::open(filename.c_str(), O_RDONLY)) < 0)
+			goto failure;
+
+		if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+			data_ = (const uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data_ == MAP_FAILED) {
+				log_error("Map '%s' FIT file failure", filename.c_str());
+				data_ = NULL;
+			}
+			else {
+				size_ = st.st_size;
+				madvise((void *) data_, size_, MADV_SEQUENTIAL);
+			}
+		}
+
+		::close(fd);
+
+		filename_ = filename;
+
+failure:
+		return;
+	}
+
+	virtual ~FIT() {
+		if (data_ != NULL)
+			munmap((void *) data_, size_);
+	}
+
+	void reset() {
+		log_call();
+
+		next_ = data_;
+		pos_ = end_ = NULL;
+
+		records_ = 0;
+
+		readHeader();
+	}
+
+	enum TelemetrySource::Data read(TelemetrySource::Point &point) {
+		log_call();
+
+		for (;;) {
+			// End of data, FIT files may be chained
+			if ((pos_ == NULL) || (pos_ >= end_)) {
+				if (!readHeader())
+					return TelemetrySource::DataEof;
+
+				continue;
+			}
+
+			switch (readRecord(point)) {
+			case RecordPoint:
+				return TelemetrySource::DataAgain;
+
+			case RecordError:
+				log_error("Parsing of '%s' failed at offset %lu", filename_.c_str(), (unsigned long) (pos_ - data_));
+				pos_ = end_ = next_ = NULL;
+				return TelemetrySource::DataEof;
+
+			default:
+				break;
+			}
+		}
+	}
+
+private:
+	// FIT epoch: 1989-12-31 00:00:00 UTC
+	static const uint32_t FIT_EPOCH = 631065600;
+
+	// Global message numbers
+	static const uint16_t MESG_RECORD = 20;
+
+	// 'record' message fields
+	enum Field {
+		FieldLatitude = 0,
+		FieldLongitude = 1,
+		FieldAltitude = 2,
+		FieldHeartrate = 3,
+		FieldCadence = 4,
+		FieldSpeed = 6,
+		FieldPower = 7,
+		FieldTemperature = 13,
+		FieldEnhancedSpeed = 73,
+		FieldEnhancedAltitude = 78,
+		FieldTimestamp = 253,
+	};
+
+	enum Record {
+		RecordNone,
+		RecordPoint,
+		RecordError,
+	};
+
+	class Definition {
+	public:
+		bool valid;
+		bool big_endian;
+
+		uint16_t global;
+
+		uint8_t nbr_fields;
+
+		// Field number, size & base type
+		uint8_t fields[255][3];
+
+		// Message size (developer fields included)
+		uint32_t size;
+	};
+
+	bool readHeader(void) {
+		uint8_t header_size;
+
+		uint32_t data_size;
+
+		if ((next_ == NULL) || (next_ + 12 > data_ + size_))
+			return false;
+
+		header_size = next_[0];
+
+		if ((header_size < 12) || (next_ + header_size > data_ + size_) || (memcmp(next_ + 8, ".FIT", 4) != 0)) {
+			// Only the first file is required
+			if (next_ == data_)
+				log_error("'%s' isn't a FIT file", filename_.c_str());
+			return false;
+		}
+
+		data_size = next_[4] | (next_[5] << 8) | (next_[6] << 16) | ((uint32_t) next_[7] << 24);
+
+		pos_ = next_ + header_size;
+		end_ = ((size_t) (data_ + size_ - pos_) < data_size) ? data_ + size_ : pos_ + data_size;
+
+		// Skip CRC
+		next_ = end_ + 2;
+
+		// Local definitions are file scoped
+		for (int i=0; i<16; i++)
+			definitions_[i].valid = false;
+
+		timestamp_ = 0;
+
+		return true;
+	}
+
+	enum Record readRecord(TelemetrySource::Point &point) {
+		uint8_t header;
+		uint8_t local, offset;
+
+		header = *pos_++;
+
+		// Compressed timestamp header
+		if (header & 0x80) {
+			local = (header >> 5) & 0x03;
+			offset = header & 0x1f;
+
+			if (offset < (timestamp_ & 0x1f))
+				timestamp_ += 0x20;
+
+			timestamp_ = (timestamp_ & ~0x1f) + offset;
+
+			return readData(definitions_[local], point);
+		}
+
+		local = header & 0x0f;
+
+		if (header & 0x40)
+			return readDefinition(definitions_[local], (header & 0x20) != 0);
+
+		return readData(definitions_[local], point);
+	}
+
+	enum Record readDefinition(Definition &definition, bool has_developer_data) {
+		uint8_t i, n;
+
+		const uint8_t *p = pos_;
+
+		// Reserved, architecture, global message number, number of fields
+		if (p + 5 > end_)
+			return RecordError;
+
+		definition.big_endian = (p[1] == 1);
+		definition.global = definition.big_endian ? ((p[2] << 8) | p[3]) : (p[2] | (p[3] << 8));
+		definition.nbr_fields = p[4];
+		definition.size = 0;
+
+		p += 5;
+
+		if (p + 3 * definition.nbr_fields > end_)
+			return RecordError;
+
+		for (i=0; i<definition.nbr_fields; i++, p+=3) {
+			memcpy(definition.fields[i], p, 3);
+			definition.size += p[1];
+		}
+
+		// Developer fields are skipped
+		if (has_developer_data) {
+			if (p + 1 > end_)
+				return RecordError;
+
+			n = *p++;
+
+			if (p + 3 * n > end_)
+				return RecordError;
+
+			for (i=0; i<n; i++, p+=3)
+				definition.size += p[1];
+		}
+
+		definition.valid = true;
+
+		pos_ = p;
+
+		return RecordNone;
+	}
+
+	enum Record readData(const Definition &definition, TelemetrySource::Point &point) {
+		uint8_t i;
+
+		uint32_t value;
+
+		int32_t lat = 0x7fffffff, lon = 0x7fffffff;
+
+		bool has_altitude = false, has_enhanced_altitude = false;
+		bool has_speed = false, has_enhanced_speed = false;
+
+		double altitude = 0.0, speed = 0.0;
+
+		// Sensor values (-1 if none)
+		int heartrate = -1, cadence = -1, power = -1;
+		int temperature = -1000;
+
+		const uint8_t *p = pos_;
+
+		if (!definition.valid || (p + definition.size > end_))
+			return RecordError;
+
+		pos_ += definition.size;
+
+		if (definition.global != MESG_RECORD)
+			return RecordNone;
+
+		point = TelemetrySource::Point();
+		point.setType(TelemetryData::TypeMeasured);
+		point.setLine(++records_);
+
+		for (i=0; i<definition.nbr_fields; i++) {
+			const uint8_t *field = definition.fields[i];
+
+			const uint8_t *v = p;
+
+			p += field[1];
+
+			if (!readValue(v, field[1], field[2], definition.big_endian, value))
+				continue;
+
+			switch (field[0]) {
+			case FieldTimestamp:
+				timestamp_ = value;
+				break;
+
+			case FieldLatitude:
+				lat = value;
+				break;
+
+			case FieldLongitude:
+				lon = value;
+				break;
+
+			case FieldAltitude:
+				altitude = has_enhanced_altitude ? altitude : (value / 5.0 - 500.0);
+				has_altitude = true;
+				break;
+
+			case FieldEnhancedAltitude:
+				altitude = value / 5.0 - 500.0;
+				has_enhanced_altitude = true;
+				break;
+
+			case FieldSpeed:
+				speed = has_enhanced_speed ? speed : (value / 1000.0);
+				has_speed = true;
+				break;
+
+			case FieldEnhancedSpeed:
+				speed = value / 1000.0;
+				has_enhanced_speed = true;
+				break;
+
+			case FieldHeartrate:
+				heartrate = value;
+				break;
+
+			case FieldCadence:
+				cadence = value;
+				break;
+
+			case FieldPower:
+				power = value;
+				break;
+
+			case FieldTemperature:
+				temperature = (int8_t) value;
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		// Points without GPS fix are skipped
+		if ((timestamp_ == 0) || (lat == 0x7fffffff) || (lon == 0x7fffffff))
+			return RecordNone;
+
+		// Position in semicircles
+		point.setPosition(
+			(uint64_t) (timestamp_ + FIT_EPOCH) * 1000,
+			lat * (180.0 / 2147483648.0),
+			lon * (180.0 / 2147483648.0)
+		);
+
+		if (has_altitude || has_enhanced_altitude)
+			point.setElevation(altitude);
+
+		// m/s to km/h
+		if (has_speed || has_enhanced_speed)
+			point.setSpeed(speed * 3.6);
+
+		if (heartrate != -1)
+			point.setHeartrate(heartrate);
+		if (cadence != -1)
+			point.setCadence(cadence);
+		if (power != -1)
+			point.setPower(power);
+		if (temperature != -1000)
+			point.setTemperature(temperature);
+
+		return RecordPoint;
+	}
+
+	static bool readValue(const uint8_t *p, uint8_t size, uint8_t type, bool big_endian, uint32_t &value) {
+		uint32_t invalid;
+
+		switch (size) {
+		case 1:
+			value = p[0];
+			break;
+		case 2:
+			value = big_endian ? ((p[0] << 8) | p[1]) : (p[0] | (p[1] << 8));
+			break;
+		case 4:
+			value = big_endian
+				? (((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3])
+				: (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+			break;
+		default:
+			// Arrays & strings aren't used
+			return false;
+		}
+
+		// Invalid value of the base type
+		switch (type & 0x1f) {
+		case 0x01: // sint8
+		case 0x03: // sint16
+		case 0x05: // sint32
+			invalid = (1U << (8 * size - 1)) - 1;
+			break;
+		case 0x0a: // uint8z
+		case 0x0b: // uint16z
+		case 0x0c: // uint32z
+			invalid = 0;
+			break;
+		default:
+			invalid = (size == 4) ? 0xffffffff : (1U << (8 * size)) - 1;
+			break;
+		}
+
+		if (value == invalid)
+			return false;
+
+		// Sign extension
+		if (((type & 0x1f) == 0x01) && (size == 1))
+			value = (int32_t) (int8_t) value;
+		else if (((type & 0x1f) == 0x03) && (size == 2))
+			value = (int32_t) (int16_t) value;
+
+		return true;
+	}
+
+	std::string filename_;
+
+	const uint8_t *data_;
+	size_t size_;
+
+	// Current FIT file (data records) & next chained one
+	const uint8_t *pos_;
+	const uint8_t *end_;
+	const uint8_t *next_;
+
+	// Last timestamp (for compressed timestamp headers)
+	uint32_t timestamp_;
+
+	// Record messages read
+	uint32_t records_;
+
+	Definition definitions_[16];
+};
+
+#endif
@@ -1,150 +1,229 @@
 #ifndef __GPX2VIDEO__GPX_H__
 #define __GPX2VIDEO__GPX_H__
 
+#include <ctype.h>
 #include <string.h>
+#include <strings.h>
 //#define __USE_XOPEN  // For strptime
 #include <time.h>
 
+#include <deque>
+#include <string>
+
+#include <expat.h>
+
 #include "unistd.h"
 
-#include "gpxlib/Parser.h"
-#include "gpxlib/ReportCerr.h"
 #include "log.h"
 #include "telemetrymedia.h"
 
 
+// Streaming GPX reader: points of the first track are built from the expat
+// (SAX) events, without the gpxlib DOM, so memory doesn't grow with the
+// file size.
 class GPX : public TelemetrySource {
 public:
 	GPX(const std::string &filename)
 		: TelemetrySource(filename)
-		, root_(NULL)
-		, trk_(NULL)
-		, eof_(false) {
-		gpx::Parser parser(NULL); //&report);
-
-//		gpx::ReportCerr report;
-
+		, parser_(NULL)
+		, eof_(true) {
 		if (!stream_.is_open()) {
 			log_error("Open '%s' GPX file failure, please check that file is readable", filename.c_str());
 			goto failure;
 		}
 
-		root_ = parser.parse(stream_);
-
-		if (root_ == NULL) {
-			log_error("Parsing of '%s' failed due to %s on line %d and column %d", 
-				filename.c_str(), parser.errorText().c_str(),
-				parser.errorLineNumber(), parser.errorColumnNumber());
-			goto failure;
-		}
+		filename_ = filename;
 
 failure:
 		return;
 	}
 
 	virtual ~GPX() {
+		if (parser_ != NULL)
+			XML_ParserFree(parser_);
 	}
 
 	void reset() {
-		std::list<gpx::TRK*> &trks = root_->trks().list();
-
 		log_call();
 
-		eof_ = false;
+		if (parser_ != NULL)
+			XML_ParserFree(parser_);
 
-		for (std::list<gpx::TRK *>::iterator node = trks.begin(); node != trks.end(); ++node) {
-			gpx::TRK *trk = (*node);
+		parser_ = XML_ParserCreate(NULL);
 
-			if (trk == nullptr)
-				continue;
+		XML_SetUserData(parser_, this);
+		XML_SetElementHandler(parser_, startElement, endElement);
+		XML_SetCharacterDataHandler(parser_, characterData);
 
-			std::list<gpx::TRKSeg*> &trksegs = trk->trksegs().list();
+		stream_.clear();
+		stream_.seekg(0, stream_.beg);
 
-			// Retrieve first segment & first track
-			trk_ = trk;
-			iter_seg_ = trksegs.begin();
-			
-			if (iter_seg_ != trksegs.end()) {
-				gpx::TRKSeg *trkseg = (*iter_seg_);
+		pending_.clear();
 
-				std::list<gpx::WPT*> &trkpts = trkseg->trkpts().list();
+		eof_ = !stream_.is_open();
 
-				iter_pts_ = trkpts.begin();
-			}
+		trks_ = 0;
+		in_trk_ = false;
+		in_trkpt_ = false;
+		in_extensions_ = false;
+	}
 
-			// Parse only the first track
-			break;
+	enum TelemetrySource::Data read(TelemetrySource::Point &point) {
+		log_call();
+
+		// Parse the next chunk until a point is complete
+		while (pending_.empty()) {
+			if (eof_)
+				return TelemetrySource::DataEof;
+
+			parse();
 		}
+
+		point = pending_.front();
+		pending_.pop_front();
+
+		return TelemetrySource::DataAgain;
 	}
 
-	enum TelemetrySource::Data read(TelemetrySource::Point &point) {
-		gpx::WPT *wpt = NULL;
+private:
+	void parse(void) {
+		char buf[65536];
 
-		enum TelemetrySource::Data type = TelemetrySource::DataUnknown;
+		size_t length;
 
-		log_call();
+		bool final;
 
-		type = readNode(&wpt);
+		stream_.read(buf, sizeof(buf));
 
-		if (type == TelemetrySource::DataEof)
-			goto eof;
+		length = stream_.gcount();
+		final = (length < sizeof(buf));
 
-		writePoint(wpt, point);
+		if (XML_Parse(parser_, buf, (int) length, final) == XML_STATUS_ERROR) {
+			// Stopped once the first track is read
+			if (XML_GetErrorCode(parser_) != XML_ERROR_ABORTED) {
+				log_error("Parsing of '%s' failed due to %s on line %lu and column %lu",
+					filename_.c_str(), XML_ErrorString(XML_GetErrorCode(parser_)),
+					XML_GetCurrentLineNumber(parser_), XML_GetCurrentColumnNumber(parser_));
+			}
 
-eof:
-		return type;
+			final = true;
+		}
+
+		if (final)
+			eof_ = true;
 	}
 
-	enum TelemetrySource::Data readNode(gpx::WPT **wpt) {
-		gpx::TRKSeg *trkseg = (*iter_seg_);
+	static const char * localName(const char *name) {
+		const char *s = ::strchr(name, ':');
 
-		std::list<gpx::WPT*> &trkpts = trkseg->trkpts().list();
-		std::list<gpx::TRKSeg*> &trksegs = trk_->trksegs().list();
+		return (s != NULL) ? s + 1 : name;
+	}
 
-		log_call();
+	static void startElement(void *data, const char *name, const char **attrs) {
+		GPX *gpx = (GPX *) data;
 
-		if (eof_)
-			return TelemetrySource::DataEof;
+		gpx->onStartElement(name, attrs);
+	}
 
-		*wpt = (*iter_pts_);
+	static void endElement(void *data, const char *name) {
+		GPX *gpx = (GPX *) data;
 
-		// Next point
-		iter_pts_++;
+		gpx->onEndElement(name);
+	}
 
-		for (; iter_pts_ == trkpts.end();) {
-			iter_seg_++;
+	static void characterData(void *data, const char *s, int len) {
+		GPX *gpx = (GPX *) data;
 
-			if (iter_seg_ == trksegs.end()) {
-				eof_ = true;
-				break;
-			}
+		// Only point values are kept
+		if (gpx->in_trkpt_)
+			gpx->text_.append(s, len);
+	}
 
-			trkseg = (*iter_seg_);
+	void onStartElement(const char *name, const char **attrs) {
+		const char *local = localName(name);
 
-			trkpts = trkseg->trkpts().list();
-			iter_pts_ = trkpts.begin();
+		text_.clear();
+
+		if (strcasecmp(local, "trk") == 0) {
+			// Parse only the first track
+			in_trk_ = (++trks_ == 1);
 		}
+		else if (in_trk_ && (strcasecmp(local, "trkpt") == 0)) {
+			in_trkpt_ = true;
+			in_extensions_ = false;
 
-		return TelemetrySource::DataAgain;
+			line_ = XML_GetCurrentLineNumber(parser_);
+
+			lat_ = lon_ = ele_ = 0.0;
+			ts_ = 0;
+			has_time_ = false;
+
+			values_ = TelemetrySource::Point();
+
+			for (int i=0; attrs[i] != NULL; i+=2) {
+				if (strcasecmp(attrs[i], "lat") == 0)
+					lat_ = strtod(attrs[i + 1], NULL);
+				else if (strcasecmp(attrs[i], "lon") == 0)
+					lon_ = strtod(attrs[i + 1], NULL);
+			}
+		}
+		else if (in_trkpt_ && (strcasecmp(local, "extensions") == 0)) {
+			in_extensions_ = true;
+		}
 	}
 
-	void writePoint(gpx::WPT *wpt, TelemetrySource::Point &point) {
-		bool ok = true;
+	void onEndElement(const char *name) {
+		const char *local = localName(name);
 
-		uint64_t ts = 0;
+		if (strcasecmp(local, "trk") == 0) {
+			// First track read, no need to parse the rest of the file
+			if (in_trk_)
+				XML_StopParser(parser_, XML_FALSE);
 
-		char buf[128];
-		const char *s;
+			in_trk_ = false;
+		}
+		else if (!in_trkpt_) {
+		}
+		else if (strcasecmp(local, "trkpt") == 0) {
+			writePoint();
+
+			in_trkpt_ = false;
+		}
+		else if (strcasecmp(local, "extensions") == 0) {
+			in_extensions_ = false;
+		}
+		else if (in_extensions_) {
+			// Garmin TrackPointExtension or raw values
+			if (::strstr(name, "atemp") != NULL)
+				values_.setTemperature(strtod(text_.c_str(), NULL));
+			else if (::strstr(name, "cad") != NULL)
+				values_.setCadence(strtol(text_.c_str(), NULL, 10));
+			else if (::strstr(name, "hr") != NULL)
+				values_.setHeartrate(strtol(text_.c_str(), NULL, 10));
+		}
+		else if (strcasecmp(local, "ele") == 0) {
+			ele_ = strtod(text_.c_str(), NULL);
+		}
+		else if (strcasecmp(local, "time") == 0) {
+			has_time_ = parseTime(text_.c_str(), ts_);
+		}
+
+		text_.clear();
+	}
+
+	bool parseTime(const char *s, uint64_t &ts) {
+		const char *ms;
 
 		struct tm time;
 
-		std::string name;
+		// Skip spaces
+		while ((*s == ' ') || (*s == '\t') || (*s == '\n') || (*s == '\r'))
+			s++;
 
 		// Convert time - GPX file contains UTC time
-		s = wpt->time().getValue().c_str();
+		memset(&time, 0, sizeof(time));
 
 		// Try format: "2020:12:13 08:55:48.215"
-		memset(&time, 0, sizeof(time));
 		if (strptime(s, "%Y:%m:%d %H:%M:%S.", &time) != NULL)
 			ts = timegm(&time) * 1000;
 		// Try format: "2020-07-28T07:04:43.000Z"
@@ -157,76 +236,72 @@ eof:
 		else if (strptime(s, "%Y-%m-%dT%H:%M:%S+", &time) != NULL)
 			ts = timegm(&time) * 1000;
 		else
-			ok = false;
+			return false;
 
 		// Parse ms precision
-		if (ok) {
-			char *ms;
+		if ((ms = ::strchr(s, '.')) != NULL) {
+			ms += 1; // skip '.' char
 
-			strcpy(buf, s);
+			if ((strlen(ms) >= 3) && isdigit(ms[0]) && isdigit(ms[1]) && isdigit(ms[2]))
+				ts += (ms[0] - '0') * 100 + (ms[1] - '0') * 10 + (ms[2] - '0');
+		}
 
-			if ((ms = ::strchr(buf, '.')) != NULL) {
-				ms += 1; // skip '.' char
+		return true;
+	}
 
-				if (strlen(ms) >= 3) {
-					ms[3] = '\0';
+	void writePoint(void) {
+		TelemetrySource::Point point;
 
-					ts += atoi(ms);
-				}
-			}
-		}
+		// GPX points are measured
+		point.setType(TelemetryData::TypeMeasured);
 
 		// Line
-		point.setLine(wpt->line());
-
-		if (!ok)
-			return;
-
-		// Build result
-		point.setPosition(
-				ts,
-				(double) wpt->lat(),
-				(double) wpt->lon()
-		);
-		point.setElevation((double) wpt->ele());
-
-		// Extensions
-		gpx::Node *extensions = wpt->extensions().getElements().front();
-
-		if (extensions) {
-			name = extensions->getName();
-
-			if (name.find("TrackPointExtension") == std::string::npos)
-				extensions = &wpt->extensions();
-
-			if (extensions) {
-				for (std::list<gpx::Node*>::const_iterator iter = extensions->getElements().begin(); 
-					iter != extensions->getElements().end(); ++iter) {
-					gpx::Node *node = (*iter);
-
-					name = node->getName();
-
-					if (name.find("atemp") != std::string::npos)
-						point.setTemperature(std::stod(node->getValue()));
-					else if (name.find("cad") != std::string::npos)
-						point.setCadence(std::stoi(node->getValue()));
-					else if (name.find("hr") != std::string::npos)
-						point.setHeartrate(std::stoi(node->getValue()));
-				}
-			}
+		point.setLine(line_);
+
+		if (has_time_) {
+			// Build result
+			point.setPosition(ts_, lat_, lon_);
+			point.setElevation(ele_);
+
+			// Extensions
+			if (values_.hasValue(TelemetryData::DataTemperature))
+				point.setTemperature(values_.temperature());
+			if (values_.hasValue(TelemetryData::DataCadence))
+				point.setCadence(values_.cadence());
+			if (values_.hasValue(TelemetryData::DataHeartrate))
+				point.setHeartrate(values_.heartrate());
 		}
+
+		pending_.push_back(point);
 	}
 
-private:
-	gpx::GPX *root_;
+	std::string filename_;
 
-	gpx::TRK *trk_;
+	XML_Parser parser_;
 
 	bool eof_;
 
-	std::list<gpx::WPT*>::iterator iter_pts_;
-	std::list<gpx::TRKSeg*>::iterator iter_seg_;
+	// Points parsed, not read yet (one chunk at most)
+	std::deque<TelemetrySource::Point> pending_;
+
+	int trks_;
+
+	bool in_trk_;
+	bool in_trkpt_;
+	bool in_extensions_;
+
+	// Current point
+	uint32_t line_;
+
+	double lat_, lon_;
+	double ele_;
+
+	uint64_t ts_;
+	bool has_time_;
+
+	TelemetrySource::Point values_;
+
+	std::string text_;
 };
 
 #endif
-
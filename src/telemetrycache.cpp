@@ -0,0 +1,379 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "log.h"
+#include "telemetrycache.h"
+
+
+#define G2VT_VERSION 3
+
+
+static const uint8_t * map_file(const std::string &filename, size_t &size) {
+	int fd;
+
+	struct stat st;
+
+	void *data = NULL;
+
+	size = 0;
+
+	if ((fd = ::open(filename.c_str(), O_RDONLY)) < 0)
+		return NULL;
+
+	if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED)
+			data = NULL;
+		else
+			size = st.st_size;
+	}
+
+	::close(fd);
+
+	return (const uint8_t *) data;
+}
+
+
+static void unmap_file(const uint8_t *data, size_t size) {
+	if (data != NULL)
+		munmap((void *) data, size);
+}
+
+
+// FNV-1a, on 64 bits words
+static uint64_t hash_data(const uint8_t *data, size_t size, uint64_t hash=0xcbf29ce484222325ULL) {
+	size_t i;
+
+	uint64_t word;
+
+	for (i=0; i+8<=size; i+=8) {
+		memcpy(&word, data + i, sizeof(word));
+
+		hash ^= word;
+		hash *= 0x100000001b3ULL;
+	}
+
+	for (; i<size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+
+template<typename T>
+static bool write_column(FILE *fp, const std::vector<T> &column) {
+	return (fwrite(column.data(), sizeof(T), column.size(), fp) == column.size());
+}
+
+
+template<typename T>
+static const uint8_t * read_column(const uint8_t *data, const uint8_t *end, size_t count, std::vector<T> &column) {
+	if ((data == NULL) || ((size_t) (end - data) < count * sizeof(T)))
+		return NULL;
+
+	// Columns aren't aligned in the file
+	column.resize(count);
+	memcpy(column.data(), data, count * sizeof(T));
+
+	return data + count * sizeof(T);
+}
+
+
+std::string TelemetryCache::path(const std::string &filename) {
+	return filename + ".g2vt";
+}
+
+
+bool TelemetryCache::key(const std::string &filename,
+	TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+	const std::string &from, const std::string &to,
+	TelemetryCache::Header &header) {
+	size_t size;
+
+	const uint8_t *data;
+
+	std::string limits = from + "\n" + to;
+
+	memset(&header, 0, sizeof(header));
+
+	if ((data = map_file(filename, size)) == NULL)
+		return false;
+
+	memcpy(header.magic, "G2VT", sizeof(header.magic));
+	header.version = G2VT_VERSION;
+
+	header.hash = hash_data(data, size);
+	header.size = size;
+
+	header.method = method;
+	header.rate = rate;
+	header.distance = distance;
+	header.limits = hash_data((const uint8_t *) limits.c_str(), limits.length());
+
+	unmap_file(data, size);
+
+	return true;
+}
+
+
+bool TelemetryCache::write(FILE *fp, const TelemetryTimeline &timeline, enum TelemetrySettings::Distance mode) {
+	bool ok = true;
+
+	ok = ok && write_column(fp, timeline.values_);
+	ok = ok && write_column(fp, timeline.lines_);
+	ok = ok && write_column(fp, timeline.types_);
+
+	ok = ok && write_column(fp, timeline.timestamps_);
+	ok = ok && write_column(fp, timeline.latitudes_);
+	ok = ok && write_column(fp, timeline.longitudes_);
+	ok = ok && write_column(fp, timeline.elevations_);
+	ok = ok && write_column(fp, timeline.temperatures_);
+	ok = ok && write_column(fp, timeline.heartrates_);
+	ok = ok && write_column(fp, timeline.cadences_);
+	ok = ok && write_column(fp, timeline.powers_);
+
+	ok = ok && write_column(fp, timeline.distances_);
+	ok = ok && write_column(fp, timeline.durations_);
+	ok = ok && write_column(fp, timeline.grades_);
+	ok = ok && write_column(fp, timeline.speeds_);
+	ok = ok && write_column(fp, timeline.maxspeeds_);
+	ok = ok && write_column(fp, timeline.ridetimes_);
+	ok = ok && write_column(fp, timeline.elapsedtimes_);
+	ok = ok && write_column(fp, timeline.avgspeeds_);
+	ok = ok && write_column(fp, timeline.avgridespeeds_);
+	ok = ok && write_column(fp, timeline.laps_);
+
+	ok = ok && write_column(fp, timeline.segments(mode));
+
+	return ok;
+}
+
+
+bool TelemetryCache::read(const uint8_t *data, size_t size, size_t count, enum TelemetrySettings::Distance mode, TelemetryTimeline &timeline) {
+	size_t i;
+
+	const uint8_t *end = data + size;
+
+	data = read_column(data, end, count, timeline.values_);
+	data = read_column(data, end, count, timeline.lines_);
+	data = read_column(data, end, count, timeline.types_);
+
+	data = read_column(data, end, count, timeline.timestamps_);
+	data = read_column(data, end, count, timeline.latitudes_);
+	data = read_column(data, end, count, timeline.longitudes_);
+	data = read_column(data, end, count, timeline.elevations_);
+	data = read_column(data, end, count, timeline.temperatures_);
+	data = read_column(data, end, count, timeline.heartrates_);
+	data = read_column(data, end, count, timeline.cadences_);
+	data = read_column(data, end, count, timeline.powers_);
+
+	data = read_column(data, end, count, timeline.distances_);
+	data = read_column(data, end, count, timeline.durations_);
+	data = read_column(data, end, count, timeline.grades_);
+	data = read_column(data, end, count, timeline.speeds_);
+	data = read_column(data, end, count, timeline.maxspeeds_);
+	data = read_column(data, end, count, timeline.ridetimes_);
+	data = read_column(data, end, count, timeline.elapsedtimes_);
+	data = read_column(data, end, count, timeline.avgspeeds_);
+	data = read_column(data, end, count, timeline.avgridespeeds_);
+	data = read_column(data, end, count, timeline.laps_);
+
+	data = read_column(data, end, count, timeline.segments_[mode]);
+
+	if (data == NULL)
+		return false;
+
+	for (i=1; i<count; i++) {
+		if (timeline.timestamps_[i] < timeline.timestamps_[i - 1])
+			timeline.sorted_ = false;
+	}
+
+	return true;
+}
+
+
+TelemetryTimelinePtr TelemetryCache::load(const std::string &filename,
+	TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+	const std::string &from, const std::string &to) {
+	size_t size;
+
+	const uint8_t *data = NULL;
+
+	TelemetryCache::Header header, cached;
+
+	TelemetryTimelinePtr timeline;
+
+	std::string cachefile = path(filename);
+
+	log_call();
+
+	// No cache file
+	if (::access(cachefile.c_str(), R_OK) != 0)
+		return NULL;
+
+	if (!key(filename, method, rate, distance, from, to, header))
+		return NULL;
+
+	if ((data = map_file(cachefile, size)) == NULL)
+		goto failure;
+
+	if (size < sizeof(cached))
+		goto failure;
+
+	memcpy(&cached, data, sizeof(cached));
+
+	header.count = cached.count;
+
+	if (memcmp(&header, &cached, sizeof(header)) != 0) {
+		log_info("Telemetry cache '%s' is outdated, skip it", cachefile.c_str());
+		goto done;
+	}
+
+	timeline = std::make_shared<TelemetryTimeline>();
+
+	if (!read(data + sizeof(cached), size - sizeof(cached), cached.count, (TelemetrySettings::Distance) cached.distance, *timeline))
+		goto failure;
+
+	// Replay of the smoothed positions
+	timeline->smoothed_ = (method == TelemetrySettings::MethodKalman);
+
+	log_info("Telemetry cache '%s' loaded: %lu points", cachefile.c_str(), timeline->size());
+
+done:
+	unmap_file(data, size);
+
+	return timeline;
+
+failure:
+	log_warn("Telemetry cache '%s' is invalid, skip it", cachefile.c_str());
+
+	unmap_file(data, size);
+
+	return NULL;
+}
+
+
+bool TelemetryCache::build(const std::string &filename,
+	TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+	const std::string &from, const std::string &to) {
+	bool result = false;
+
+	FILE *fp = NULL;
+
+	int64_t timecode_ms;
+
+	TelemetryData data;
+	TelemetrySource::Point point;
+
+	TelemetryCache::Header header;
+
+	TelemetrySource *source = NULL;
+
+	TelemetryTimelinePtr timeline;
+	TelemetryTimelinePtr computed;
+
+	std::string cachefile = path(filename);
+	std::string tmpfile = cachefile + ".tmp";
+
+	log_call();
+
+	if (!key(filename, method, rate, distance, from, to, header)) {
+		log_error("Open '%s' telemetry file failure", filename.c_str());
+		goto done;
+	}
+
+	if ((timeline = TelemetryTimeline::load(filename)) == NULL)
+		goto done;
+
+	if (timeline->size() == 0)
+		goto done;
+
+	source = TelemetryMedia::open(timeline, method);
+	source->setDistance(distance);
+
+	if (!source->setFrom(from) || !source->setTo(to))
+		goto done;
+
+	computed = std::make_shared<TelemetryTimeline>();
+
+	// First point, as read (start point of the replay)
+	timeline->get(0, point);
+	computed->append(point);
+
+	// Replay the telemetry data at rate (as 'gpxtools compute')
+	source->retrieveFirst(data);
+
+	timecode_ms = data.time() * 1000;
+
+	for (;;) {
+		// Skip unchanged points
+		if (data.timestamp() > computed->timestamps().back())
+			computed->append(data);
+
+		if (rate > 0)
+			timecode_ms += 1000 / rate;
+		else
+			timecode_ms += 1000;
+
+		if (method == TelemetrySettings::MethodNone)
+			timecode_ms = -1;
+
+		if (source->retrieveNext(data, timecode_ms) == TelemetrySource::DataEof)
+			break;
+	}
+
+	// Last point, as read (never returned by a replay)
+	timeline->get(timeline->size() - 1, point);
+
+	if (point.timestamp() > computed->timestamps().back())
+		computed->append(point);
+
+	// Write cache file
+	if ((fp = ::fopen(tmpfile.c_str(), "wb")) == NULL) {
+		log_error("Open '%s' failure", tmpfile.c_str());
+		goto done;
+	}
+
+	header.count = computed->size();
+
+	if ((fwrite(&header, sizeof(header), 1, fp) != 1) || !write(fp, *computed, distance)) {
+		log_error("Write '%s' failure", tmpfile.c_str());
+		goto done;
+	}
+
+	if (::fclose(fp) != 0) {
+		fp = NULL;
+		log_error("Write '%s' failure", tmpfile.c_str());
+		goto done;
+	}
+
+	fp = NULL;
+
+	if (::rename(tmpfile.c_str(), cachefile.c_str()) != 0) {
+		log_error("Rename '%s' failure", tmpfile.c_str());
+		goto done;
+	}
+
+	log_info("Telemetry cache '%s' built: %lu points", cachefile.c_str(), computed->size());
+
+	result = true;
+
+done:
+	if (fp != NULL) {
+		::fclose(fp);
+		::unlink(tmpfile.c_str());
+	}
+
+	if (source != NULL)
+		delete source;
+
+	return result;
+}
@@ -0,0 +1,61 @@
+#ifndef __GPX2VIDEO__TELEMETRYCACHE_H__
+#define __GPX2VIDEO__TELEMETRYCACHE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "telemetrysettings.h"
+#include "telemetrymedia.h"
+
+
+// Computed telemetry cache: a '.g2vt' sidecar file next to the telemetry
+// file, holding the timeline replayed (and computed) at the telemetry rate,
+// with the telemetry method, distance mode & from/to limits. Cached points
+// have all their computed values set, so a cursor doesn't parse the input
+// file again.
+//
+// The cache is keyed by the input file content hash & the replay settings,
+// a cache built with other settings is ignored.
+class TelemetryCache {
+public:
+	static std::string path(const std::string &filename);
+
+	// Cached timeline, NULL if none or outdated
+	static TelemetryTimelinePtr load(const std::string &filename,
+		TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+		const std::string &from, const std::string &to);
+
+	static bool build(const std::string &filename,
+		TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+		const std::string &from, const std::string &to);
+
+private:
+	class Header {
+	public:
+		char magic[4];
+		uint32_t version;
+
+		uint64_t hash;
+		uint64_t size;
+
+		int32_t method;
+		int32_t rate;
+		int32_t distance;
+		int32_t reserved;
+		uint64_t limits;
+
+		uint64_t count;
+	};
+
+	static bool key(const std::string &filename,
+		TelemetrySettings::Method method, int rate, TelemetrySettings::Distance distance,
+		const std::string &from, const std::string &to,
+		Header &header);
+
+	static bool write(FILE *fp, const TelemetryTimeline &timeline, enum TelemetrySettings::Distance mode);
+	static bool read(const uint8_t *data, size_t size, size_t count, enum TelemetrySettings::Distance mode, TelemetryTimeline &timeline);
+};
+
+#endif
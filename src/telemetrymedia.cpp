@@ -1,17 +1,59 @@
+#include <cmath>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <filesystem>
+#include <thread>
 
 #include <time.h>
 
 #include <GeographicLib/Geodesic.hpp>
 
 #include "telemetry/csv.h"
+#include "telemetry/fit.h"
 #include "telemetry/gpx.h"
 #include "telemetry.h"
+#include "telemetrysmoother.h"
+
+
+// Shared by all the distance computations
+static const GeographicLib::Geodesic geodesic(6378137.0, 1.0/298.2572);
+
+
+// Local flat approximation (ellipsoid radii of curvature at the mean
+// latitude), accurate for short distances only
+static double flat_distance(double lat1, double lon1, double lat2, double lon2) {
+	const double a = 6378137.0;
+	const double f = 1.0 / 298.2572;
+	const double e2 = f * (2.0 - f);
+
+	double x, y;
+	double dlat, dlon;
+	double phi, w, m, n;
+
+	phi = (lat1 + lat2) / 2.0 * M_PI / 180.0;
+
+	dlat = (lat2 - lat1) * M_PI / 180.0;
+	dlon = lon2 - lon1;
+
+	if (dlon > 180.0)
+		dlon -= 360.0;
+	else if (dlon < -180.0)
+		dlon += 360.0;
+
+	dlon = dlon * M_PI / 180.0;
+
+	w = 1.0 - e2 * sin(phi) * sin(phi);
+	n = a / sqrt(w);
+	m = a * (1.0 - e2) / (w * sqrt(w));
+
+	x = dlon * n * cos(phi);
+	y = dlat * m;
+
+	return sqrt(x * x + y * y);
+}
 
 
 std::string timestamp2string(uint64_t value) {
@@ -60,9 +102,12 @@ void TelemetryData::reset(bool all) {
 		cadence_ = 0;
 		heartrate_ = 0;
 		temperature_ = 0;
+		power_ = 0;
 
 		grade_ = 0.0;
 		speed_ = 0.0;
+
+		heading_ = 0.0;
 	}
 
 	distance_ = 0.0;
@@ -108,18 +153,26 @@ void TelemetryData::dump(bool debug) {
 
 
 
-TelemetrySource::TelemetrySource(const std::string &filename) 
+TelemetrySource::TelemetrySource() 
 	: enable_(false)
 	, offset_(0) 
 	, from_(0)
-	, to_(0) {
+	, to_(0)
+	, distance_(TelemetrySettings::DistanceGeodesic)
+	, interpolation_(TelemetrySettings::InterpolationNone)
+	, nbr_frames_(0)
+	, frames_eof_(false) {
 	log_call();
 
 	setNumberOfPoints(100);
+}
 
-    stream_ = std::ifstream(filename);
 
-	kalman_ = alloc_filter_velocity2d(10.0);
+TelemetrySource::TelemetrySource(const std::string &filename) 
+	: TelemetrySource() {
+	log_call();
+
+    stream_ = std::ifstream(filename);
 }
 
 
@@ -141,6 +194,20 @@ void TelemetrySource::setMethod(enum TelemetrySettings::Method method) {
 }
 
 
+void TelemetrySource::setDistance(enum TelemetrySettings::Distance distance) {
+	log_call();
+
+	distance_ = distance;
+}
+
+
+void TelemetrySource::setInterpolation(enum TelemetrySettings::Interpolation interpolation) {
+	log_call();
+
+	interpolation_ = interpolation;
+}
+
+
 bool TelemetrySource::setFrom(std::string from) {
 	struct tm time;
 
@@ -209,6 +276,28 @@ void TelemetrySource::push(TelemetrySource::Point &point) {
 }
 
 
+double TelemetrySource::distance(double lat1, double lon1, double lat2, double lon2,
+	enum TelemetrySettings::Distance mode) {
+	GeographicLib::Math::real d;
+
+	if (mode == TelemetrySettings::DistanceFast) {
+		d = flat_distance(lat1, lon1, lat2, lon2);
+
+		if (d < 100)
+			return d;
+	}
+
+	geodesic.Inverse(lat1, lon1, lat2, lon2, d);
+
+	return d;
+}
+
+
+double TelemetrySource::segment(const TelemetrySource::Point &prev, const TelemetrySource::Point &cur) {
+	return distance(cur.lat_, cur.lon_, prev.lat_, prev.lon_, distance_);
+}
+
+
 void TelemetrySource::compute(TelemetryData &data) {
 	size_t k;
 
@@ -219,13 +308,7 @@ void TelemetrySource::compute(TelemetryData &data) {
 	double ridetime = 0;
 	double speed = 0;
 
-	GeographicLib::Math::real lat1;
-	GeographicLib::Math::real lon1;
-	GeographicLib::Math::real lat2;
-	GeographicLib::Math::real lon2;
-	GeographicLib::Math::real d;
-
-	GeographicLib::Geodesic gsic(6378137.0, 1.0/298.2572);
+	double d;
 
 	TelemetrySource::Point prevPoint, curPoint;
 
@@ -249,14 +332,7 @@ void TelemetrySource::compute(TelemetryData &data) {
 		curPoint.restore(prevPoint);
 
 		// Maths
-		lat1 = curPoint.lat_;
-		lon1 = curPoint.lon_;
-		lat2 = prevPoint.lat_;
-		lon2 = prevPoint.lon_;
-
-		gsic.Inverse(lat1, lon1, lat2, lon2, d);
-
-		dc = d;
+		dc = segment(prevPoint, curPoint);
 		dt = curPoint.ts_ - prevPoint.ts_;
 		dz = (curPoint.ele_ - prevPoint.ele_);
 
@@ -281,6 +357,8 @@ void TelemetrySource::compute(TelemetryData &data) {
 		}
 
 		// Speed & maxspeed & ridetime
+		// Resolved point after point: a speed is kept if close to the last
+		// kept one, and only kept speeds update maxspeed & ridetime
 		if (dt > 0) {
 			speed = (3600.0 * dc) / (1.0 * dt);
 
@@ -327,14 +405,13 @@ void TelemetrySource::compute(TelemetryData &data) {
 			if ((ridetime > 0) && !curPoint.hasValue(TelemetryData::DataAverageRideSpeed))
 				curPoint.setAverageRideSpeed((3600.0 * distance) / (1000.0 * ridetime));
 
-			// Determine current lap
-			lat1 = curPoint.lat_;
-			lon1 = curPoint.lon_;
-			lat2 = start_.lat_;
-			lon2 = start_.lon_;
+			// Determine current lap (distance to the start point is only
+			// required near it)
+			d = flat_distance(curPoint.lat_, curPoint.lon_, start_.lat_, start_.lon_);
+
+			if (d < 100)
+				d = TelemetrySource::distance(curPoint.lat_, curPoint.lon_, start_.lat_, start_.lon_, distance_);
 
-			gsic.Inverse(lat1, lon1, lat2, lon2, d);
-	
 			if (prevPoint.in_lap_ && (d < 8)) {
 				curPoint.setLap(prevPoint.lap_ + 1); // lap_++;
 				curPoint.in_lap_ = false;
@@ -365,15 +442,8 @@ void TelemetrySource::update(TelemetryData &data) {
 
 	size = points_.size();
 
-	if (size > 1) {
-		if (method_ == TelemetrySettings::MethodKalman) {
-			TelemetryData point = points_.back();
-
-			::update_velocity2d(kalman_, point.latitude(), point.longitude(), 1.0);
-		}
-
+	if (size > 1)
 		compute(data);
-	}
 	else
 		data = points_.front();
 }
@@ -411,6 +481,7 @@ void TelemetrySource::predict(TelemetryData &data) {
 		method = TelemetrySettings::MethodInterpolate;
 
 	switch (method) {
+	// Kalman: positions are already smoothed (see TelemetrySmoother)
 	case TelemetrySettings::MethodKalman:
 	case TelemetrySettings::MethodInterpolate:
 		double lat, lon;
@@ -422,14 +493,8 @@ void TelemetrySource::predict(TelemetryData &data) {
 		point.setType(TelemetryData::TypePredicted);
 
 		// Compute new position
-		if (method == TelemetrySettings::MethodKalman) {
-			::update(kalman_);
-			::get_lat_long(kalman_, &lat, &lon);
-		}
-		else {
-			lat = data.lat_ + (timestamp - prevPoint.ts_) * (nextPoint.lat_ - prevPoint.lat_) / (nextPoint.ts_ - prevPoint.ts_);
-			lon = data.lon_ + (timestamp - prevPoint.ts_) * (nextPoint.lon_ - prevPoint.lon_) / (nextPoint.ts_ - prevPoint.ts_);
-		}
+		lat = data.lat_ + (timestamp - prevPoint.ts_) * (nextPoint.lat_ - prevPoint.lat_) / (nextPoint.ts_ - prevPoint.ts_);
+		lon = data.lon_ + (timestamp - prevPoint.ts_) * (nextPoint.lon_ - prevPoint.lon_) / (nextPoint.ts_ - prevPoint.ts_);
 
 		point.setPosition(timestamp, lat, lon);
 
@@ -439,6 +504,9 @@ void TelemetrySource::predict(TelemetryData &data) {
 		if (prevPoint.hasValue(TelemetryData::DataCadence) && nextPoint.hasValue(TelemetryData::DataCadence))
 			point.setCadence(data.cadence_ + (timestamp - prevPoint.ts_) * (nextPoint.cadence_ - prevPoint.cadence_) / (nextPoint.ts_ - prevPoint.ts_));
 
+		if (prevPoint.hasValue(TelemetryData::DataPower) && nextPoint.hasValue(TelemetryData::DataPower))
+			point.setPower(data.power_ + (timestamp - prevPoint.ts_) * (nextPoint.power_ - prevPoint.power_) / (nextPoint.ts_ - prevPoint.ts_));
+
 		if (prevPoint.hasValue(TelemetryData::DataHeartrate) && nextPoint.hasValue(TelemetryData::DataHeartrate))
 			point.setHeartrate(data.heartrate_ + (timestamp - prevPoint.ts_) * (nextPoint.heartrate_ - prevPoint.heartrate_) / (nextPoint.ts_ - prevPoint.ts_));
 
@@ -467,6 +535,9 @@ void TelemetrySource::predict(TelemetryData &data) {
 		if (prevPoint.hasValue(TelemetryData::DataCadence) && curPoint.hasValue(TelemetryData::DataCadence))
 			point.setCadence(data.cadence_ + (curPoint.cadence_ - prevPoint.cadence_));
 
+		if (prevPoint.hasValue(TelemetryData::DataPower) && curPoint.hasValue(TelemetryData::DataPower))
+			point.setPower(data.power_ + (curPoint.power_ - prevPoint.power_));
+
 		if (prevPoint.hasValue(TelemetryData::DataHeartrate) && curPoint.hasValue(TelemetryData::DataHeartrate))
 			point.setHeartrate(data.heartrate_ + (curPoint.heartrate_ - prevPoint.heartrate_));
 
@@ -557,6 +628,8 @@ enum TelemetrySource::Data TelemetrySource::retrieveFirst(TelemetryData &data) {
 
 	points_.clear();
 
+	nbr_frames_ = 0;
+
 	data = TelemetryData();
 	type = retrieveData(data);
 
@@ -698,29 +771,614 @@ enum TelemetrySource::Data TelemetrySource::retrieveLast(TelemetryData &data) {
 }
 
 
+enum TelemetrySource::Data TelemetrySource::retrieveFrame(TelemetryData &data, uint64_t timestamp) {
+	uint64_t next;
 
-TelemetrySource * TelemetryMedia::open(const std::string &filename, enum TelemetrySettings::Method method) {
-	TelemetryData data;
+	log_call();
 
-	TelemetrySource *source = NULL;
+	// One value each second
+	if (interpolation_ == TelemetrySettings::InterpolationNone)
+		return retrieveNext(data, timestamp);
+
+	// Replay goes on from the current data (see retrieveFirst)
+	if (nbr_frames_ == 0) {
+		replay_ = data;
+		frames_eof_ = false;
+
+		pushFrame(replay_);
+	}
+
+	timestamp += offset_;
+
+	// Compute samples up to the second after the next one
+	while ((nbr_frames_ < 4) || (frames_[2].ts_ <= timestamp)) {
+		if (!frames_eof_) {
+			next = (frames_[nbr_frames_ - 1].ts_ / 1000 + 1) * 1000;
+
+			if (retrieveNext(replay_, next - offset_) != TelemetrySource::DataEof) {
+				pushFrame(replay_);
+				continue;
+			}
+
+			frames_eof_ = true;
+		}
+
+		// End of data, the last sample is repeated
+		if ((nbr_frames_ == 4) && (frames_[3].ts_ == frames_[2].ts_))
+			break;
+
+		pushFrame(frames_[nbr_frames_ - 1]);
+	}
+
+	interpolateFrame(data, timestamp);
+
+	if (frames_eof_ && (frames_[2].ts_ <= timestamp))
+		return TelemetrySource::DataEof;
+
+	return TelemetrySource::DataAgain;
+}
+
+
+void TelemetrySource::pushFrame(const TelemetryData &data) {
+	size_t i;
+
+	// First sample is also the previous one
+	if (nbr_frames_ == 0)
+		frames_[nbr_frames_++] = data;
+
+	if (nbr_frames_ < 4) {
+		frames_[nbr_frames_++] = data;
+		return;
+	}
+
+	for (i=0; i<3; i++)
+		frames_[i] = frames_[i + 1];
+
+	frames_[3] = data;
+}
+
+
+static double interpolate(enum TelemetrySettings::Interpolation mode, double u,
+	double p0, double p1, double p2, double p3) {
+	if (mode == TelemetrySettings::InterpolationLinear)
+		return p1 + u * (p2 - p1);
+
+	// Catmull-Rom spline, goes through p1 & p2
+	return 0.5 * ((2.0 * p1)
+		+ (p2 - p0) * u
+		+ (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * u * u
+		+ (3.0 * (p1 - p2) + p3 - p0) * u * u * u);
+}
+
+
+static bool bearing(const TelemetryData &from, const TelemetryData &to, double &heading) {
+	double dx, dy;
+
+	if (!from.hasValue(TelemetryData::DataFix) || !to.hasValue(TelemetryData::DataFix))
+		return false;
+
+	dy = to.latitude() - from.latitude();
+	dx = (to.longitude() - from.longitude()) * cos((from.latitude() + to.latitude()) / 2.0 * M_PI / 180.0);
+
+	// Not moving, no direction
+	if ((dx == 0.0) && (dy == 0.0))
+		return false;
+
+	heading = atan2(dx, dy) * 180.0 / M_PI;
+
+	if (heading < 0.0)
+		heading += 360.0;
+
+	return true;
+}
+
+
+void TelemetrySource::interpolateFrame(TelemetryData &data, uint64_t timestamp) {
+	double u, dh;
+	double h1, h2;
+
+	bool has_h1, has_h2;
+
+	const TelemetryData &p0 = frames_[0];
+	const TelemetryData &p1 = frames_[1];
+	const TelemetryData &p2 = frames_[2];
+	const TelemetryData &p3 = frames_[3];
+
+	TelemetryData result;
+
+	// Before the first sample or after the last one
+	if ((timestamp <= p1.ts_) || (p2.ts_ <= p1.ts_)) {
+		result = (timestamp < p2.ts_) ? p1 : p2;
+		u = 0.0;
+	}
+	else {
+		result = p1;
+		result.type_ = TelemetryData::TypePredicted;
+		result.ts_ = timestamp;
+
+		u = (double) (timestamp - p1.ts_) / (double) (p2.ts_ - p1.ts_);
+
+		if (p1.hasValue(TelemetryData::DataFix) && p2.hasValue(TelemetryData::DataFix)) {
+			result.lat_ = interpolate(interpolation_, u,
+				p0.hasValue(TelemetryData::DataFix) ? p0.lat_ : p1.lat_, p1.lat_,
+				p2.lat_, p3.hasValue(TelemetryData::DataFix) ? p3.lat_ : p2.lat_);
+			result.lon_ = interpolate(interpolation_, u,
+				p0.hasValue(TelemetryData::DataFix) ? p0.lon_ : p1.lon_, p1.lon_,
+				p2.lon_, p3.hasValue(TelemetryData::DataFix) ? p3.lon_ : p2.lon_);
+		}
+
+		if (p1.hasValue(TelemetryData::DataElevation) && p2.hasValue(TelemetryData::DataElevation)) {
+			result.ele_ = interpolate(interpolation_, u,
+				p0.hasValue(TelemetryData::DataElevation) ? p0.ele_ : p1.ele_, p1.ele_,
+				p2.ele_, p3.hasValue(TelemetryData::DataElevation) ? p3.ele_ : p2.ele_);
+		}
+
+		if (p1.hasValue(TelemetryData::DataSpeed) && p2.hasValue(TelemetryData::DataSpeed)) {
+			result.speed_ = interpolate(interpolation_, u,
+				p0.hasValue(TelemetryData::DataSpeed) ? p0.speed_ : p1.speed_, p1.speed_,
+				p2.speed_, p3.hasValue(TelemetryData::DataSpeed) ? p3.speed_ : p2.speed_);
+
+			// Spline overshoot
+			if (result.speed_ < 0.0)
+				result.speed_ = 0.0;
+		}
+
+		// Distance is increasing, always linear
+		if (p1.hasValue(TelemetryData::DataDistance) && p2.hasValue(TelemetryData::DataDistance))
+			result.distance_ = p1.distance_ + u * (p2.distance_ - p1.distance_);
+	}
+
+	// Heading at a sample is given by its neighbours, then interpolated
+	has_h1 = bearing(p0, p2, h1);
+	has_h2 = bearing(p1, p3, h2);
+
+	if (!has_h1 && data.hasValue(TelemetryData::DataHeading)) {
+		// Keep the last direction
+		h1 = data.heading_;
+		has_h1 = true;
+	}
+
+	if (!has_h2) {
+		h2 = h1;
+		has_h2 = has_h1;
+	}
+	else if (!has_h1) {
+		h1 = h2;
+		has_h1 = true;
+	}
+
+	if (has_h1) {
+		// Shortest turn
+		dh = fmod(h2 - h1 + 540.0, 360.0) - 180.0;
+
+		result.heading_ = fmod(h1 + u * dh + 360.0, 360.0);
+		result.has_value_ |= TelemetryData::DataHeading;
+	}
+
+	// Same frame time, nothing to refresh
+	if ((data.ts_ == result.ts_) && (data.lat_ == result.lat_) && (data.lon_ == result.lon_))
+		result.type_ = TelemetryData::TypeUnchanged;
+
+	data = result;
+}
+
+
+
+std::mutex TelemetryTimeline::timelines_mutex_;
+std::map<std::string, std::weak_ptr<TelemetryTimeline> > TelemetryTimeline::timelines_;
+
+
+TelemetryTimeline::TelemetryTimeline()
+	: sorted_(true)
+	, smoothed_(false) {
+	log_call();
+}
+
+
+TelemetryTimeline::~TelemetryTimeline() {
+	log_call();
+}
+
+
+TelemetryTimelinePtr TelemetryTimeline::load(const std::string &filename) {
+	TelemetryTimelinePtr timeline;
+
+	TelemetrySource *reader = NULL;
 
 	std::string ext = std::filesystem::path(filename).extension();
 
+	log_call();
+
 	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
 
+	std::lock_guard<std::mutex> lock(timelines_mutex_);
+
+	// Already loaded (& still in use)
+	auto it = timelines_.find(filename);
+
+	if ((it != timelines_.end()) && ((timeline = it->second.lock()) != NULL))
+		return timeline;
+
 	if (ext == ".gpx") {
-		source = new GPX(filename);
+		reader = new GPX(filename);
+	}
+	else if (ext == ".fit") {
+		reader = new FIT(filename);
 	}
 	else if (ext == ".csv") {
-		source = new CSV(filename);
+		reader = new CSV(filename);
+	}
+	else {
+		log_error("Telemetry file '%s' format not supported", filename.c_str());
+		return NULL;
 	}
 
+	timeline = std::make_shared<TelemetryTimeline>();
+
+	// Read each point once
+	reader->reset();
+
+	for (;;) {
+		TelemetrySource::Point point;
+
+		point.setType(TelemetryData::TypeMeasured);
+
+		if (reader->read(point) == TelemetrySource::DataEof)
+			break;
+
+		timeline->append(point);
+	}
+
+	delete reader;
+
+	log_info("Telemetry file '%s' loaded: %lu points", filename.c_str(), timeline->size());
+
+	// Forget the released timelines
+	for (it = timelines_.begin(); it != timelines_.end(); ) {
+		if (it->second.expired())
+			it = timelines_.erase(it);
+		else
+			++it;
+	}
+
+	timelines_[filename] = timeline;
+
+	return timeline;
+}
+
+
+void TelemetryTimeline::append(const TelemetryData &point) {
+	if (!timestamps_.empty() && (point.ts_ < timestamps_.back()))
+		sorted_ = false;
+
+	values_.push_back(point.has_value_);
+	lines_.push_back(point.line_);
+	types_.push_back(point.type_);
+
+	timestamps_.push_back(point.ts_);
+	latitudes_.push_back(point.lat_);
+	longitudes_.push_back(point.lon_);
+	elevations_.push_back(point.ele_);
+	temperatures_.push_back(point.temperature_);
+	heartrates_.push_back(point.heartrate_);
+	cadences_.push_back(point.cadence_);
+	powers_.push_back(point.power_);
+
+	distances_.push_back(point.distance_);
+	durations_.push_back(point.duration_);
+	grades_.push_back(point.grade_);
+	speeds_.push_back(point.speed_);
+	maxspeeds_.push_back(point.maxspeed_);
+	ridetimes_.push_back(point.ridetime_);
+	elapsedtimes_.push_back(point.elapsedtime_);
+	avgspeeds_.push_back(point.avgspeed_);
+	avgridespeeds_.push_back(point.avgridespeed_);
+	laps_.push_back(point.lap_);
+}
+
+
+void TelemetryTimeline::get(size_t index, TelemetrySource::Point &point) const {
+	point = TelemetrySource::Point();
+
+	point.has_value_ = values_[index];
+	point.line_ = lines_[index];
+	point.type_ = (TelemetryData::Type) types_[index];
+
+	point.ts_ = timestamps_[index];
+	point.lat_ = latitudes_[index];
+	point.lon_ = longitudes_[index];
+	point.ele_ = elevations_[index];
+	point.temperature_ = temperatures_[index];
+	point.heartrate_ = heartrates_[index];
+	point.cadence_ = cadences_[index];
+	point.power_ = powers_[index];
+
+	point.distance_ = distances_[index];
+	point.duration_ = durations_[index];
+	point.grade_ = grades_[index];
+	point.speed_ = speeds_[index];
+	point.maxspeed_ = maxspeeds_[index];
+	point.ridetime_ = ridetimes_[index];
+	point.elapsedtime_ = elapsedtimes_[index];
+	point.avgspeed_ = avgspeeds_[index];
+	point.avgridespeed_ = avgridespeeds_[index];
+	point.lap_ = laps_[index];
+}
+
+
+size_t TelemetryTimeline::find(uint64_t timestamp) const {
+	size_t i;
+
+	if (sorted_)
+		return std::lower_bound(timestamps_.begin(), timestamps_.end(), timestamp) - timestamps_.begin();
+
+	for (i=0; i<timestamps_.size(); i++) {
+		if (timestamps_[i] >= timestamp)
+			break;
+	}
+
+	return i;
+}
+
+
+bool TelemetryTimeline::interpolate(uint64_t timestamp, TelemetrySource::Point &point) const {
+	size_t next, prev;
+
+	double ratio;
+
+	next = find(timestamp);
+
+	if (next >= size())
+		return false;
+
+	get(next, point);
+
+	if ((next == 0) || (timestamps_[next] == timestamp))
+		return true;
+
+	prev = next - 1;
+
+	if (timestamps_[next] <= timestamps_[prev])
+		return true;
+
+	ratio = (double) (timestamp - timestamps_[prev]) / (double) (timestamps_[next] - timestamps_[prev]);
+
+	point.type_ = TelemetryData::TypePredicted;
+	point.ts_ = timestamp;
+
+	if (hasValue(prev, TelemetryData::DataFix) && hasValue(next, TelemetryData::DataFix)) {
+		point.lat_ = latitudes_[prev] + ratio * (latitudes_[next] - latitudes_[prev]);
+		point.lon_ = longitudes_[prev] + ratio * (longitudes_[next] - longitudes_[prev]);
+	}
+
+	if (hasValue(prev, TelemetryData::DataElevation) && hasValue(next, TelemetryData::DataElevation))
+		point.ele_ = elevations_[prev] + ratio * (elevations_[next] - elevations_[prev]);
+
+	if (hasValue(prev, TelemetryData::DataTemperature) && hasValue(next, TelemetryData::DataTemperature))
+		point.temperature_ = temperatures_[prev] + ratio * (temperatures_[next] - temperatures_[prev]);
+
+	if (hasValue(prev, TelemetryData::DataHeartrate) && hasValue(next, TelemetryData::DataHeartrate))
+		point.heartrate_ = heartrates_[prev] + ratio * (heartrates_[next] - heartrates_[prev]);
+
+	if (hasValue(prev, TelemetryData::DataCadence) && hasValue(next, TelemetryData::DataCadence))
+		point.cadence_ = cadences_[prev] + ratio * (cadences_[next] - cadences_[prev]);
+
+	if (hasValue(prev, TelemetryData::DataPower) && hasValue(next, TelemetryData::DataPower))
+		point.power_ = powers_[prev] + ratio * (powers_[next] - powers_[prev]);
+
+	return true;
+}
+
+
+void TelemetryTimeline::computeSegments(enum TelemetrySettings::Distance mode) {
+	size_t i, n, chunk;
+
+	std::vector<std::thread> workers;
+
+	log_call();
+
+	segments_[mode].resize(size());
+
+	if (segments_[mode].empty())
+		return;
+
+	segments_[mode][0] = 0.0;
+
+	// Segments are independent, computed by chunks in parallel
+	n = std::max(1u, std::thread::hardware_concurrency());
+	chunk = std::max((size() + n - 1) / n, (size_t) 16384);
+
+	if (chunk >= size()) {
+		computeChunk(1, size(), mode);
+		return;
+	}
+
+	for (i=1; i<size(); i+=chunk)
+		workers.push_back(std::thread(&TelemetryTimeline::computeChunk, this, i, std::min(i + chunk, size()), mode));
+
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+
+void TelemetryTimeline::computeChunk(size_t begin, size_t end, enum TelemetrySettings::Distance mode) const {
+	size_t i;
+
+	std::vector<double> &segments = segments_[mode];
+
+	const double *lat = latitudes_.data();
+	const double *lon = longitudes_.data();
+
+	// Same distance (and same order) as TelemetrySource::segment
+	for (i=begin; i<end; i++)
+		segments[i] = TelemetrySource::distance(lat[i], lon[i], lat[i - 1], lon[i - 1], mode);
+}
+
+
+const std::vector<double>& TelemetryTimeline::segments(enum TelemetrySettings::Distance mode) const {
+	std::lock_guard<std::mutex> lock(segments_lock_.mutex);
+
+	// Shared timeline, computed by the first cursor of this mode
+	if (segments_[mode].size() != size())
+		const_cast<TelemetryTimeline *>(this)->computeSegments(mode);
+
+	return segments_[mode];
+}
+
+
+bool TelemetryTimeline::segment(size_t index, const TelemetryData &prev, const TelemetryData &cur,
+	const std::vector<double> &segments, double &distance) const {
+	if (segments.size() != size())
+		return false;
+
+	// Successive points of the timeline only (the previous one may be
+	// a sample copy, same position but another timestamp)
+	if ((index == 0) || (index >= size()) || (timestamps_[index] != cur.ts_))
+		return false;
+
+	if ((latitudes_[index] != cur.lat_) || (longitudes_[index] != cur.lon_)
+		|| (latitudes_[index - 1] != prev.lat_) || (longitudes_[index - 1] != prev.lon_))
+		return false;
+
+	distance = segments[index];
+
+	return true;
+}
+
+
+bool TelemetryTimeline::getBoundingBox(uint64_t from, uint64_t to, TelemetryData *p1, TelemetryData *p2) const {
+	size_t i;
+
+	TelemetrySource::Point point;
+
+	log_call();
+
+	// Skip points before 'from'
+	for (i=(sorted_ && (from != 0)) ? find(from) : 0; i<size(); i++) {
+		if (!hasValue(i, TelemetryData::DataFix))
+			continue;
+
+		if ((from != 0) && (timestamps_[i] < from))
+			continue;
+
+		if (!p1->hasValue(TelemetryData::DataFix) || !p2->hasValue(TelemetryData::DataFix)) {
+			get(i, point);
+
+			if (!p1->hasValue(TelemetryData::DataFix))
+				*p1 = point;
+			if (!p2->hasValue(TelemetryData::DataFix))
+				*p2 = point;
+		}
+
+		// top-left bounding box
+		if (longitudes_[i] < p1->lon_)
+			p1->lon_ = longitudes_[i];
+		if (latitudes_[i] > p1->lat_)
+			p1->lat_ = latitudes_[i];
+
+		// bottom-right bounding box
+		if (longitudes_[i] > p2->lon_)
+			p2->lon_ = longitudes_[i];
+		if (latitudes_[i] < p2->lat_)
+			p2->lat_ = latitudes_[i];
+
+		if ((to != 0) && (timestamps_[i] > to))
+			break;
+	}
+
+	return (p1->hasValue(TelemetryData::DataFix) && p2->hasValue(TelemetryData::DataFix));
+}
+
+
+
+TelemetryCursor::TelemetryCursor(TelemetryTimelinePtr timeline)
+	: TelemetrySource()
+	, timeline_(timeline)
+	, index_(0)
+	, segments_(NULL)
+	, segments_mode_(TelemetrySettings::DistanceGeodesic) {
+	log_call();
+}
+
+
+TelemetryCursor::~TelemetryCursor() {
+	log_call();
+}
+
+
+void TelemetryCursor::reset() {
+	log_call();
+
+	index_ = 0;
+}
+
+
+enum TelemetrySource::Data TelemetryCursor::read(TelemetrySource::Point &point) {
+	log_call();
+
+	if (index_ >= timeline_->size())
+		return TelemetrySource::DataEof;
+
+	timeline_->get(index_++, point);
+
+	return TelemetrySource::DataAgain;
+}
+
+
+double TelemetryCursor::segment(const TelemetrySource::Point &prev, const TelemetrySource::Point &cur) {
+	double d;
+
+	// Timeline segments of the cursor distance mode
+	if ((segments_ == NULL) || (segments_mode_ != distance_)) {
+		segments_ = &timeline_->segments(distance_);
+		segments_mode_ = distance_;
+	}
+
+	// Precomputed distance, if any: the current point is the last read
+	// one or the one before (no timestamp search)
+	if ((index_ >= 1) && timeline_->segment(index_ - 1, prev, cur, *segments_, d))
+		return d;
+
+	if ((index_ >= 2) && timeline_->segment(index_ - 2, prev, cur, *segments_, d))
+		return d;
+
+	return TelemetrySource::segment(prev, cur);
+}
+
+
+bool TelemetryCursor::getBoundingBox(TelemetryData *p1, TelemetryData *p2) {
+	// No need to replay the data, only positions are used
+	return timeline_->getBoundingBox(from_, to_, p1, p2);
+}
+
+
+
+TelemetrySource * TelemetryMedia::open(const std::string &filename, enum TelemetrySettings::Method method) {
+	// File is parsed only once, each caller gets its own cursor
+	TelemetryTimelinePtr timeline = TelemetryTimeline::load(filename);
+
+	if (timeline == NULL)
+		return NULL;
+
+	return open(timeline, method);
+}
+
+
+TelemetrySource * TelemetryMedia::open(TelemetryTimelinePtr timeline, enum TelemetrySettings::Method method) {
+	TelemetryData data;
+
+	TelemetrySource *source = NULL;
+
+	// Kalman: replay the smoothed timeline (computed once per timeline,
+	// cached timelines are already smoothed)
+	if ((method == TelemetrySettings::MethodKalman) && !timeline->isSmoothed())
+		timeline = TelemetrySmoother::get(timeline);
+
+	source = new TelemetryCursor(timeline);
+
 	// Init
 	source->setMethod(method);
 	source->retrieveFirst(data);
 
 	return source;
 }
-
-
-
@@ -3,10 +3,13 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <map>
 #include <string>
 #include <deque>
+#include <vector>
 
-#include "kalman.h"
 #include "telemetrysettings.h"
 
 
@@ -16,11 +19,15 @@ std::string timestamp2string(uint64_t value);
 class TelemetryData;
 class TelemetryMedia;
 class TelemetrySource;
+class TelemetryTimeline;
+
+using TelemetryTimelinePtr = std::shared_ptr<TelemetryTimeline>;
 
 
 class TelemetryData {
 public:
 	friend class TelemetrySource;
+	friend class TelemetryTimeline;
 
 	enum Type {
 		TypeUnknown,
@@ -48,7 +55,10 @@ public:
 		DataAverageSpeed = (1 << 12),
 		DataAverageRideSpeed = (1 << 13),
 
-		DataAll = (1 << 14) -1
+		DataHeading = (1 << 14),
+		DataPower = (1 << 15),
+
+		DataAll = (1 << 16) -1
 	};
 
 	TelemetryData();
@@ -109,6 +119,10 @@ public:
 		return temperature_;
 	}
 
+	const int& power(void) const {
+		return power_;
+	}
+
 	const double &duration(void) const {
 		return duration_;
 	}
@@ -149,6 +163,11 @@ public:
 		return lap_;
 	}
 
+	// Direction of travel, in degrees (per frame interpolation only)
+	const double& heading(void) const {
+		return heading_;
+	}
+
 	bool hasValue(Data type = DataAll) const {
 		return ((has_value_ & type) == type);
 	}
@@ -169,6 +188,7 @@ protected:
 	double temperature_;
 	int heartrate_;
 	int cadence_;
+	int power_;
 
 	double distance_;
 	double duration_;
@@ -182,6 +202,8 @@ protected:
 
 	int lap_;
 	bool in_lap_;
+
+	double heading_;
 };
 
 
@@ -258,6 +280,12 @@ public:
 			addValue(Data::DataTemperature);
 		}
 
+		void setPower(int power) {
+			power_ = power;
+
+			addValue(Data::DataPower);
+		}
+
 		void setDuration(double duration) {
 			duration_ = duration;
 
@@ -384,12 +412,15 @@ public:
 		}
 	};
 
+	TelemetrySource();
 	TelemetrySource(const std::string &filename);
 	virtual ~TelemetrySource();
 
 	void setNumberOfPoints(const unsigned long number);
 
 	void setMethod(enum TelemetrySettings::Method method=TelemetrySettings::MethodNone);
+	void setDistance(enum TelemetrySettings::Distance distance=TelemetrySettings::DistanceGeodesic);
+	void setInterpolation(enum TelemetrySettings::Interpolation interpolation=TelemetrySettings::InterpolationNone);
 
 	bool setFrom(std::string from);
 	bool setTo(std::string to);
@@ -401,7 +432,7 @@ public:
 	int64_t timeOffset(void) const;
 	void setTimeOffset(const int64_t& offset);
 
-	bool getBoundingBox(TelemetryData *p1, TelemetryData *p2);
+	virtual bool getBoundingBox(TelemetryData *p1, TelemetryData *p2);
 
 	enum Data retrieveFirst(TelemetryData &data);
 	enum Data retrieveFrom(TelemetryData &data);
@@ -409,15 +440,31 @@ public:
 	enum Data retrieveData(TelemetryData &data);
 	enum Data retrieveLast(TelemetryData &data);
 
+	// Data at the exact (frame) timestamp, interpolated between the
+	// computed samples of each second (see setInterpolation)
+	enum Data retrieveFrame(TelemetryData &data, uint64_t timestamp);
+
 	virtual void reset() = 0;
 	virtual enum Data read(Point &point) = 0;
 
+	// Distance in meters, the fast mode uses a local flat approximation
+	// for segments shorter than 100m (error below 0.1µm)
+	static double distance(double lat1, double lon1, double lat2, double lon2,
+		enum TelemetrySettings::Distance mode=TelemetrySettings::DistanceGeodesic);
+
+protected:
+	// Distance between two successive points
+	virtual double segment(const Point &prev, const Point &cur);
+
 private:
 	void push(Point &pt);
 	void compute(TelemetryData &data);
 	void update(TelemetryData &data);
 	void predict(TelemetryData &data);
 
+	void pushFrame(const TelemetryData &data);
+	void interpolateFrame(TelemetryData &data, uint64_t timestamp);
+
 	void enableCompute(void) {
 		enable_ = true;
 	}
@@ -443,14 +490,167 @@ protected:
 	uint64_t to_;
 
 	enum TelemetrySettings::Method method_;
+	enum TelemetrySettings::Distance distance_;
+	enum TelemetrySettings::Interpolation interpolation_;
+
+	// Per frame interpolation: the replay runs up to 2 seconds ahead, the
+	// last 4 computed samples are kept (previous, current, next, after)
+	TelemetryData replay_;
+	TelemetryData frames_[4];
+	size_t nbr_frames_;
+	bool frames_eof_;
+};
+
+
+// Points of a telemetry file, read once and shared (read-only) by all the
+// sources opened on this file. Points are stored by columns, with a
+// presence bitmask (TelemetryData::Data) for each point.
+class TelemetryTimeline {
+public:
+	friend class TelemetryCache;
+	friend class TelemetrySmoother;
+
+	TelemetryTimeline();
+	virtual ~TelemetryTimeline();
+
+	static TelemetryTimelinePtr load(const std::string &filename);
+
+	size_t size(void) const {
+		return timestamps_.size();
+	}
+
+	// Positions already smoothed (Kalman)
+	bool isSmoothed(void) const {
+		return smoothed_;
+	}
+
+	const std::vector<uint64_t>& timestamps(void) const {
+		return timestamps_;
+	}
+
+	const std::vector<double>& latitudes(void) const {
+		return latitudes_;
+	}
+
+	const std::vector<double>& longitudes(void) const {
+		return longitudes_;
+	}
+
+	const std::vector<double>& elevations(void) const {
+		return elevations_;
+	}
+
+	bool hasValue(size_t index, TelemetryData::Data type) const {
+		return ((values_[index] & type) == type);
+	}
+
+	void append(const TelemetryData &point);
+	void get(size_t index, TelemetrySource::Point &point) const;
+
+	// Index of the first point at or after timestamp (size() if none)
+	size_t find(uint64_t timestamp) const;
+
+	// Point at timestamp, linear interpolation between neighbours
+	bool interpolate(uint64_t timestamp, TelemetrySource::Point &point) const;
+
+	bool getBoundingBox(uint64_t from, uint64_t to, TelemetryData *p1, TelemetryData *p2) const;
+
+	// Distance between successive points, computed once for the timeline
+	// & each distance mode, on first use
+	void computeSegments(enum TelemetrySettings::Distance mode);
+	const std::vector<double>& segments(enum TelemetrySettings::Distance mode) const;
+
+	// Precomputed distance, false if prev & cur aren't the points at
+	// index - 1 & index
+	bool segment(size_t index, const TelemetryData &prev, const TelemetryData &cur,
+		const std::vector<double> &segments, double &distance) const;
+
+private:
+	void computeChunk(size_t begin, size_t end, enum TelemetrySettings::Distance mode) const;
+
+	// Loaded timelines, shared while in use
+	static std::mutex timelines_mutex_;
+	static std::map<std::string, std::weak_ptr<TelemetryTimeline> > timelines_;
+
+	// Timestamps are increasing (binary search), else linear search
+	bool sorted_;
+
+	bool smoothed_;
+
+	std::vector<int> values_;
+	std::vector<uint32_t> lines_;
+	std::vector<uint8_t> types_;
+
+	std::vector<uint64_t> timestamps_;
+	std::vector<double> latitudes_;
+	std::vector<double> longitudes_;
+	std::vector<double> elevations_;
+	std::vector<double> temperatures_;
+	std::vector<int> heartrates_;
+	std::vector<int> cadences_;
+	std::vector<int> powers_;
+
+	// Imported data (CSV)
+	std::vector<double> distances_;
+	std::vector<double> durations_;
+	std::vector<double> grades_;
+	std::vector<double> speeds_;
+	std::vector<double> maxspeeds_;
+	std::vector<double> ridetimes_;
+	std::vector<double> elapsedtimes_;
+	std::vector<double> avgspeeds_;
+	std::vector<double> avgridespeeds_;
+	std::vector<int> laps_;
+
+	// Distance from the previous point, by distance mode (the lock isn't
+	// copied with the timeline)
+	class Lock {
+	public:
+		Lock() {}
+		Lock(const Lock &) {}
+
+		Lock& operator=(const Lock &) {
+			return *this;
+		}
+
+		std::mutex mutex;
+	};
+
+	mutable Lock segments_lock_;
+	mutable std::vector<double> segments_[TelemetrySettings::DistanceCount];
+};
+
+
+// Sequential access to a timeline, each consumer has its own cursor (and
+// its own computed data, since they depend on from/to & method settings)
+class TelemetryCursor : public TelemetrySource {
+public:
+	TelemetryCursor(TelemetryTimelinePtr timeline);
+	virtual ~TelemetryCursor();
+
+	bool getBoundingBox(TelemetryData *p1, TelemetryData *p2);
+
+	void reset();
+	enum Data read(Point &point);
+
+protected:
+	double segment(const Point &prev, const Point &cur);
+
+private:
+	TelemetryTimelinePtr timeline_;
+
+	size_t index_;
 
-	KalmanFilter kalman_;
+	// Timeline segments of the distance mode
+	const std::vector<double> *segments_;
+	enum TelemetrySettings::Distance segments_mode_;
 };
 
 
 class TelemetryMedia {
 public:
 	static TelemetrySource * open(const std::string &filename, enum TelemetrySettings::Method method=TelemetrySettings::MethodNone);
+	static TelemetrySource * open(TelemetryTimelinePtr timeline, enum TelemetrySettings::Method method=TelemetrySettings::MethodNone);
 
 	//void dump(void);
 };
@@ -28,10 +28,29 @@ public:
 		MethodCount
 	};
 
+	enum Distance {
+		DistanceGeodesic = 0,	// GeographicLib, full accuracy
+
+		DistanceFast,			// Flat approximation for short segments
+
+		DistanceCount
+	};
+
+	enum Interpolation {
+		InterpolationNone = 0,	// One value each second
+
+		InterpolationLinear,	// Per frame, linear
+		InterpolationSpline,	// Per frame, Catmull-Rom spline
+
+		InterpolationCount
+	};
+
 	TelemetrySettings(
 			TelemetrySettings::Method method=TelemetrySettings::MethodNone,
 			int rate=0,
-			TelemetrySettings::Format format=TelemetrySettings::FormatAuto
+			TelemetrySettings::Format format=TelemetrySettings::FormatAuto,
+			TelemetrySettings::Distance distance=TelemetrySettings::DistanceGeodesic,
+			TelemetrySettings::Interpolation interpolation=TelemetrySettings::InterpolationNone
 	);
 	virtual ~TelemetrySettings();
 
@@ -41,6 +60,10 @@ public:
 
 	const int& telemetryRate(void) const;
 
+	const Distance& telemetryDistance(void) const;
+
+	const Interpolation& telemetryInterpolation(void) const;
+
 	static const std::string getFriendlyName(const Method &method);
 
 private:
@@ -49,6 +72,10 @@ private:
 	enum Method telemetry_method_;
 
 	int telemetry_rate_;
+
+	enum Distance telemetry_distance_;
+
+	enum Interpolation telemetry_interpolation_;
 };
 
 
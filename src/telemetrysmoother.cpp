@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <thread>
+
+#include "log.h"
+#include "telemetrysmoother.h"
+
+
+// kalman.c velocity2d model (positions in thousandths of degree)
+#define UNIT_SCALER 0.001
+#define NOISE_POSITION 0.000001
+#define NOISE_VELOCITY 1.0
+#define NOISE_OBSERVATION (0.000001 * 10.0)
+
+// A gap longer than 60 seconds starts a new segment
+#define SEGMENT_GAP 60000
+
+
+std::mutex TelemetrySmoother::timelines_mutex_;
+std::map<TelemetryTimelinePtr, std::weak_ptr<TelemetryTimeline> > TelemetrySmoother::timelines_;
+
+
+TelemetryTimelinePtr TelemetrySmoother::get(TelemetryTimelinePtr timeline) {
+	TelemetryTimelinePtr smoothed;
+
+	log_call();
+
+	std::lock_guard<std::mutex> lock(timelines_mutex_);
+
+	// Already smoothed (& still in use)
+	auto it = timelines_.find(timeline);
+
+	if ((it != timelines_.end()) && ((smoothed = it->second.lock()) != NULL))
+		return smoothed;
+
+	smoothed = std::make_shared<TelemetryTimeline>(*timeline);
+
+	smooth(*smoothed);
+
+	// Forget the released timelines (& their source)
+	for (it = timelines_.begin(); it != timelines_.end(); ) {
+		if (it->second.expired())
+			it = timelines_.erase(it);
+		else
+			++it;
+	}
+
+	timelines_[timeline] = smoothed;
+
+	return smoothed;
+}
+
+
+void TelemetrySmoother::smooth(TelemetryTimeline &timeline) {
+	size_t i, n;
+	size_t first, count, target;
+
+	std::vector<Segment> segments;
+	std::vector<std::thread> workers;
+
+	Segment segment;
+
+	const std::vector<uint64_t> &ts = timeline.timestamps_;
+
+	log_call();
+
+	// Split in segments of successive fixes
+	segment.begin = 0;
+
+	for (i=0; i<timeline.size(); i++) {
+		// Point without fix or time gap, end of segment
+		if (timeline.hasValue(i, TelemetryData::DataFix)) {
+			if ((i == segment.begin) || ((ts[i] >= ts[i - 1]) && (ts[i] - ts[i - 1] <= SEGMENT_GAP)))
+				continue;
+		}
+
+		if (i > segment.begin) {
+			segment.end = i;
+			segments.push_back(segment);
+		}
+
+		segment.begin = timeline.hasValue(i, TelemetryData::DataFix) ? i : i + 1;
+	}
+
+	if (timeline.size() > segment.begin) {
+		segment.end = timeline.size();
+		segments.push_back(segment);
+	}
+
+	if (segments.empty()) {
+		timeline.smoothed_ = true;
+		return;
+	}
+
+	// Segments are independent, shared out between the workers
+	n = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()), segments.size());
+
+	if ((n == 1) || (timeline.size() < 16384)) {
+		smoothSegments(timeline, segments, 0, segments.size());
+	}
+	else {
+		target = (timeline.size() + n - 1) / n;
+
+		for (first=0, i=0, count=0; i<segments.size(); i++) {
+			count += segments[i].end - segments[i].begin;
+
+			if ((count < target) && (i + 1 < segments.size()))
+				continue;
+
+			workers.push_back(std::thread(&TelemetrySmoother::smoothSegments, std::ref(timeline), std::cref(segments), first, i + 1));
+
+			first = i + 1;
+			count = 0;
+		}
+
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+
+	// Positions changed, segments computed again on first use
+	for (i=0; i<TelemetrySettings::DistanceCount; i++)
+		timeline.segments_[i].clear();
+
+	timeline.smoothed_ = true;
+}
+
+
+void TelemetrySmoother::smoothSegments(TelemetryTimeline &timeline, const std::vector<Segment> &segments, size_t first, size_t last) {
+	size_t i;
+
+	std::vector<double> state;
+
+	for (i=first; i<last; i++) {
+		const Segment &segment = segments[i];
+
+		const uint64_t *ts = timeline.timestamps_.data() + segment.begin;
+
+		smooth(ts, timeline.latitudes_.data() + segment.begin, segment.end - segment.begin, state);
+		smooth(ts, timeline.longitudes_.data() + segment.begin, segment.end - segment.begin, state);
+	}
+}
+
+
+void TelemetrySmoother::smooth(const uint64_t *ts, double *x, size_t n, std::vector<double> &state) {
+	size_t k;
+
+	double s, y, det;
+	double dp, dv;
+	double gain0, gain1;
+
+	// Filtered state (position, velocity) & covariance [a b; b c]
+	double p, v, a, b, c;
+	// Predicted state & covariance
+	double pp, vp, ap, bp, cp;
+	// Smoothed state
+	double sp, sv;
+	// Smoother gain
+	double c00, c01, c10, c11;
+
+	// Filtered state & covariance of each point
+	state.resize(5 * n);
+
+	// The start position is totally unknown, so give a high variance
+	p = v = 0.0;
+	a = c = 1000.0 * 1000.0 * 1000.0 * 1000.0;
+	b = 0.0;
+
+	// Forward filter
+	for (k=0; k<n; k++) {
+		s = UNIT_SCALER * ((k > 0) ? (ts[k] - ts[k - 1]) / 1000.0 : 1.0);
+
+		pp = p + s * v;
+		vp = v;
+		ap = a + 2.0 * s * b + s * s * c + NOISE_POSITION;
+		bp = b + s * c;
+		cp = c + NOISE_VELOCITY;
+
+		gain0 = ap / (ap + NOISE_OBSERVATION);
+		gain1 = bp / (ap + NOISE_OBSERVATION);
+
+		y = x[k] * 1000.0 - pp;
+
+		p = pp + gain0 * y;
+		v = vp + gain1 * y;
+		a = (1.0 - gain0) * ap;
+		b = (1.0 - gain0) * bp;
+		c = cp - gain1 * bp;
+
+		state[5 * k + 0] = p;
+		state[5 * k + 1] = v;
+		state[5 * k + 2] = a;
+		state[5 * k + 3] = b;
+		state[5 * k + 4] = c;
+	}
+
+	// Backward pass, the last point is already smoothed
+	sp = p;
+	sv = v;
+
+	x[n - 1] = sp / 1000.0;
+
+	for (k=n-1; k-->0; ) {
+		p = state[5 * k + 0];
+		v = state[5 * k + 1];
+		a = state[5 * k + 2];
+		b = state[5 * k + 3];
+		c = state[5 * k + 4];
+
+		// Prediction of the next point (as the forward filter)
+		s = UNIT_SCALER * (ts[k + 1] - ts[k]) / 1000.0;
+
+		pp = p + s * v;
+		vp = v;
+		ap = a + 2.0 * s * b + s * s * c + NOISE_POSITION;
+		bp = b + s * c;
+		cp = c + NOISE_VELOCITY;
+
+		// Gain: P F' inv(Pp)
+		det = ap * cp - bp * bp;
+
+		c00 = ((a + s * b) * cp - b * bp) / det;
+		c01 = (b * ap - (a + s * b) * bp) / det;
+		c10 = ((b + s * c) * cp - c * bp) / det;
+		c11 = (c * ap - (b + s * c) * bp) / det;
+
+		dp = sp - pp;
+		dv = sv - vp;
+
+		sp = p + c00 * dp + c01 * dv;
+		sv = v + c10 * dp + c11 * dv;
+
+		x[k] = sp / 1000.0;
+	}
+}
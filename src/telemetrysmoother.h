@@ -0,0 +1,40 @@
+#ifndef __GPX2VIDEO__TELEMETRYSMOOTHER_H__
+#define __GPX2VIDEO__TELEMETRYSMOOTHER_H__
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "telemetrymedia.h"
+
+
+// Kalman smoothing of the positions (Rauch-Tung-Striebel): a forward
+// filter then a backward pass over the whole timeline, once. Same
+// constant velocity model as kalman.c velocity2d, latitude & longitude
+// are independent so each axis is a 2 states filter.
+//
+// Track segments (split on time gaps) are smoothed in parallel.
+class TelemetrySmoother {
+public:
+	// Smoothed copy of the timeline, computed once & shared
+	static TelemetryTimelinePtr get(TelemetryTimelinePtr timeline);
+
+	// Smooth the timeline positions in place
+	static void smooth(TelemetryTimeline &timeline);
+
+private:
+	class Segment {
+	public:
+		size_t begin;
+		size_t end;
+	};
+
+	static void smoothSegments(TelemetryTimeline &timeline, const std::vector<Segment> &segments, size_t first, size_t last);
+	static void smooth(const uint64_t *ts, double *x, size_t n, std::vector<double> &state);
+
+	// Smoothed timelines, shared while in use (their source too)
+	static std::mutex timelines_mutex_;
+	static std::map<TelemetryTimelinePtr, std::weak_ptr<TelemetryTimeline> > timelines_;
+};
+
+#endif
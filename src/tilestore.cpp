@@ -0,0 +1,1202 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "log.h"
+#include "utils.h"
+#include "tilestore.h"
+
+
+#define G2TS_VERSION 1
+#define G2TA_VERSION 1
+
+// Journal records indexed by flush() (at least)
+#define JOURNAL_MIN 256
+
+// Popped access entries dropped from the queue file (at least)
+#define ACCESS_COMPACT_MIN 4096
+
+// Records are 8 bytes aligned, so is the index
+#define RECORD_SIZE(etag, length) ((sizeof(Record) + (etag) + (length) + 7) & ~((uint64_t) 7))
+
+#define KEY_MASK 0x1fffffffULL
+
+
+TileStore::TileStore(const std::string &filename, int fd)
+	: filename_(filename)
+	, fd_(fd)
+	, data_(NULL)
+	, size_(0)
+	, end_(0)
+	, count_(0)
+	, bytes_(0) {
+	memset(&header_, 0, sizeof(header_));
+}
+
+
+TileStore::~TileStore() {
+	if (data_ != NULL)
+		munmap((void *) data_, size_);
+
+	::close(fd_);
+}
+
+
+std::string TileStore::path(const std::string &cachedir, int source) {
+	return cachedir + "/" + std::to_string(source) + ".g2ts";
+}
+
+
+TileStore * TileStore::open(const std::string &filename) {
+	int fd;
+
+	TileStore *store;
+
+	log_call();
+
+	if ((fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+		log_error("Open '%s' tile store failure", filename.c_str());
+		return NULL;
+	}
+
+	store = new TileStore(filename, fd);
+
+	if (!store->init()) {
+		log_error("Tile store '%s' is invalid", filename.c_str());
+		delete store;
+		return NULL;
+	}
+
+	return store;
+}
+
+
+uint64_t TileStore::key(int zoom, int x, int y) {
+	return ((uint64_t) zoom << 58) | (((uint64_t) x & KEY_MASK) << 29) | ((uint64_t) y & KEY_MASK);
+}
+
+
+uint64_t TileStore::storedSize(const TileStore::Entry &entry) {
+	return RECORD_SIZE(entry.etag, entry.length);
+}
+
+
+// FNV-1a, record (without its hash & accesses) & payload
+uint64_t TileStore::hash(const Record &record, const void *etag, const void *data) {
+	size_t i;
+
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	Record copy = record;
+
+	const uint8_t *parts[3] = { (const uint8_t *) &copy, (const uint8_t *) etag, (const uint8_t *) data };
+	size_t sizes[3] = { sizeof(copy), record.etag, record.length };
+
+	copy.hits = 0;
+	copy.access = 0;
+	copy.hash = 0;
+
+	for (int part=0; part<3; part++) {
+		for (i=0; i<sizes[part]; i++) {
+			hash ^= parts[part][i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+
+	return hash;
+}
+
+
+bool TileStore::init(void) {
+	bool result = false;
+
+	struct stat st;
+
+	Header header;
+
+	if (!lock())
+		return false;
+
+	if (fstat(fd_, &st) != 0)
+		goto done;
+
+	// New store
+	if (st.st_size == 0) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "G2TS", sizeof(header.magic));
+		header.version = G2TS_VERSION;
+		header.index = sizeof(header);
+
+		if (pwrite(fd_, &header, sizeof(header), 0) != sizeof(header))
+			goto done;
+	}
+
+	result = sync();
+
+done:
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::lock(void) {
+	struct stat st, fst;
+
+	for (;;) {
+		while (flock(fd_, LOCK_EX) != 0) {
+			if (errno != EINTR)
+				return false;
+		}
+
+		if ((::stat(filename_.c_str(), &st) != 0) || (fstat(fd_, &fst) != 0)) {
+			unlock();
+			return false;
+		}
+
+		// Still the store file
+		if ((st.st_dev == fst.st_dev) && (st.st_ino == fst.st_ino))
+			return true;
+
+		unlock();
+
+		if (!reopen())
+			return false;
+	}
+}
+
+
+void TileStore::unlock(void) {
+	flock(fd_, LOCK_UN);
+}
+
+
+bool TileStore::reopen(void) {
+	int fd;
+
+	if ((fd = ::open(filename_.c_str(), O_RDWR | O_CLOEXEC)) < 0)
+		return false;
+
+	::close(fd_);
+	fd_ = fd;
+
+	if (data_ != NULL)
+		munmap((void *) data_, size_);
+
+	data_ = NULL;
+	size_ = 0;
+
+	// Loaded by the next sync
+	memset(&header_, 0, sizeof(header_));
+
+	return true;
+}
+
+
+bool TileStore::map(size_t size) {
+	struct stat st;
+
+	void *data;
+
+	if (size <= size_)
+		return true;
+
+	if ((fstat(fd_, &st) != 0) || ((size_t) st.st_size < size))
+		return false;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	if (data_ != NULL)
+		munmap((void *) data_, size_);
+
+	data_ = (const uint8_t *) data;
+	size_ = st.st_size;
+
+	return true;
+}
+
+
+bool TileStore::load(void) {
+	struct stat st;
+
+	Header header;
+
+	if (pread(fd_, &header, sizeof(header), 0) != sizeof(header))
+		return false;
+
+	if ((memcmp(header.magic, "G2TS", sizeof(header.magic)) != 0) || (header.version != G2TS_VERSION))
+		return false;
+
+	if (fstat(fd_, &st) != 0)
+		return false;
+
+	if ((header.index < sizeof(header)) || (header.index + header.count * sizeof(Entry) > (uint64_t) st.st_size))
+		return false;
+
+	header_ = header;
+
+	end_ = header.index + header.count * sizeof(Entry);
+	count_ = header.count;
+	bytes_ = header.bytes;
+
+	journal_.clear();
+
+	return scan();
+}
+
+
+bool TileStore::scan(void) {
+	uint64_t size;
+
+	struct stat st;
+
+	Entry entry;
+	Record record;
+
+	const Entry *previous;
+	const uint8_t *payload;
+
+	if (fstat(fd_, &st) != 0)
+		return false;
+
+	if (!map(st.st_size))
+		return false;
+
+	// Records appended since the last scan (stop on a torn or pending append)
+	while (end_ + sizeof(record) <= (uint64_t) st.st_size) {
+		memcpy(&record, data_ + end_, sizeof(record));
+
+		if (memcmp(record.magic, "G2TR", sizeof(record.magic)) != 0)
+			break;
+
+		size = RECORD_SIZE(record.etag, record.length);
+
+		if (end_ + size > (uint64_t) st.st_size)
+			break;
+
+		payload = data_ + end_ + sizeof(record);
+
+		if (hash(record, payload, payload + record.etag) != record.hash)
+			break;
+
+		previous = lookup(record.key);
+
+		if (record.flags & FlagTouch) {
+			if (previous != NULL) {
+				entry = *previous;
+				entry.fetched_at = record.fetched_at;
+
+				journal_[record.key] = entry;
+			}
+		}
+		else if (record.flags & FlagDelete) {
+			if (previous != NULL) {
+				count_--;
+				bytes_ -= storedSize(*previous);
+			}
+
+			memset(&entry, 0, sizeof(entry));
+			entry.key = record.key;
+			entry.flags = FlagDelete;
+
+			journal_[record.key] = entry;
+		}
+		else {
+			entry.key = record.key;
+			entry.offset = end_;
+			entry.length = record.length;
+			entry.etag = record.etag;
+			entry.flags = 0;
+			entry.fetched_at = record.fetched_at;
+
+			if (previous == NULL)
+				count_++;
+			else
+				bytes_ -= storedSize(*previous);
+
+			bytes_ += size;
+
+			journal_[record.key] = entry;
+		}
+
+		end_ += size;
+	}
+
+	return true;
+}
+
+
+bool TileStore::sync(void) {
+	struct stat st;
+
+	Header header;
+
+	if (pread(fd_, &header, sizeof(header), 0) != sizeof(header))
+		return false;
+
+	// Index rewritten (by another process)
+	if ((header.index != header_.index) || (header.count != header_.count)) {
+		if (!load())
+			return false;
+	}
+	else if (!scan())
+		return false;
+
+	if (fstat(fd_, &st) != 0)
+		return false;
+
+	// Lock owner, so a torn append (writer crash)
+	if ((uint64_t) st.st_size > end_) {
+		log_warn("Tile store '%s' torn append, %lu bytes dropped", filename_.c_str(), (unsigned long) (st.st_size - end_));
+
+		if (ftruncate(fd_, end_) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+
+bool TileStore::append(const Record &record, const void *etag, const void *data) {
+	uint64_t end = end_;
+	uint64_t size = RECORD_SIZE(record.etag, record.length);
+
+	std::vector<uint8_t> buf(size, 0);
+
+	memcpy(buf.data(), &record, sizeof(record));
+	memcpy(buf.data() + sizeof(record), etag, record.etag);
+	memcpy(buf.data() + sizeof(record) + record.etag, data, record.length);
+
+	// Single write, the record is valid once complete
+	if (pwrite(fd_, buf.data(), size, end_) != (ssize_t) size) {
+		if (ftruncate(fd_, end_) != 0)
+			log_warn("Tile store '%s' truncate failure", filename_.c_str());
+
+		return false;
+	}
+
+	// Indexed in the journal
+	if (!scan())
+		return false;
+
+	return (end_ == end + size);
+}
+
+
+const TileStore::Entry * TileStore::lookup(uint64_t key) {
+	const Entry *index, *end, *entry;
+
+	auto it = journal_.find(key);
+
+	// Evicted tile
+	if (it != journal_.end())
+		return (it->second.flags & FlagDelete) ? NULL : &it->second;
+
+	index = (const Entry *) (data_ + header_.index);
+	end = index + header_.count;
+
+	entry = std::lower_bound(index, end, key, [](const Entry &entry, uint64_t key) {
+		return entry.key < key;
+	});
+
+	if ((entry != end) && (entry->key == key))
+		return entry;
+
+	return NULL;
+}
+
+
+void TileStore::entries(std::vector<Entry> &entries) {
+	size_t i;
+
+	const Entry *index = (const Entry *) (data_ + header_.index);
+
+	auto it = journal_.begin();
+
+	entries.clear();
+	entries.reserve(count_);
+
+	// Journal entries replace the index ones
+	for (i=0; i<header_.count; i++) {
+		for (; (it != journal_.end()) && (it->first < index[i].key); it++) {
+			if (!(it->second.flags & FlagDelete))
+				entries.push_back(it->second);
+		}
+
+		if ((it != journal_.end()) && (it->first == index[i].key)) {
+			if (!(it->second.flags & FlagDelete))
+				entries.push_back(it->second);
+
+			it++;
+		}
+		else
+			entries.push_back(index[i]);
+	}
+
+	for (; it != journal_.end(); it++) {
+		if (!(it->second.flags & FlagDelete))
+			entries.push_back(it->second);
+	}
+}
+
+
+bool TileStore::find(int zoom, int x, int y, TileStore::Entry &entry) {
+	const Entry *found = lookup(key(zoom, x, y));
+
+	if (found == NULL)
+		return false;
+
+	entry = *found;
+
+	return true;
+}
+
+
+const uint8_t * TileStore::data(const TileStore::Entry &entry) {
+	uint64_t offset = entry.offset + sizeof(Record) + entry.etag;
+
+	// Appended since mapped
+	if (!map(offset + entry.length))
+		return NULL;
+
+	return data_ + offset;
+}
+
+
+std::string TileStore::etag(const TileStore::Entry &entry) {
+	const uint8_t *tile = data(entry);
+
+	if (tile == NULL)
+		return "";
+
+	return std::string((const char *) tile - entry.etag, entry.etag);
+}
+
+
+bool TileStore::put(int zoom, int x, int y, const void *data, size_t length, const std::string &etag, time_t fetched_at) {
+	int fd;
+
+	bool result = false;
+
+	Access access;
+	Record record;
+
+	log_call();
+
+	if ((length > UINT32_MAX) || (etag.length() > UINT16_MAX))
+		return false;
+
+	memset(&record, 0, sizeof(record));
+	memcpy(record.magic, "G2TR", sizeof(record.magic));
+	record.length = length;
+	record.key = key(zoom, x, y);
+	record.fetched_at = fetched_at;
+	record.etag = etag.length();
+	record.hash = hash(record, etag.data(), data);
+
+	if (!lock())
+		goto done;
+
+	// Stored tile, first access
+	if (sync() && ((fd = openAccess(access)) >= 0)) {
+		record.hits = 1;
+
+		result = enqueue(fd, access, record.key, fetched_at, record.access) && closeAccess(fd, access);
+		result = result && append(record, etag.data(), data);
+	}
+
+	unlock();
+
+done:
+	if (!result)
+		log_error("Write '%s' tile store failure", filename_.c_str());
+
+	return result;
+}
+
+
+bool TileStore::touch(int zoom, int x, int y, time_t fetched_at) {
+	bool result = false;
+
+	Record record;
+
+	log_call();
+
+	memset(&record, 0, sizeof(record));
+	memcpy(record.magic, "G2TR", sizeof(record.magic));
+	record.key = key(zoom, x, y);
+	record.fetched_at = fetched_at;
+	record.flags = FlagTouch;
+	record.hash = hash(record, NULL, NULL);
+
+	if (!lock())
+		return false;
+
+	// Unknown tile
+	if (sync() && (lookup(record.key) != NULL))
+		result = append(record, NULL, NULL);
+
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::flush(bool force) {
+	bool result = false;
+
+	size_t size;
+
+	Header header;
+
+	std::vector<Entry> list;
+
+	log_call();
+
+	if (!lock())
+		return false;
+
+	if (!sync())
+		goto done;
+
+	// Small journal, still read at open
+	if (journal_.empty() || (!force && (journal_.size() < std::max((size_t) JOURNAL_MIN, (size_t) (header_.count / 16))))) {
+		result = true;
+		goto done;
+	}
+
+	entries(list);
+
+	// New index after the records, the previous one is left as is
+	size = list.size() * sizeof(Entry);
+
+	if ((pwrite(fd_, list.data(), size, end_) != (ssize_t) size) || (fdatasync(fd_) != 0)) {
+		if (ftruncate(fd_, end_) != 0)
+			log_warn("Tile store '%s' truncate failure", filename_.c_str());
+
+		goto done;
+	}
+
+	// Readers switch to the new index
+	header = header_;
+	header.index = end_;
+	header.count = list.size();
+	header.bytes = 0;
+
+	for (const Entry &entry : list)
+		header.bytes += storedSize(entry);
+
+	if ((pwrite(fd_, &header, sizeof(header), 0) != sizeof(header)) || (fdatasync(fd_) != 0))
+		goto done;
+
+	if (!load())
+		goto done;
+
+	log_info("Tile store '%s' indexed: %lu tiles", filename_.c_str(), list.size());
+
+	result = true;
+
+done:
+	unlock();
+
+	if (!result)
+		log_error("Index '%s' tile store failure", filename_.c_str());
+
+	return result;
+}
+
+
+int TileStore::openAccess(TileStore::Access &access) {
+	int fd;
+
+	std::string filename = filename_ + ".access";
+
+	if ((fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+		return -1;
+
+	if (pread(fd, &access, sizeof(access), 0) == sizeof(access)) {
+		if ((memcmp(access.magic, "G2TA", sizeof(access.magic)) == 0) && (access.version == G2TA_VERSION) && (access.head >= access.base))
+			return fd;
+
+		// Tiles not queued are no more evicted, still stored
+		log_warn("Tile store '%s' access queue is invalid, reset", filename_.c_str());
+	}
+
+	// New queue
+	if (ftruncate(fd, 0) != 0) {
+		::close(fd);
+		return -1;
+	}
+
+	memset(&access, 0, sizeof(access));
+	memcpy(access.magic, "G2TA", sizeof(access.magic));
+	access.version = G2TA_VERSION;
+	access.base = 1;
+	access.head = 1;
+
+	return fd;
+}
+
+
+bool TileStore::closeAccess(int fd, const TileStore::Access &access) {
+	bool result;
+
+	result = (pwrite(fd, &access, sizeof(access), 0) == sizeof(access));
+	result = (::close(fd) == 0) && result;
+
+	return result;
+}
+
+
+bool TileStore::enqueue(int fd, const TileStore::Access &access, uint64_t key, time_t time, uint64_t &sequence) {
+	uint64_t count = 0;
+
+	struct stat st;
+
+	AccessEntry entry;
+
+	if (fstat(fd, &st) != 0)
+		return false;
+
+	// Queued entries (a torn one is overwritten)
+	if ((uint64_t) st.st_size > sizeof(Access))
+		count = (st.st_size - sizeof(Access)) / sizeof(AccessEntry);
+
+	entry.key = key;
+	entry.time = time;
+
+	if (pwrite(fd, &entry, sizeof(entry), sizeof(Access) + count * sizeof(entry)) != sizeof(entry))
+		return false;
+
+	sequence = access.base + count;
+
+	return true;
+}
+
+
+bool TileStore::compactAccess(void) {
+	int fd, tmpfd = -1;
+
+	bool result = false;
+
+	uint64_t count = 0, popped;
+
+	size_t size;
+
+	struct stat st;
+
+	Access access;
+
+	std::vector<AccessEntry> list;
+
+	std::string filename = filename_ + ".access";
+	std::string tmpfile = filename + ".tmp";
+
+	if ((fd = openAccess(access)) < 0)
+		return false;
+
+	if (fstat(fd, &st) != 0)
+		goto done;
+
+	if ((uint64_t) st.st_size > sizeof(Access))
+		count = (st.st_size - sizeof(Access)) / sizeof(AccessEntry);
+
+	popped = std::min(access.head - access.base, count);
+
+	// Mostly queued entries, kept as is
+	if ((popped < ACCESS_COMPACT_MIN) || (popped < count - popped)) {
+		result = true;
+		goto done;
+	}
+
+	list.resize(count - popped);
+	size = list.size() * sizeof(AccessEntry);
+
+	if (pread(fd, list.data(), size, sizeof(Access) + popped * sizeof(AccessEntry)) != (ssize_t) size)
+		goto done;
+
+	access.base += popped;
+
+	if ((tmpfd = ::open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0)
+		goto done;
+
+	if ((pwrite(tmpfd, &access, sizeof(access), 0) != sizeof(access))
+		|| (pwrite(tmpfd, list.data(), size, sizeof(access)) != (ssize_t) size)
+		|| (::close(tmpfd) != 0)) {
+		tmpfd = -1;
+		::unlink(tmpfile.c_str());
+		goto done;
+	}
+
+	tmpfd = -1;
+
+	// Store lock owner, the queue file is opened by each call
+	result = (::rename(tmpfile.c_str(), filename.c_str()) == 0);
+
+done:
+	if (tmpfd != -1)
+		::close(tmpfd);
+
+	::close(fd);
+
+	return result;
+}
+
+
+bool TileStore::readHits(const TileStore::Entry &entry, uint32_t &hits, uint64_t &access) {
+	Record record;
+
+	if (pread(fd_, &record, sizeof(record), entry.offset) != sizeof(record))
+		return false;
+
+	hits = record.hits;
+	access = record.access;
+
+	return true;
+}
+
+
+bool TileStore::writeHits(const TileStore::Entry &entry, uint32_t hits, uint64_t access) {
+	if (pwrite(fd_, &hits, sizeof(hits), entry.offset + offsetof(Record, hits)) != sizeof(hits))
+		return false;
+
+	return (pwrite(fd_, &access, sizeof(access), entry.offset + offsetof(Record, access)) == sizeof(access));
+}
+
+
+bool TileStore::access(int zoom, int x, int y, bool hit) {
+	int fd;
+
+	bool result = false;
+
+	uint32_t hits;
+	uint64_t last, sequence;
+
+	Access access;
+
+	const Entry *entry;
+
+	log_call();
+
+	if (!lock())
+		return false;
+
+	if (!sync() || ((fd = openAccess(access)) < 0))
+		goto done;
+
+	if (hit)
+		access.hits++;
+	else
+		access.misses++;
+
+	// Stored tile, now the most recent one
+	entry = lookup(key(zoom, x, y));
+
+	result = (entry == NULL)
+		|| (readHits(*entry, hits, last) && enqueue(fd, access, entry->key, time(NULL), sequence) && writeHits(*entry, hits + 1, sequence));
+	result = closeAccess(fd, access) && result;
+
+done:
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::stats(TileStore::Stats &stats) {
+	int fd;
+
+	bool result = false;
+
+	struct stat st;
+
+	Access access;
+
+	memset(&stats, 0, sizeof(stats));
+
+	if (!lock())
+		return false;
+
+	if (sync() && ((fd = openAccess(access)) >= 0)) {
+		stats.tiles = count_;
+		stats.bytes = bytes_;
+		stats.hits = access.hits;
+		stats.misses = access.misses;
+
+		// Allocated blocks, evicted tiles are holes
+		if (fstat(fd_, &st) == 0)
+			stats.disk += (uint64_t) st.st_blocks * 512;
+		if (fstat(fd, &st) == 0)
+			stats.disk += (uint64_t) st.st_blocks * 512;
+
+		::close(fd);
+
+		result = true;
+	}
+
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::victim(CacheSettings::Policy policy, TileStore::Entry &entry, time_t &accessed_at) {
+	int fd;
+
+	bool result = false;
+
+	uint32_t hits;
+	uint64_t last, sequence;
+
+	Access access;
+	AccessEntry queued;
+
+	const Entry *found;
+
+	if (!lock())
+		return false;
+
+	if (!sync() || ((fd = openAccess(access)) < 0))
+		goto done;
+
+	while (pread(fd, &queued, sizeof(queued), sizeof(Access) + (access.head - access.base) * sizeof(queued)) == sizeof(queued)) {
+		found = lookup(queued.key);
+
+		// Tile evicted or accessed since, entry popped
+		if ((found == NULL) || !readHits(*found, hits, last) || (last != access.head)) {
+			access.head++;
+			continue;
+		}
+
+		// Frequently used tile, queued again (second chance) with its hits halved
+		if ((policy == CacheSettings::PolicyLFU) && (hits > 1)) {
+			if (!enqueue(fd, access, queued.key, queued.time, sequence) || !writeHits(*found, hits / 2, sequence))
+				break;
+
+			access.head++;
+			continue;
+		}
+
+		entry = *found;
+		accessed_at = queued.time;
+
+		result = true;
+		break;
+	}
+
+	closeAccess(fd, access);
+
+done:
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::evict(const TileStore::Entry &entry) {
+	int fd;
+
+	bool result = false;
+
+	uint32_t hits;
+	uint64_t last;
+
+	Access access;
+	Record record;
+
+	const Entry *found;
+
+	log_call();
+
+	if (!lock())
+		return false;
+
+	if (!sync() || ((fd = openAccess(access)) < 0))
+		goto done;
+
+	// Still the queue head (not replaced, nor accessed since)
+	found = lookup(entry.key);
+
+	if ((found == NULL) || (found->offset != entry.offset) || !readHits(*found, hits, last) || (last != access.head)) {
+		::close(fd);
+		goto done;
+	}
+
+	memset(&record, 0, sizeof(record));
+	memcpy(record.magic, "G2TR", sizeof(record.magic));
+	record.key = entry.key;
+	record.fetched_at = entry.fetched_at;
+	record.flags = FlagDelete;
+	record.hash = hash(record, NULL, NULL);
+
+	if (!append(record, NULL, NULL)) {
+		::close(fd);
+		goto done;
+	}
+
+	access.head++;
+
+	result = closeAccess(fd, access);
+
+	// Indexed record, never read again: free its blocks (else left to compact)
+	if (entry.offset + storedSize(entry) <= header_.index)
+		fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, entry.offset, storedSize(entry));
+
+	if (result && (access.head - access.base >= ACCESS_COMPACT_MIN))
+		compactAccess();
+
+done:
+	unlock();
+
+	return result;
+}
+
+
+bool TileStore::compact(void) {
+	int fd = -1;
+
+	bool result = false;
+
+	uint64_t offset, size;
+
+	Header header;
+
+	std::vector<Entry> list;
+
+	std::string tmpfile = filename_ + ".tmp";
+
+	log_call();
+
+	if (!lock())
+		return false;
+
+	if (!sync())
+		goto done;
+
+	entries(list);
+
+	if ((fd = ::open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0)
+		goto done;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "G2TS", sizeof(header.magic));
+	header.version = G2TS_VERSION;
+	header.count = list.size();
+
+	// Stored records (with their accesses), then the index
+	offset = sizeof(header);
+
+	for (Entry &entry : list) {
+		size = storedSize(entry);
+
+		if (pwrite(fd, data_ + entry.offset, size, offset) != (ssize_t) size)
+			goto done;
+
+		entry.offset = offset;
+		offset += size;
+
+		header.bytes += size;
+	}
+
+	header.index = offset;
+
+	size = list.size() * sizeof(Entry);
+
+	if ((pwrite(fd, list.data(), size, offset) != (ssize_t) size)
+		|| (pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+		|| (fdatasync(fd) != 0))
+		goto done;
+
+	// Other processes reopen the store at their next lock
+	if (::rename(tmpfile.c_str(), filename_.c_str()) != 0)
+		goto done;
+
+	log_info("Tile store '%s' compacted: %lu tiles", filename_.c_str(), list.size());
+
+	result = true;
+
+done:
+	if (fd != -1)
+		::close(fd);
+
+	if (!result)
+		::unlink(tmpfile.c_str());
+
+	unlock();
+
+	// Switch to the new file
+	if (result && lock()) {
+		result = sync();
+		unlock();
+	}
+
+	if (!result)
+		log_error("Compact '%s' tile store failure", filename_.c_str());
+
+	return result;
+}
+
+
+bool TileStore::importDir(const std::string &dir, size_t &count) {
+	int n;
+	int zoom, x, y;
+
+	bool result = true;
+
+	struct stat st;
+
+	DIR *zdir, *tdir;
+	struct dirent *zentry, *tentry;
+
+	Entry entry;
+
+	log_call();
+
+	count = 0;
+
+	if ((zdir = ::opendir(dir.c_str())) == NULL)
+		return false;
+
+	while (result && ((zentry = ::readdir(zdir)) != NULL)) {
+		std::string path = dir + "/" + zentry->d_name;
+
+		n = 0;
+
+		if ((sscanf(zentry->d_name, "%d%n", &zoom, &n) != 1) || (zentry->d_name[n] != '\0'))
+			continue;
+
+		if ((tdir = ::opendir(path.c_str())) == NULL)
+			continue;
+
+		while (result && ((tentry = ::readdir(tdir)) != NULL)) {
+			std::string etag;
+			std::string filename = path + "/" + tentry->d_name;
+
+			n = 0;
+
+			if ((sscanf(tentry->d_name, "tile_%d_%d.png%n", &y, &x, &n) != 2) || (n == 0) || (tentry->d_name[n] != '\0'))
+				continue;
+
+			if ((::stat(filename.c_str(), &st) != 0) || (st.st_size == 0))
+				continue;
+
+			// Already stored, as recent
+			if (find(zoom, x, y, entry) && (entry.fetched_at >= st.st_mtime))
+				continue;
+
+			std::ifstream stream(filename, std::ios::binary);
+			std::string tile((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+			std::ifstream etagstream(filename + ".etag");
+
+			if (etagstream.is_open())
+				std::getline(etagstream, etag);
+
+			if (!put(zoom, x, y, tile.data(), tile.length(), etag, st.st_mtime)) {
+				result = false;
+				break;
+			}
+
+			count++;
+		}
+
+		::closedir(tdir);
+	}
+
+	::closedir(zdir);
+
+	return result && flush(true);
+}
+
+
+bool TileStore::exportDir(const std::string &dir, size_t &count) {
+	int zoom, x, y;
+
+	bool result;
+
+	FILE *fp;
+
+	const uint8_t *tile;
+
+	struct utimbuf times;
+
+	std::vector<Entry> list;
+
+	log_call();
+
+	count = 0;
+
+	if (!lock())
+		return false;
+
+	if ((result = sync()))
+		entries(list);
+
+	unlock();
+
+	for (const Entry &entry : list) {
+		if (!result)
+			break;
+
+		zoom = (int) (entry.key >> 58);
+		x = (int) ((entry.key >> 29) & KEY_MASK);
+		y = (int) (entry.key & KEY_MASK);
+
+		std::string path = dir + "/" + std::to_string(zoom);
+		std::string filename = path + "/tile_" + std::to_string(y) + "_" + std::to_string(x) + ".png";
+
+		if ((tile = data(entry)) == NULL) {
+			result = false;
+			break;
+		}
+
+		::mkpath(path, 0700);
+
+		if ((fp = ::fopen(filename.c_str(), "wb")) == NULL) {
+			log_error("Open '%s' failure", filename.c_str());
+			result = false;
+			break;
+		}
+
+		result = (fwrite(tile, 1, entry.length, fp) == entry.length);
+		result = (::fclose(fp) == 0) && result;
+
+		if (!result) {
+			log_error("Write '%s' failure", filename.c_str());
+			break;
+		}
+
+		// ETag & fetch time, for the revalidation
+		if (entry.etag == 0)
+			::unlink((filename + ".etag").c_str());
+		else {
+			std::ofstream stream(filename + ".etag", std::ios::trunc);
+
+			stream << etag(entry) << std::endl;
+		}
+
+		times.actime = entry.fetched_at;
+		times.modtime = entry.fetched_at;
+
+		::utime(filename.c_str(), &times);
+
+		count++;
+	}
+
+	return result;
+}
@@ -0,0 +1,212 @@
+#ifndef __GPX2VIDEO__TILESTORE_H__
+#define __GPX2VIDEO__TILESTORE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cachesettings.h"
+
+
+// Map tiles store: a single '.g2ts' file by map source, instead of a file
+// by tile. Each tile is appended as a record (key, fetch time, ETag & tile
+// data) in a single write, under an exclusive lock. Records are hashed, a
+// torn append (crash) is dropped by the next writer.
+//
+// The index (entries sorted by key) is written at the end of the file by
+// flush() & read in place (mmap). Records appended after the last index
+// (journal) are read when the store is opened.
+//
+// Tile accesses are queued in a '.g2ts.access' file, oldest first, the
+// tile record holds its last access (queue sequence) & its hits count. So
+// the least recently used tile is found from the queue head, skipping the
+// entries of the tiles accessed since, then evicted (hole punched).
+class TileStore {
+public:
+	class Entry {
+	public:
+		uint64_t key;
+		uint64_t offset;
+		uint32_t length;
+		uint16_t etag;
+		uint16_t flags;
+		int64_t fetched_at;
+	};
+
+	class Stats {
+	public:
+		size_t tiles;
+		uint64_t bytes;
+		uint64_t disk;
+		uint64_t hits;
+		uint64_t misses;
+	};
+
+	virtual ~TileStore();
+
+	// Store of a map source in the cache directory
+	static std::string path(const std::string &cachedir, int source);
+
+	static TileStore * open(const std::string &filename);
+
+	const std::string& filename(void) const {
+		return filename_;
+	}
+
+	// Tiles in the store & their size
+	size_t count(void) const {
+		return count_;
+	}
+
+	uint64_t bytes(void) const {
+		return bytes_;
+	}
+
+	static uint64_t key(int zoom, int x, int y);
+
+	// Tile size in the store
+	static uint64_t storedSize(const Entry &entry);
+
+	// Tile lookup, false if not in the store
+	bool find(int zoom, int x, int y, Entry &entry);
+
+	// Tile data & ETag, data is valid till the next store call
+	const uint8_t * data(const Entry &entry);
+	std::string etag(const Entry &entry);
+
+	bool put(int zoom, int x, int y, const void *data, size_t length, const std::string &etag, time_t fetched_at);
+
+	// Tile revalidated, only its fetch time is updated
+	bool touch(int zoom, int x, int y, time_t fetched_at);
+
+	// Write the index, if the journal is large enough (or force)
+	bool flush(bool force=false);
+
+	// Tile requested by the map, hit if stored & recent
+	bool access(int zoom, int x, int y, bool hit);
+
+	bool stats(Stats &stats);
+
+	// Next tile to evict & its last access time, false if none
+	bool victim(CacheSettings::Policy policy, Entry &entry, time_t &accessed_at);
+	bool evict(const Entry &entry);
+
+	// Rewrite the store without the replaced & evicted tiles
+	bool compact(void);
+
+	// Directory layout: <dir>/<zoom>/tile_<y>_<x>.png, with its '.etag'
+	// file & its mtime as fetch time
+	bool importDir(const std::string &dir, size_t &count);
+	bool exportDir(const std::string &dir, size_t &count);
+
+private:
+	enum Flags {
+		FlagTouch = 0x01,
+		FlagDelete = 0x02,
+	};
+
+	class Header {
+	public:
+		char magic[4];
+		uint32_t version;
+
+		uint64_t index;
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	class Record {
+	public:
+		char magic[4];
+		uint32_t length;
+
+		uint64_t key;
+		int64_t fetched_at;
+
+		uint16_t etag;
+		uint16_t flags;
+
+		// Updated in place, not hashed
+		uint32_t hits;
+		uint64_t access;
+
+		uint64_t hash;
+	};
+
+	// Access queue file
+	class Access {
+	public:
+		char magic[4];
+		uint32_t version;
+
+		// Sequence of the first entry in the file & of the queue head
+		uint64_t base;
+		uint64_t head;
+
+		uint64_t hits;
+		uint64_t misses;
+	};
+
+	class AccessEntry {
+	public:
+		uint64_t key;
+		int64_t time;
+	};
+
+	TileStore(const std::string &filename, int fd);
+
+	static uint64_t hash(const Record &record, const void *etag, const void *data);
+
+	bool init(void);
+
+	bool lock(void);
+	void unlock(void);
+
+	// Store file replaced (compacted)
+	bool reopen(void);
+
+	bool map(size_t size);
+
+	// Reload the index & the journal (header changed), read the new records
+	bool load(void);
+	bool scan(void);
+	bool sync(void);
+
+	bool append(const Record &record, const void *etag, const void *data);
+
+	const Entry * lookup(uint64_t key);
+
+	int openAccess(Access &access);
+	bool closeAccess(int fd, const Access &access);
+	bool enqueue(int fd, const Access &access, uint64_t key, time_t time, uint64_t &sequence);
+	bool compactAccess(void);
+
+	// Tile record accesses
+	bool readHits(const Entry &entry, uint32_t &hits, uint64_t &access);
+	bool writeHits(const Entry &entry, uint32_t hits, uint64_t access);
+
+	// Index & journal merged, sorted by key
+	void entries(std::vector<Entry> &entries);
+
+	std::string filename_;
+
+	int fd_;
+
+	const uint8_t *data_;
+	size_t size_;
+
+	Header header_;
+
+	// End of the valid records
+	uint64_t end_;
+
+	size_t count_;
+	uint64_t bytes_;
+
+	std::map<uint64_t, Entry> journal_;
+};
+
+#endif
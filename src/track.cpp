@@ -4,6 +4,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -21,6 +24,8 @@
 #include "oiioutils.h"
 #include "videoparams.h"
 #include "telemetrymedia.h"
+#include "assetcache.h"
+#include "blend.h"
 #include "track.h"
 
 
@@ -127,6 +132,8 @@ Track::Track(GPXApplication &app, const TrackSettings &settings, struct event_ba
 	trackbuf_ = NULL;
 
 	divider_ = 1.0;
+
+	x_pos_ = y_pos_ = -1;
 }
 
 
@@ -289,30 +296,57 @@ void Track::init(bool zoomfit) {
 }
 
 
-void Track::path(OIIO::ImageBuf &outbuf, TelemetrySource *source, double divider) {
-	int zoom;
+// Add the path segments which cross the (width x height) area at (x, y)
+static void trace(cairo_t *cairo, const std::vector<std::pair<int, int> > &points, int x, int y, int width, int height, double margin) {
+	size_t i;
+
+	int x1, y1, x2, y2;
+
+	bool is_drawn = false;
+
+	for (i=1; i<points.size(); i++) {
+		x1 = points[i - 1].first - x;
+		y1 = points[i - 1].second - y;
+		x2 = points[i].first - x;
+		y2 = points[i].second - y;
+
+		// Segment out of area
+		if ((std::max(x1, x2) < -margin) || (std::min(x1, x2) > width + margin)
+			|| (std::max(y1, y2) < -margin) || (std::min(y1, y2) > height + margin)) {
+			is_drawn = false;
+			continue;
+		}
+
+		if (!is_drawn)
+			cairo_move_to(cairo, x1, y1);
+
+		cairo_line_to(cairo, x2, y2);
+
+		is_drawn = true;
+	}
+}
+
+
+void Track::path(OIIO::ImageBuf &outbuf, int x, int y) {
 	int stride;
+	int width, height;
 	double path_thick;
 	double path_border;
 	unsigned char *data;
 
-	int x = 0, y = 0;
-
-	TelemetryData wpt;
-
-	enum TelemetrySource::Data result;
-
 	log_call();
 
-	zoom = settings().zoom();
 	path_thick = settings().pathThick();
 	path_border = settings().pathBorder();
 
+	width = outbuf.spec().width;
+	height = outbuf.spec().height;
+
 	// Cairo buffer
 	OIIO::ImageBuf buf(outbuf.spec());
 
 	// Create the cairo destination surface
-	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, outbuf.spec().width, outbuf.spec().height);
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
 
 	// Cairo context
 	cairo_t *cairo = cairo_create(surface);
@@ -324,15 +358,7 @@ void Track::path(OIIO::ImageBuf &outbuf, TelemetrySource *source, double divider
 		cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
 		// Draw each WPT
-		for (result = source->retrieveFrom(wpt); result != TelemetrySource::DataEof; result = source->retrieveNext(wpt)) {
-			x = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
-			y = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
-
-			x *= divider;
-			y *= divider;
-
-			cairo_line_to(cairo, x, y);
-		}
+		trace(cairo, points_, x, y, width, height, path_border + path_thick);
 
 		// Cairo draw
 		cairo_stroke(cairo);
@@ -344,19 +370,13 @@ void Track::path(OIIO::ImageBuf &outbuf, TelemetrySource *source, double divider
 	cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
 	// Draw each WPT
-	for (result = source->retrieveFrom(wpt); result != TelemetrySource::DataEof; result = source->retrieveNext(wpt)) {
-		x = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
-		y = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
-
-		x *= divider;
-		y *= divider;
-
-		cairo_line_to(cairo, x, y);
-	}
+	trace(cairo, points_, x, y, width, height, path_border + path_thick);
 
 	// Cairo draw
 	cairo_stroke(cairo);
 
+	cairo_surface_flush(surface);
+
 	data = cairo_image_surface_get_data(surface);
 	stride = cairo_image_surface_get_stride(surface);
 
@@ -376,63 +396,86 @@ void Track::path(OIIO::ImageBuf &outbuf, TelemetrySource *source, double divider
 }
 
 
-bool Track::load(void) {
-	if (trackbuf_)
-		return true;
-
-	int width = settings().width();
-	int height = settings().height();
-
+bool Track::loadPath(void) {
+	int x, y;
 	int zoom = settings().zoom();
 
 	std::string filename = app_.settings().inputfile();
 
 	TelemetryData wpt;
 
-	log_call();
+	enum TelemetrySource::Data result;
 
-	// Compute track size
-	width = (x2_ - x1_) * TILESIZE;
-	height = (y2_ - y1_) * TILESIZE;
+	if (!points_.empty())
+		return true;
 
-	// Create track buffer
-	trackbuf_ = new OIIO::ImageBuf(OIIO::ImageSpec(width * divider_, height * divider_, 4, OIIO::TypeDesc::UINT8)); //, OIIO::InitializePixels::No);
+	log_call();
 
 	TelemetrySource *source = TelemetryMedia::open(filename);
 
-	if (source != NULL) {
-		// Telemetry data limits
-		source->setFrom(app_.settings().from());
-		source->setTo(app_.settings().to());
-		//gpx->setTimeOffset(app_.settings().offset());
+	if (source == NULL) {
+		log_warn("Can't open '%s' telemetry data file", filename.c_str());
+		return false;
+	}
 
-		// Draw path
-		path(*trackbuf_, source, divider_);
+	// Telemetry data limits
+	source->setFrom(app_.settings().from());
+	source->setTo(app_.settings().to());
+	//gpx->setTimeOffset(app_.settings().offset());
 
-		// Compute begin
-		source->retrieveFrom(wpt);
+	// Walk the telemetry data once
+	for (result = source->retrieveFrom(wpt); result != TelemetrySource::DataEof; result = source->retrieveNext(wpt)) {
+		x = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
+		y = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
 
-		x_start_ = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
-		y_start_ = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
+		x *= divider_;
+		y *= divider_;
 
-		x_start_ *= divider_;
-		y_start_ *= divider_;
+		points_.push_back(std::make_pair(x, y));
+	}
 
-		// Compute end
-		source->retrieveLast(wpt);
+	// Compute begin
+	source->retrieveFrom(wpt);
 
-		x_end_ = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
-		y_end_ = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
+	x_start_ = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
+	y_start_ = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
 
-		x_end_ *= divider_;
-		y_end_ *= divider_;
-	}
-	else {
-		log_warn("Can't open '%s' telemetry data file", filename.c_str());
-	}
+	x_start_ *= divider_;
+	y_start_ *= divider_;
+
+	// Compute end
+	source->retrieveLast(wpt);
+
+	x_end_ = floorf((float) Track::lon2pixel(zoom, wpt.longitude())) - (x1_ * TILESIZE);
+	y_end_ = floorf((float) Track::lat2pixel(zoom, wpt.latitude())) - (y1_ * TILESIZE);
+
+	x_end_ *= divider_;
+	y_end_ *= divider_;
+
+	delete source;
+
+	return true;
+}
+
+
+bool Track::load(void) {
+	if (trackbuf_)
+		return true;
+
+	int width, height;
+
+	log_call();
+
+	// Compute track size
+	width = (x2_ - x1_) * TILESIZE;
+	height = (y2_ - y1_) * TILESIZE;
+
+	// Create track buffer
+	trackbuf_ = new OIIO::ImageBuf(OIIO::ImageSpec(width * divider_, height * divider_, 4, OIIO::TypeDesc::UINT8)); //, OIIO::InitializePixels::No);
 
-	if (source != NULL)
-		delete source;
+	// Draw path
+	if (loadPath())
+		path(*trackbuf_);
 
 	return (trackbuf_ != NULL);
 }
@@ -489,6 +532,15 @@ OIIO::ImageBuf * Track::render(const TelemetryData &data, bool &is_update) {
 	posX *= divider_;
 	posY *= divider_;
 
+	// Marker on the same pixel (per frame interpolation)
+	if ((fg_buf_ != NULL) && (posX == x_pos_) && (posY == y_pos_)) {
+		is_update = false;
+		goto skip;
+	}
+
+	x_pos_ = posX;
+	y_pos_ = posY;
+
 	// width x height of track
 	w = (px2_ - px1_) * divider_; // floorf((float) Track::lon2pixel(zoom, lon1)) - (x1_ * TILESIZE);
 	h = (py2_ - py1_) * divider_; // floorf((float) Track::lat2pixel(zoom, lat1)) - (y1_ * TILESIZE);
@@ -511,7 +563,7 @@ OIIO::ImageBuf * Track::render(const TelemetryData &data, bool &is_update) {
 	// Image over
 	trackbuf_->specmod().x = x - offsetX;
 	trackbuf_->specmod().y = y - offsetY;
-	OIIO::ImageBufAlgo::over(*fg_buf_, *trackbuf_, *fg_buf_, OIIO::ROI(x, x + width, y, y + height));
+	Blend::over(*fg_buf_, *trackbuf_, OIIO::ROI(x, x + width, y, y + height));
 
 	// Draw track
 	// ...
@@ -535,29 +587,35 @@ bool Track::drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const ch
 
 	double divider;
 
-	// Open picto
-	auto img = OIIO::ImageInput::open(picto);
-	const OIIO::ImageSpec& spec = img->spec();
-	OIIO::TypeDesc::BASETYPE type = (OIIO::TypeDesc::BASETYPE) spec.format.basetype;
+	// Decoded picto (shared)
+	AssetPtr image = AssetCache::get(picto);
 
-	OIIO::ImageBuf buf = OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type));
-	img->read_image(type, buf.localpixels());
+	if (image == NULL)
+		return false;
+
+	const OIIO::ImageSpec& spec = image->spec();
 
 	// Compute divider
 	divider = (double) size / (double) spec.height;
 
-	// Resize picto
-	OIIO::ImageBuf dst(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type));
-	OIIO::ImageBufAlgo::resize(dst, buf);
+	// Resized picto (shared)
+	AssetPtr marker = AssetCache::get(picto, spec.width * divider, spec.height * divider);
+
+	if (marker == NULL)
+		return false;
 
 	// Marker position
-	x -= dst.spec().width / 2;
-	y -= dst.spec().height - (25 * divider);
+	x -= marker->spec().width / 2;
+	y -= marker->spec().height - (25 * divider);
 
-	// Image over
-	dst.specmod().x = x;
-	dst.specmod().y = y;
-	result = OIIO::ImageBufAlgo::over(map, dst, map, roi);
+	// Image over (wrap the cached pixels at the marker position)
+	OIIO::ImageSpec dstspec = marker->spec();
+	dstspec.x = x;
+	dstspec.y = y;
+
+	OIIO::ImageBuf dst(dstspec, (void *) marker->localpixels());
+
+	result = Blend::over(map, dst, roi);
 
 	if (!result)
 		log_error("ImageBufAlgo::over failure");
@@ -7,6 +7,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <list>
+#include <utility>
+#include <vector>
 
 #include <stdlib.h>
 
@@ -43,8 +45,8 @@ public:
 	static int lat2pixel(int zoom, float lat);
 	static int lon2pixel(int zoom, float lon);
 
-	// Draw track path
-	void path(OIIO::ImageBuf &outbuf, TelemetrySource *source, double divider=1.0);
+	// Draw track path, (x, y) is the outbuf position in the track
+	void path(OIIO::ImageBuf &outbuf, int x=0, int y=0);
 
 	// Render track
 	OIIO::ImageBuf * prepare(bool &is_update);
@@ -59,6 +61,9 @@ protected:
 	void init(bool zoomfit=true);
 	bool load(void);
 
+	// Read path points & start/end positions
+	bool loadPath(void);
+
 	bool drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const char *picto, int size);
 
 	GPXApplication &app_;
@@ -68,6 +73,9 @@ protected:
 
 	OIIO::ImageBuf *trackbuf_;
 
+	// Path points (divider applied)
+	std::vector<std::pair<int, int> > points_;
+
 	double divider_;
 
 	// Bounding box
@@ -77,6 +85,9 @@ protected:
 	// Start & end position
 	int x_end_, y_end_;
 	int x_start_, y_start_;
+
+	// Last drawn position
+	int x_pos_, y_pos_;
 };
 
 #endif
@@ -6,6 +6,8 @@
 #include <OpenImageIO/imagebufalgo.h>
 
 #include "oiioutils.h"
+#include "assetcache.h"
+#include "blend.h"
 #include "ffmpegutils.h"
 #include "videorenderer.h"
 
@@ -13,7 +15,9 @@
 VideoRenderer::VideoRenderer(GPXApplication &app, 
 		RendererSettings &renderer_settings, TelemetrySettings &telemetry_settings)
 	: Renderer(app, renderer_settings, telemetry_settings)
-	, started_at_(0) {
+	, started_at_(0)
+	, nb_threads_(1)
+	, yuv_(false) {
 	decoder_audio_ = NULL;
 	decoder_video_ = NULL;
 	decoder_gpmf_ = NULL;
@@ -204,6 +208,26 @@ bool VideoRenderer::init(MediaContainer *container) {
 		decoder_gpmf_->open(gpmf_stream);
 	}
 
+	// YUV compositing, draw overlay in the decoded planes
+	if (rendererSettings().isVideoYUV()) {
+		if (YUVSprite::isSupported(decoder_video_->pixelFormat())) {
+			decoder_video_->setYUVOutput(true);
+			yuv_ = true;
+		}
+		else {
+			const char *name = av_get_pix_fmt_name(decoder_video_->pixelFormat());
+
+			log_warn("YUV compositing doesn't support '%s' pixel format, fallback to RGBA", 
+				name ? name : "unknown");
+		}
+	}
+
+	// Rendering threads (decode, composite & encode are pipelined if > 1)
+	nb_threads_ = rendererSettings().videoThreads();
+
+	if (nb_threads_ <= 0)
+		nb_threads_ = MAX(1, (int) std::thread::hardware_concurrency());
+
 	// Open & encode output video
 	encoder_ = Encoder::create(encoderSettings);
 	return encoder_->open();
@@ -309,19 +333,208 @@ bool VideoRenderer::start(void) {
 			continue;
 
 		// Rotate & rescale
-		this->resize(buf, round((double) widget->width() / sar), widget->height());
-		this->rotate(buf, orientation);
+		this->transform(buf, round((double) widget->width() / sar), widget->height(), orientation);
 
 		// Image over
 		buf->specmod().x = widget->x();
 		buf->specmod().y = widget->y();
-		OIIO::ImageBufAlgo::over(*overlay_, *buf, *overlay_, buf->roi());
+		Blend::over(*overlay_, *buf, buf->roi());
+
+		addOverlayROI(buf->roi());
+	}
+
+	// Convert overlay areas once
+	if (yuv_) {
+		for (const OIIO::ROI &roi : overlay_rois_)
+			overlay_sprites_.push_back(createYUVSprite(*overlay_, roi));
+	}
+
+	// Start pipeline
+	if (nb_threads_ > 1) {
+		log_info("Rendering with %d compositing threads", nb_threads_);
+
+		decoded_.reset();
+		decoded_.setCapacity(2);
+		jobs_.reset();
+		jobs_.setCapacity(2 * nb_threads_);
+		composited_.reset();
+		composited_.setCapacity(2 * nb_threads_);
+
+		decode_thread_ = std::thread(&VideoRenderer::decodeLoop, this);
+		encode_thread_ = std::thread(&VideoRenderer::encodeLoop, this);
+
+		for (int i=0; i<nb_threads_; i++)
+			workers_.push_back(std::thread(&VideoRenderer::compositeLoop, this));
 	}
 
 	return true;
 }
 
 
+YUVSpritePtr VideoRenderer::createYUVSprite(const OIIO::ImageBuf &buf, const OIIO::ROI &roi) {
+	return YUVSprite::create(buf, roi, 
+		decoder_video_->pixelFormat(), decoder_video_->colorSpace(), decoder_video_->colorRange(),
+		container_->getVideoStream()->height());
+}
+
+
+void VideoRenderer::addSprite(Job *job, OIIO::ImageBuf *buf, bool is_update) {
+	used_sprites_.insert(buf);
+
+	// YUV compositing, sprite is converted only if it changes
+	if (yuv_) {
+		YUVSpritePtr &yuv_sprite = yuv_sprites_[buf];
+
+		if (is_update || (yuv_sprite == NULL))
+			yuv_sprite = createYUVSprite(*buf, buf->roi());
+
+		job->yuv_sprites.push_back(yuv_sprite);
+
+		return;
+	}
+
+	// Serial pipeline, the job is composited before the widget changes
+	if (nb_threads_ <= 1) {
+		job->sprites.push_back(std::shared_ptr<OIIO::ImageBuf>(buf, [](OIIO::ImageBuf *) {}));
+		return;
+	}
+
+	// Widget buffers are reused frame after frame, so jobs still in
+	// flight hold a snapshot taken the last time the widget changed
+	std::shared_ptr<OIIO::ImageBuf> &sprite = sprites_[buf];
+
+	if (is_update || (sprite == NULL))
+		sprite = std::make_shared<OIIO::ImageBuf>(*buf);
+
+	job->sprites.push_back(sprite);
+}
+
+
+void VideoRenderer::pruneSprites(void) {
+	// Widgets may switch between several buffers (cached values), forget
+	// the ones not drawn in this frame, they might have been freed
+	for (auto it = sprites_.begin(); it != sprites_.end(); ) {
+		if (used_sprites_.count(it->first) == 0)
+			it = sprites_.erase(it);
+		else
+			++it;
+	}
+
+	for (auto it = yuv_sprites_.begin(); it != yuv_sprites_.end(); ) {
+		if (used_sprites_.count(it->first) == 0)
+			it = yuv_sprites_.erase(it);
+		else
+			++it;
+	}
+
+	used_sprites_.clear();
+}
+
+
+void VideoRenderer::composite(Job *job) {
+	if ((job->frame == NULL) || !job->overlay)
+		return;
+
+	// YUV compositing, only widget areas of the planes are modified
+	if (job->frame->avFrame() != NULL) {
+		for (YUVSpritePtr &sprite : overlay_sprites_)
+			sprite->blend(job->frame->avFrame());
+
+		for (YUVSpritePtr &sprite : job->yuv_sprites)
+			sprite->blend(job->frame->avFrame());
+
+		return;
+	}
+
+	// Frame buffer wraps the frame data, no copy
+	OIIO::ImageBuf frame_buffer = job->frame->toImageBuf();
+
+	// Draw overlay
+	drawOverlay(frame_buffer);
+
+	// Draw each widget, map...
+	for (std::shared_ptr<OIIO::ImageBuf> &sprite : job->sprites)
+		Blend::over(frame_buffer, *sprite, sprite->roi());
+
+	job->frame->fromImageBuf(frame_buffer);
+}
+
+
+void VideoRenderer::write(Job *job) {
+	for (FramePtr &frame : job->audio)
+		encoder_->writeAudio(frame, job->audio_time);
+
+	if (job->frame != NULL)
+		encoder_->writeFrame(job->frame, job->video_time);
+}
+
+
+void VideoRenderer::decodeLoop(void) {
+	FramePtr frame;
+
+	int64_t n = 0;
+
+	AVRational video_time;
+
+	while (true) {
+		video_time = av_div_q(av_make_q(1000 * n, 1), encoder_->settings().videoParams().frameRate());
+
+		frame = decoder_video_->retrieveVideo(video_time);
+
+		if (frame == NULL)
+			break;
+
+		if (decoded_.push(frame) == false)
+			break;
+
+		n++;
+	}
+
+	decoded_.close();
+}
+
+
+void VideoRenderer::compositeLoop(void) {
+	Job *job;
+
+	while (jobs_.pop(job)) {
+		composite(job);
+
+		if (composited_.push(job) == false)
+			delete job;
+	}
+}
+
+
+void VideoRenderer::encodeLoop(void) {
+	Job *job;
+
+	int64_t next = 0;
+
+	std::map<int64_t, Job *> pending;
+
+	// Workers complete out of order, write back in sequence order
+	while (composited_.pop(job)) {
+		pending[job->seq] = job;
+
+		while (!pending.empty() && (pending.begin()->first == next)) {
+			job = pending.begin()->second;
+			pending.erase(pending.begin());
+
+			write(job);
+			delete job;
+
+			next++;
+		}
+	}
+
+	for (auto &it : pending) {
+		log_warn("Frame %ld dropped", it.first);
+		delete it.second;
+	}
+}
+
+
 bool VideoRenderer::run(void) {
 	FramePtr frame;
 
@@ -342,6 +555,8 @@ bool VideoRenderer::run(void) {
 
 	bool is_update = false;
 
+	Job *job = NULL;
+
 	VideoStreamPtr video_stream = container_->getVideoStream();
 //	AudioStreamPtr audio_stream = container_->getAudioStream();
 
@@ -355,6 +570,11 @@ bool VideoRenderer::run(void) {
 	sar = av_q2d(encoder_->settings().videoParams().pixelAspectRatio());
 	orientation = encoder_->settings().videoParams().orientation();
 
+	job = new Job();
+	job->seq = frame_time_;
+	job->overlay = false;
+	job->audio_time = video_time;
+
 	// Read GPMF data
 	if (decoder_gpmf_) {
 		decoder_gpmf_->retrieveData(gpmf_data_, video_time);
@@ -372,12 +592,17 @@ bool VideoRenderer::run(void) {
 			frame = decoder_audio_->retrieveAudio(encoder_->settings().audioParams(), video_time, duration);
 
 			if (frame != NULL)
-				encoder_->writeAudio(frame, video_time);
+				job->audio.push_back(frame);
 		} while (frame != NULL);
 	}
 
 	// Read video data
-	frame = decoder_video_->retrieveVideo(video_time);
+	if (nb_threads_ > 1) {
+		if (decoded_.pop(frame) == false)
+			frame = NULL;
+	}
+	else
+		frame = decoder_video_->retrieveVideo(video_time);
 
 	if (frame == NULL)
 		goto done;
@@ -389,16 +614,13 @@ bool VideoRenderer::run(void) {
 	app_.setTime(start_time + real_duration_ms_ / 1000);
 
 	if (source_) {
-		OIIO::ImageBuf frame_buffer = frame->toImageBuf();
+		job->overlay = true;
 
 		// Read GPX data
 //		source_->retrieveNext(data_, (start_time * 1000) + (time_factor * timecode_ms));
-		source_->retrieveNext(data_, (start_time * 1000) + real_duration_ms_);
+		source_->retrieveFrame(data_, (start_time * 1000) + real_duration_ms_);
 
-		// Draw overlay
-		OIIO::ImageBufAlgo::over(frame_buffer, *overlay_, frame_buffer, OIIO::ROI());
-
-		// Draw each widget, map...
+		// Render each widget, map... (compositing is done by composite())
 		for (VideoWidget *widget : widgets_) {
 			OIIO::ImageBuf *buf = NULL;
 
@@ -416,15 +638,13 @@ bool VideoRenderer::run(void) {
 
 				if (buf != NULL) {
 					// Rotate & resize
-					if (is_update) {
-						this->resize(buf, round((double) widget->width() / sar), widget->height());
-						this->rotate(buf, orientation);
-					}
+					if (is_update)
+						this->transform(buf, round((double) widget->width() / sar), widget->height(), orientation);
 
 					// Image over
 					buf->specmod().x = widget->x();
 					buf->specmod().y = widget->y();
-					OIIO::ImageBufAlgo::over(frame_buffer, *buf, frame_buffer, buf->roi());
+					addSprite(job, buf, is_update);
 				}
 			}
 
@@ -435,18 +655,16 @@ bool VideoRenderer::run(void) {
 				continue;
 
 			// Rotate & resize
-			if (is_update) {
-				this->resize(buf, round((double) widget->width() / sar), widget->height());
-				this->rotate(buf, orientation);
-			}
+			if (is_update)
+				this->transform(buf, round((double) widget->width() / sar), widget->height(), orientation);
 
 			// Image over
 			buf->specmod().x = widget->x();
 			buf->specmod().y = widget->y();
-			OIIO::ImageBufAlgo::over(frame_buffer, *buf, frame_buffer, buf->roi());
+			addSprite(job, buf, is_update);
 		}
 
-		frame->fromImageBuf(frame_buffer);
+		pruneSprites();
 	}
 
 	// Max rendering duration
@@ -497,9 +715,19 @@ bool VideoRenderer::run(void) {
 	if (source_ && app_.progressInfo())
 		data_.dump();
 
-	video_time = av_mul_q(av_make_q(timecode, 1), video_stream->timeBase());
+	job->frame = frame;
+	job->video_time = av_mul_q(av_make_q(timecode, 1), video_stream->timeBase());
 
-	encoder_->writeFrame(frame, video_time);
+	// Composite & encode
+	if (nb_threads_ > 1) {
+		if (jobs_.push(job) == false)
+			delete job;
+	}
+	else {
+		composite(job);
+		write(job);
+		delete job;
+	}
 
 	frame_time_++;
 
@@ -509,6 +737,18 @@ bool VideoRenderer::run(void) {
 	return true;
 
 done:
+	// Last audio samples have been read, write them without any video frame
+	job->frame = NULL;
+
+	if (nb_threads_ > 1) {
+		if (jobs_.push(job) == false)
+			delete job;
+	}
+	else {
+		write(job);
+		delete job;
+	}
+
 	complete();
 
 	return true;
@@ -518,7 +758,29 @@ done:
 bool VideoRenderer::stop(void) {
 	int working;
 
-	time_t now = ::time(NULL);
+	time_t now;
+
+	// Flush pipeline
+	if (nb_threads_ > 1) {
+		decoded_.close();
+		if (decode_thread_.joinable())
+			decode_thread_.join();
+
+		jobs_.close();
+		for (std::thread &worker : workers_)
+			worker.join();
+		workers_.clear();
+
+		composited_.close();
+		if (encode_thread_.joinable())
+			encode_thread_.join();
+	}
+
+	sprites_.clear();
+	yuv_sprites_.clear();
+	overlay_sprites_.clear();
+
+	now = ::time(NULL);
 
 	if (!app_.progressInfo())
 		printf("\n");
@@ -538,6 +800,8 @@ bool VideoRenderer::stop(void) {
 	else
 		printf("None frame proceed\n");
 
+	log_info("Asset cache: %lu hits, %lu misses", AssetCache::hits(), AssetCache::misses());
+
 	encoder_->close();
 	if (decoder_audio_)
 		decoder_audio_->close();
@@ -546,6 +810,8 @@ bool VideoRenderer::stop(void) {
 	if (overlay_)
 		delete overlay_;
 
+	overlay_rois_.clear();
+
 	decoder_audio_ = NULL;
 	decoder_video_ = NULL;
 	overlay_ = NULL;
@@ -1,8 +1,15 @@
 #ifndef __GPX2VIDEO__VIDEORENDERER_H__
 #define __GPX2VIDEO__VIDEORENDERER_H__
 
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
 #include "gpmf.h"
 #include "renderer.h"
+#include "workqueue.h"
+#include "yuvsprite.h"
 
 
 class VideoRenderer : public Renderer {
@@ -18,6 +25,23 @@ public:
 	bool stop(void);
 
 protected:
+	// Everything a compositing worker and the encoder need for one frame
+	class Job {
+	public:
+		int64_t seq;
+
+		FramePtr frame;
+		AVRational video_time;
+
+		bool overlay;
+
+		std::vector<FramePtr> audio;
+		AVRational audio_time;
+
+		std::vector<std::shared_ptr<OIIO::ImageBuf> > sprites;
+		std::vector<YUVSpritePtr> yuv_sprites;
+	};
+
 	Decoder *decoder_audio_;
 	Decoder *decoder_video_;
 	GPMFDecoder *decoder_gpmf_;
@@ -33,11 +57,44 @@ protected:
 
 	GPMFData gpmf_data_;
 
+	// Pipeline: decode thread -> compositing workers -> encode thread
+	int nb_threads_;
+
+	WorkQueue<FramePtr> decoded_;
+	WorkQueue<Job *> jobs_;
+	WorkQueue<Job *> composited_;
+
+	std::thread decode_thread_;
+	std::thread encode_thread_;
+	std::vector<std::thread> workers_;
+
+	// Last snapshot of each widget buffer, shared with the in-flight jobs
+	std::map<OIIO::ImageBuf *, std::shared_ptr<OIIO::ImageBuf> > sprites_;
+
+	// YUV compositing: overlay & widgets converted to the decoded format
+	bool yuv_;
+
+	std::vector<YUVSpritePtr> overlay_sprites_;
+	std::map<OIIO::ImageBuf *, YUVSpritePtr> yuv_sprites_;
+
+	// Widget buffers drawn in the current frame
+	std::set<OIIO::ImageBuf *> used_sprites_;
+
 	VideoRenderer(GPXApplication &app, 
 			RendererSettings &rendererSettings, TelemetrySettings &telemetrySettings); //, Map *map);
 
 	bool init(MediaContainer *container);
 	void computeWidgetsPosition(void);
+
+	YUVSpritePtr createYUVSprite(const OIIO::ImageBuf &buf, const OIIO::ROI &roi);
+	void addSprite(Job *job, OIIO::ImageBuf *buf, bool is_update);
+	void pruneSprites(void);
+	void composite(Job *job);
+	void write(Job *job);
+
+	void decodeLoop(void);
+	void compositeLoop(void);
+	void encodeLoop(void);
 };
 
 #endif
@@ -6,6 +6,9 @@
 #include <OpenImageIO/imagebufalgo.h>
 
 #include "oiio.h"
+#include "assetcache.h"
+#include "blend.h"
+#include "glyphatlas.h"
 #include "oiioutils.h"
 #include "videowidget.h"
 
@@ -278,8 +281,6 @@ void VideoWidget::drawBackground(OIIO::ImageBuf *buf) {
 
 
 void VideoWidget::drawImage(OIIO::ImageBuf *buf, int x, int y, const char *name, VideoWidget::Zoom zoom) {
-	bool ok;
-
 	double ratio;
 
 	int width, height;
@@ -288,17 +289,13 @@ void VideoWidget::drawImage(OIIO::ImageBuf *buf, int x, int y, const char *name,
 	if ((name == NULL) || (name[0] == '\0'))
 		return;
 
-	// Open image
-	auto img = OIIO::ImageInput::open(name);
-	const OIIO::ImageSpec& spec = img->spec();
-	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
-	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+	// Decoded picto (shared)
+	AssetPtr picto = AssetCache::get(name);
 
-	OIIO::ImageBuf *inbuf = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	ok = img->read_image(type, inbuf->localpixels());
+	if (picto == NULL)
+		return;
 
-	if (!ok)
-		log_warn("Read '%s' image (%dx%d) failure!", name, spec.width, spec.height);
+	const OIIO::ImageSpec& spec = picto->spec();
 
 	// Input image ratio
 	ratio = (double) spec.width / (double) spec.height;
@@ -341,25 +338,20 @@ void VideoWidget::drawImage(OIIO::ImageBuf *buf, int x, int y, const char *name,
 	max_width = this->width() - (2 * this->border());
 	max_height = this->height() - (2 * this->border());
 
-	// Resize picto
-	OIIO::ImageBuf outbuf(OIIO::ImageSpec(width, height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	OIIO::ImageBufAlgo::resize(outbuf, *inbuf);
+	// Resized picto (shared)
+	AssetPtr image = AssetCache::get(name, width, height);
 
-	// Add alpha channel
-	if (spec.nchannels != 4) {
-		int channelorder[] = { 0, 1, 2, -1 /*use a float value*/ };
-		float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
-		std::string channelnames[] = { "", "", "", "A" };
+	if (image == NULL)
+		return;
 
-		outbuf = OIIO::ImageBufAlgo::channels(outbuf, 4, channelorder, channelvalues, channelnames);
-	}
+	// Image over (wrap the cached pixels at the picto position)
+	OIIO::ImageSpec outspec = image->spec();
+	outspec.x = x;
+	outspec.y = y;
 
-	// Image over
-	outbuf.specmod().x = x;
-	outbuf.specmod().y = y;
-	OIIO::ImageBufAlgo::over(*buf, outbuf, *buf, OIIO::ROI(x, x + max_width, y, y + max_height));
+	OIIO::ImageBuf outbuf(outspec, (void *) image->localpixels());
 
-	delete inbuf;
+	Blend::over(*buf, outbuf, OIIO::ROI(x, x + max_width, y, y + max_height));
 }
 
 
@@ -395,14 +387,7 @@ void VideoWidget::drawText(OIIO::ImageBuf *buf, int x, int y, int px, const char
 
 	y += border + padding_yt;
 
-	result = OIIO::ImageBufAlgo::render_text_shadow(*buf, 
-		x, 
-		y, 
-		label, 
-		px, this->font(), color, 
-		OIIO::ImageBufAlgo::TextAlignX::Left, 
-		OIIO::ImageBufAlgo::TextAlignY::Baseline, 
-		this->textShadow());
+	result = this->drawString(buf, x, y, px, label, color);
 
 	if (result == false)
 		fprintf(stderr, "render text error\n");
@@ -463,14 +448,7 @@ void VideoWidget::drawLabel(OIIO::ImageBuf *buf, const char *label) {
 
 	y += border + padding_yt;
 
-	result = OIIO::ImageBufAlgo::render_text_shadow(*buf, 
-		x, 
-		y, 
-		label, 
-		label_px_, this->font(), color, 
-		OIIO::ImageBufAlgo::TextAlignX::Left, 
-		OIIO::ImageBufAlgo::TextAlignY::Baseline,
-		this->textShadow());
+	result = this->drawString(buf, x, y, label_px_, label, color);
 
 	if (result == false)
 		fprintf(stderr, "render label text error\n");
@@ -535,17 +513,60 @@ void VideoWidget::drawValue(OIIO::ImageBuf *buf, const char *value) {
 	else
 		y += border + padding_yt;
 
-	result = OIIO::ImageBufAlgo::render_text_shadow(*buf, 
+	result = this->drawString(buf, x, y, value_px_, value, color);
+
+	if (result == false)
+		fprintf(stderr, "render value text error\n");
+}
+
+
+OIIO::ImageBuf * VideoWidget::renderValue(const std::string &value, bool &is_update) {
+	OIIO::ImageBuf *buf = NULL;
+
+	auto it = values_index_.find(value);
+
+	// Value already rasterized (and already transformed by the renderer)
+	if (it != values_index_.end()) {
+		values_.splice(values_.begin(), values_, it->second);
+
+		is_update = false;
+
+		return values_.front().second;
+	}
+
+	this->createBox(&buf, this->width(), this->height());
+	this->drawValue(buf, value.c_str());
+
+	values_.push_front(std::make_pair(value, buf));
+	values_index_[value] = values_.begin();
+
+	// Drop the least recently used value
+	if (values_.size() > values_size_) {
+		values_index_.erase(values_.back().first);
+		delete values_.back().second;
+		values_.pop_back();
+	}
+
+	is_update = true;
+
+	return buf;
+}
+
+
+bool VideoWidget::drawString(OIIO::ImageBuf *buf, int x, int y, int px, const char *text, float color[4]) {
+	GlyphAtlasPtr atlas = GlyphAtlas::get(this->font(), px, this->textShadow());
+
+	if ((atlas != NULL) && atlas->draw(*buf, x, y, text, color))
+		return true;
+
+	return OIIO::ImageBufAlgo::render_text_shadow(*buf, 
 		x, 
 		y, 
-		value, 
-		value_px_, this->font(), color, 
+		text, 
+		px, this->font(), color, 
 		OIIO::ImageBufAlgo::TextAlignX::Left, 
 		OIIO::ImageBufAlgo::TextAlignY::Baseline, 
 		this->textShadow());
-
-	if (result == false)
-		fprintf(stderr, "render value text error\n");
 }
 
 
@@ -553,7 +574,14 @@ void VideoWidget::textSize(std::string text, int fontsize,
 	int &x1, int &y1, int &x2, int &y2,
 	int &width, int &height) {
 
-	OIIO::ROI roi = OIIO::ImageBufAlgo::text_size(text, fontsize, this->font());
+	OIIO::ROI roi;
+
+	GlyphAtlasPtr atlas = GlyphAtlas::get(this->font(), fontsize, this->textShadow());
+
+	if (atlas != NULL)
+		roi = atlas->textSize(text);
+	else
+		roi = OIIO::ImageBufAlgo::text_size(text, fontsize, this->font());
 
 	x1 = roi.xbegin;
 	x2 = roi.xend;
@@ -7,6 +7,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <list>
+#include <map>
+#include <utility>
 
 #include <OpenImageIO/imagebuf.h>
 
@@ -93,6 +95,9 @@ public:
 
 	virtual ~VideoWidget() {
 		log_call();
+
+		for (auto &entry : values_)
+			delete entry.second;
 	}
 
 	uint64_t& atBeginTime(void) {
@@ -423,6 +428,7 @@ protected:
    		, value_size_(0)
 		, value_offset_(0)
 		, txtratio_(0.0)
+		, values_size_(32)
 		, name_(name) {
 		log_call();
 
@@ -456,6 +462,9 @@ protected:
 	void drawText(OIIO::ImageBuf *buf, int x, int y, int pt, const char *label);
 	void drawLabel(OIIO::ImageBuf *buf, const char *label);
 	void drawValue(OIIO::ImageBuf *buf, const char *value);
+	bool drawString(OIIO::ImageBuf *buf, int x, int y, int px, const char *text, float color[4]);
+
+	OIIO::ImageBuf * renderValue(const std::string &value, bool &is_update);
 
 	void textSize(std::string text, int fontsize, 
 		int &x1, int &y1, int &x2, int &y2,
@@ -513,6 +522,11 @@ protected:
 	int flags_;
 
 private:
+	// Rasterized values, most recently used first
+	std::list<std::pair<std::string, OIIO::ImageBuf *> > values_;
+	std::map<std::string, std::list<std::pair<std::string, OIIO::ImageBuf *> >::iterator> values_index_;
+	size_t values_size_;
+
 	std::string name_;
 };
 
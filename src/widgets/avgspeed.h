@@ -12,9 +12,6 @@ public:
 
 		if (bg_buf_)
 			delete bg_buf_;
-
-		if (fg_buf_)
-			delete fg_buf_;
 	}
 
 	static AvgSpeedWidget * create(GPXApplication &app) {
@@ -71,14 +68,8 @@ skip:
 		else
 			sprintf(s, "-- %s", unit2string(unit()).c_str());
 
-		// Refresh dynamic info
-		if (fg_buf_ != NULL)
-			delete fg_buf_;
-
-		this->createBox(&fg_buf_, this->width(), this->height());
-		this->drawValue(fg_buf_, s);
-
-		is_update = true;
+		// Refresh dynamic info (already rasterized values are reused)
+		fg_buf_ = this->renderValue(s, is_update);
 skip:
 		return fg_buf_;
 	}
@@ -12,9 +12,6 @@ public:
 
 		if (bg_buf_)
 			delete bg_buf_;
-
-		if (fg_buf_)
-			delete fg_buf_;
 	}
 
 	static DateWidget * create(GPXApplication &app) {
@@ -70,14 +67,8 @@ skip:
 
 		strftime(s, sizeof(s), format().c_str(), &time);
 
-		// Refresh dynamic info
-		if (fg_buf_ != NULL)
-			delete fg_buf_;
-
-		this->createBox(&fg_buf_, this->width(), this->height());
-		this->drawValue(fg_buf_, s);
-
-		is_update = true;
+		// Refresh dynamic info (already rasterized values are reused)
+		fg_buf_ = this->renderValue(s, is_update);
 skip:
 		return fg_buf_;
 	}
@@ -0,0 +1,99 @@
+#ifndef __GPX2VIDEO__WORKQUEUE_H__
+#define __GPX2VIDEO__WORKQUEUE_H__
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+
+// Bounded blocking FIFO between pipeline stages. push() waits while the
+// queue is full (back-pressure), pop() waits while it's empty. Once closed,
+// push() fails and pop() only drains the remaining items.
+template <typename T>
+class WorkQueue {
+public:
+	WorkQueue(size_t capacity=1)
+		: capacity_((capacity > 0) ? capacity : 1)
+		, closed_(false) {
+	}
+
+	virtual ~WorkQueue() {
+	}
+
+	bool push(const T &item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		not_full_.wait(lock, [this] { return closed_ || (queue_.size() < capacity_); });
+
+		if (closed_)
+			return false;
+
+		queue_.push_back(item);
+
+		not_empty_.notify_one();
+
+		return true;
+	}
+
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+
+		if (queue_.empty())
+			return false;
+
+		item = queue_.front();
+		queue_.pop_front();
+
+		not_full_.notify_one();
+
+		return true;
+	}
+
+	void close(void) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		closed_ = true;
+
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+
+	void setCapacity(size_t capacity) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		capacity_ = (capacity > 0) ? capacity : 1;
+	}
+
+	void reset(void) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		queue_.clear();
+		closed_ = false;
+	}
+
+	bool isClosed(void) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		return closed_;
+	}
+
+	size_t size(void) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		return queue_.size();
+	}
+
+private:
+	size_t capacity_;
+	bool closed_;
+
+	std::deque<T> queue_;
+
+	std::mutex mutex_;
+	std::condition_variable not_full_;
+	std::condition_variable not_empty_;
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include <cmath>
+
+#include "log.h"
+#include "macros.h"
+#include "yuvsprite.h"
+
+
+#define YUVSPRITE_ALPHA_ONE (1 << 15)
+
+
+static int floor_div(int a, int b) {
+	return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+
+YUVSprite::YUVSprite()
+	: desc_(NULL)
+	, depth_(8) {
+}
+
+
+YUVSprite::~YUVSprite() {
+}
+
+
+bool YUVSprite::isSupported(AVPixelFormat pix_fmt) {
+	int i;
+
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+
+	if (desc == NULL)
+		return false;
+
+	if (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL
+			| AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_ALPHA))
+		return false;
+
+	// Y, U & V components, same depth, without any bit shift
+	if (desc->nb_components != 3)
+		return false;
+
+	for (i=0; i<desc->nb_components; i++) {
+		const AVComponentDescriptor &comp = desc->comp[i];
+
+		if ((comp.depth != desc->comp[0].depth) || (comp.shift != 0))
+			return false;
+
+		if ((comp.depth > 8) && ((comp.depth > 16) || (comp.step % 2)))
+			return false;
+	}
+
+	return true;
+}
+
+
+YUVSpritePtr YUVSprite::create(const OIIO::ImageBuf &buf, const OIIO::ROI &roi,
+	AVPixelFormat pix_fmt, AVColorSpace color_space, AVColorRange color_range, int height) {
+	int i, j, k;
+	int x, y;
+
+	double kr, kb, kg;
+	double y_offset, y_scale;
+	double c_offset, c_scale;
+
+	bool full_range;
+
+	int nb_channels = buf.nchannels();
+	int width = roi.width();
+	int sw, sh;
+
+	std::vector<float> pixels;
+	std::vector<double> u, v, a;
+
+	YUVSpritePtr sprite;
+
+	if (!isSupported(pix_fmt))
+		return NULL;
+
+	sprite = std::make_shared<YUVSprite>();
+	sprite->desc_ = av_pix_fmt_desc_get(pix_fmt);
+	sprite->depth_ = sprite->desc_->comp[0].depth;
+
+	// Color matrix (unspecified: BT.709 for HD, else BT.601)
+	switch (color_space) {
+	case AVCOL_SPC_BT709:
+		kr = 0.2126;
+		kb = 0.0722;
+		break;
+
+	case AVCOL_SPC_BT470BG:
+	case AVCOL_SPC_SMPTE170M:
+		kr = 0.299;
+		kb = 0.114;
+		break;
+
+	case AVCOL_SPC_BT2020_NCL:
+	case AVCOL_SPC_BT2020_CL:
+		kr = 0.2627;
+		kb = 0.0593;
+		break;
+
+	default:
+		if (height >= 720) {
+			kr = 0.2126;
+			kb = 0.0722;
+		}
+		else {
+			kr = 0.299;
+			kb = 0.114;
+		}
+		break;
+	}
+
+	kg = 1.0 - kr - kb;
+
+	// Range
+	full_range = (color_range == AVCOL_RANGE_JPEG)
+		|| (pix_fmt == AV_PIX_FMT_YUVJ420P) || (pix_fmt == AV_PIX_FMT_YUVJ422P)
+		|| (pix_fmt == AV_PIX_FMT_YUVJ444P) || (pix_fmt == AV_PIX_FMT_YUVJ440P)
+		|| (pix_fmt == AV_PIX_FMT_YUVJ411P);
+
+	c_offset = (double) (1 << (sprite->depth_ - 1));
+
+	if (full_range) {
+		y_offset = 0.0;
+		y_scale = (double) ((1 << sprite->depth_) - 1);
+		c_scale = y_scale;
+	}
+	else {
+		y_offset = 16.0 * (1 << (sprite->depth_ - 8));
+		y_scale = 219.0 * (1 << (sprite->depth_ - 8));
+		c_scale = 224.0 * (1 << (sprite->depth_ - 8));
+	}
+
+	// Read RGBA (premultiplied) pixels
+	OIIO::ROI src = roi;
+	src.chbegin = 0;
+	src.chend = nb_channels;
+
+	pixels.resize(roi.npixels() * nb_channels);
+	buf.get_pixels(src, OIIO::TypeDesc::FLOAT, &pixels[0]);
+
+	// Luma plane
+	Plane &luma = sprite->luma_;
+
+	luma.x = roi.xbegin;
+	luma.y = roi.ybegin;
+	luma.width = width;
+	luma.height = roi.height();
+	luma.alpha.resize(luma.width * luma.height);
+	luma.values[0].resize(luma.width * luma.height);
+
+	u.resize(luma.width * luma.height);
+	v.resize(luma.width * luma.height);
+	a.resize(luma.width * luma.height);
+
+	for (k=0; k<luma.width*luma.height; k++) {
+		const float *p = &pixels[k * nb_channels];
+
+		double r = p[0];
+		double g = (nb_channels > 1) ? p[1] : r;
+		double b = (nb_channels > 2) ? p[2] : r;
+		double alpha = (nb_channels > 3) ? p[3] : 1.0;
+
+		double l = kr * r + kg * g + kb * b;
+
+		alpha = MIN(MAX(alpha, 0.0), 1.0);
+
+		a[k] = alpha;
+		u[k] = alpha * c_offset + c_scale * (b - l) / (2.0 * (1.0 - kb));
+		v[k] = alpha * c_offset + c_scale * (r - l) / (2.0 * (1.0 - kr));
+
+		luma.alpha[k] = (uint16_t) lround(alpha * YUVSPRITE_ALPHA_ONE);
+		luma.values[0][k] = (uint16_t) lround(MAX(alpha * y_offset + y_scale * l, 0.0));
+	}
+
+	// Chroma plane, aligned on the frame chroma grid
+	Plane &chroma = sprite->chroma_;
+
+	sw = 1 << sprite->desc_->log2_chroma_w;
+	sh = 1 << sprite->desc_->log2_chroma_h;
+
+	chroma.x = floor_div(luma.x, sw);
+	chroma.y = floor_div(luma.y, sh);
+	chroma.width = floor_div(luma.x + luma.width + sw - 1, sw) - chroma.x;
+	chroma.height = floor_div(luma.y + luma.height + sh - 1, sh) - chroma.y;
+	chroma.alpha.resize(chroma.width * chroma.height);
+	chroma.values[0].resize(chroma.width * chroma.height);
+	chroma.values[1].resize(chroma.width * chroma.height);
+
+	for (j=0; j<chroma.height; j++) {
+		for (i=0; i<chroma.width; i++) {
+			double su = 0.0, sv = 0.0, sa = 0.0;
+
+			// Average the block (pixels out of the sprite are transparent)
+			for (y=(chroma.y + j) * sh; y<(chroma.y + j + 1) * sh; y++) {
+				if ((y < luma.y) || (y >= luma.y + luma.height))
+					continue;
+
+				for (x=(chroma.x + i) * sw; x<(chroma.x + i + 1) * sw; x++) {
+					if ((x < luma.x) || (x >= luma.x + luma.width))
+						continue;
+
+					k = (y - luma.y) * luma.width + (x - luma.x);
+
+					su += u[k];
+					sv += v[k];
+					sa += a[k];
+				}
+			}
+
+			k = j * chroma.width + i;
+
+			chroma.alpha[k] = (uint16_t) lround(sa * YUVSPRITE_ALPHA_ONE / (sw * sh));
+			chroma.values[0][k] = (uint16_t) lround(MAX(su / (sw * sh), 0.0));
+			chroma.values[1][k] = (uint16_t) lround(MAX(sv / (sw * sh), 0.0));
+		}
+	}
+
+	return sprite;
+}
+
+
+template <typename T>
+void YUVSprite::blendComponent(AVFrame *frame, const AVComponentDescriptor &comp,
+	const Plane &plane, const std::vector<uint16_t> &values, int width, int height) const {
+	int i, j, k;
+	int x, y;
+
+	uint32_t maxval = (1 << depth_) - 1;
+
+	for (j=0; j<plane.height; j++) {
+		y = plane.y + j;
+
+		if ((y < 0) || (y >= height))
+			continue;
+
+		uint8_t *line = frame->data[comp.plane] + y * frame->linesize[comp.plane] + comp.offset;
+
+		for (i=0; i<plane.width; i++) {
+			x = plane.x + i;
+
+			if ((x < 0) || (x >= width))
+				continue;
+
+			k = j * plane.width + i;
+
+			uint32_t alpha = plane.alpha[k];
+
+			if (alpha == 0)
+				continue;
+
+			T *p = (T *) (line + x * comp.step);
+
+			uint32_t value = values[k] + ((*p * (YUVSPRITE_ALPHA_ONE - alpha) + (YUVSPRITE_ALPHA_ONE / 2)) >> 15);
+
+			*p = (T) MIN(value, maxval);
+		}
+	}
+}
+
+
+void YUVSprite::blend(AVFrame *frame) const {
+	int chroma_width = AV_CEIL_RSHIFT(frame->width, desc_->log2_chroma_w);
+	int chroma_height = AV_CEIL_RSHIFT(frame->height, desc_->log2_chroma_h);
+
+	if (depth_ > 8) {
+		blendComponent<uint16_t>(frame, desc_->comp[0], luma_, luma_.values[0], frame->width, frame->height);
+		blendComponent<uint16_t>(frame, desc_->comp[1], chroma_, chroma_.values[0], chroma_width, chroma_height);
+		blendComponent<uint16_t>(frame, desc_->comp[2], chroma_, chroma_.values[1], chroma_width, chroma_height);
+	}
+	else {
+		blendComponent<uint8_t>(frame, desc_->comp[0], luma_, luma_.values[0], frame->width, frame->height);
+		blendComponent<uint8_t>(frame, desc_->comp[1], chroma_, chroma_.values[0], chroma_width, chroma_height);
+		blendComponent<uint8_t>(frame, desc_->comp[2], chroma_, chroma_.values[1], chroma_width, chroma_height);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef __GPX2VIDEO__YUVSPRITE_H__
+#define __GPX2VIDEO__YUVSPRITE_H__
+
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+
+
+class YUVSprite;
+
+using YUVSpritePtr = std::shared_ptr<YUVSprite>;
+
+
+// RGBA sprite converted once to the YUV layout of the decoded frames, so it
+// can be blended straight into the AVFrame planes. Luma & chroma values are
+// premultiplied by alpha, alpha is stored in 1.15 fixed point.
+class YUVSprite {
+public:
+	YUVSprite();
+	virtual ~YUVSprite();
+
+	static bool isSupported(AVPixelFormat pix_fmt);
+
+	static YUVSpritePtr create(const OIIO::ImageBuf &buf, const OIIO::ROI &roi,
+		AVPixelFormat pix_fmt, AVColorSpace color_space, AVColorRange color_range, int height);
+
+	void blend(AVFrame *frame) const;
+
+private:
+	class Plane {
+	public:
+		int x;
+		int y;
+		int width;
+		int height;
+
+		std::vector<uint16_t> alpha;
+		std::vector<uint16_t> values[2];
+	};
+
+	template <typename T>
+	void blendComponent(AVFrame *frame, const AVComponentDescriptor &comp,
+		const Plane &plane, const std::vector<uint16_t> &values, int width, int height) const;
+
+	const AVPixFmtDescriptor *desc_;
+
+	int depth_;
+
+	Plane luma_;
+	Plane chroma_;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <chrono>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+
+#include "src/blend.h"
+
+
+// Compare Blend::over kernels with ImageBufAlgo::over on a full frame
+// overlay: bench-blend [iterations]
+
+
+static void fill(OIIO::ImageBuf &buf, bool overlay) {
+	int x, y, c;
+
+	const OIIO::ImageSpec &spec = buf.spec();
+
+	float pixel[4];
+
+	srand(42);
+
+	for (y=0; y<spec.height; y++) {
+		for (x=0; x<spec.width; x++) {
+			float a = 1.0;
+
+			// Overlay: 50% transparent, 25% opaque, 25% translucent
+			if (overlay) {
+				int r = rand() % 4;
+
+				a = (r < 2) ? 0.0 : ((r == 2) ? 1.0 : (float) rand() / RAND_MAX);
+			}
+
+			for (c=0; c<3; c++)
+				pixel[c] = a * (float) rand() / RAND_MAX;
+			pixel[3] = a;
+
+			buf.setpixel(x, y, pixel);
+		}
+	}
+}
+
+
+static double bench_oiio(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, int count, int nthreads) {
+	int i;
+
+	auto begin = std::chrono::steady_clock::now();
+
+	for (i=0; i<count; i++)
+		OIIO::ImageBufAlgo::over(dst, src, dst, OIIO::ROI(), nthreads);
+
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - begin).count() / count;
+}
+
+
+static double bench_blend(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, int count) {
+	int i;
+
+	auto begin = std::chrono::steady_clock::now();
+
+	for (i=0; i<count; i++)
+		Blend::over(dst, src);
+
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - begin).count() / count;
+}
+
+
+int main(int argc, char *argv[]) {
+	int i, k;
+
+	int count = (argc > 1) ? atoi(argv[1]) : 20;
+
+	struct {
+		const char *name;
+		int width;
+		int height;
+	} sizes[] = {
+		{ "1080p", 1920, 1080 },
+		{ "4K", 3840, 2160 },
+	};
+
+	OIIO::TypeDesc::BASETYPE types[] = {
+		OIIO::TypeDesc::UINT8,
+		OIIO::TypeDesc::UINT16,
+	};
+
+	Blend::Kernel best = Blend::kernel();
+
+	for (i=0; i<2; i++) {
+		for (k=0; k<2; k++) {
+			OIIO::ImageSpec spec(sizes[i].width, sizes[i].height, 4, types[k]);
+
+			OIIO::ImageBuf frame(spec);
+			OIIO::ImageBuf overlay(spec);
+
+			fill(frame, false);
+			fill(overlay, true);
+
+			printf("%s %s:\n", sizes[i].name, (types[k] == OIIO::TypeDesc::UINT8) ? "uint8" : "uint16");
+
+			printf("  %-24s %8.2f ms\n", "ImageBufAlgo::over (1)", bench_oiio(frame, overlay, count, 1));
+			printf("  %-24s %8.2f ms\n", "ImageBufAlgo::over (mt)", bench_oiio(frame, overlay, count, 0));
+
+			for (int kernel=Blend::KernelScalar; kernel<Blend::KernelCount; kernel++) {
+				char label[64];
+
+				if (!Blend::setKernel((Blend::Kernel) kernel))
+					continue;
+
+				snprintf(label, sizeof(label), "Blend::over (%s)", Blend::kernelName((Blend::Kernel) kernel));
+
+				printf("  %-24s %8.2f ms\n", label, bench_blend(frame, overlay, count));
+			}
+
+			Blend::setKernel(best);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/telemetry/csv.h"
+
+
+// CSV telemetry reading throughput, getline + stringstream split (previous
+// reader) vs memory mapped CSV reader:
+// bench-csv [file.csv] [rows]
+// Without file, a 10 Hz sensor CSV of 'rows' lines is generated.
+
+
+static void generate(const char *filename, int count) {
+	int i;
+
+	FILE *fp = fopen(filename, "w");
+
+	if (fp == NULL)
+		return;
+
+	fprintf(fp, "Timestamp,Data,Lat,Lon,Ele,Grade,Distance,Speed,Cadence,Heartrate,Temperature\n");
+
+	for (i=0; i<count; i++) {
+		fprintf(fp, "%d,M,%.7f,%.7f,%.2f,%.1f,%.1f,%.2f,%d,%d,%d\n",
+			1595919600 + i / 10,
+			45.0 + (i % 1000) * 1e-5, 5.0 + (i % 2000) * 1e-5, 200.0 + (i % 500) * 0.1,
+			(i % 20) * 0.5, i * 0.8, 25.0 + (i % 30) * 0.1,
+			80 + (i % 20), 120 + (i % 40), 20 + (i % 5));
+	}
+
+	fclose(fp);
+}
+
+
+int main(int argc, char *argv[]) {
+	size_t bytes;
+
+	int rows = 0;
+	int count = (argc > 2) ? atoi(argv[2]) : 1000000;
+
+	std::string filename = (argc > 1) ? argv[1] : "/tmp/bench-csv.csv";
+
+	if (argc < 2)
+		generate(filename.c_str(), count);
+
+	std::ifstream stream(filename);
+
+	if (!stream.is_open()) {
+		fprintf(stderr, "Can't open '%s'\n", filename.c_str());
+		return 1;
+	}
+
+	stream.seekg(0, stream.end);
+	bytes = stream.tellg();
+	stream.seekg(0, stream.beg);
+
+	// getline + stringstream split
+	auto begin = std::chrono::steady_clock::now();
+
+	std::string line;
+
+	while (std::getline(stream, line)) {
+		std::string column;
+		std::vector<std::string> columns;
+
+		std::stringstream ss(line);
+
+		while (std::getline(ss, column, ','))
+			columns.emplace_back(std::move(column));
+
+		for (size_t i=1; i<columns.size(); i++)
+			strtod(columns[i].c_str(), NULL);
+
+		rows++;
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	printf("%-24s %8d rows %10.1f ms %8.1f MB/s\n", "getline/stringstream", rows, ms, bytes / (ms * 1e3));
+
+	// CSV reader (points are built, as for a telemetry source)
+	begin = std::chrono::steady_clock::now();
+
+	CSV csv(filename);
+
+	csv.reset();
+
+	for (rows=0; ; rows++) {
+		TelemetrySource::Point point;
+
+		if (csv.read(point) == TelemetrySource::DataEof)
+			break;
+	}
+
+	end = std::chrono::steady_clock::now();
+
+	ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	printf("%-24s %8d rows %10.1f ms %8.1f MB/s\n", "CSV", rows, ms, bytes / (ms * 1e3));
+
+	return 0;
+}
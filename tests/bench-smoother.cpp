@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+
+#include "src/kalman.h"
+#include "src/telemetrymedia.h"
+#include "src/telemetrysmoother.h"
+
+
+// Kalman throughput, live velocity2d filter (one update per point, as the
+// previous replay) vs batch RTS smoother over the whole timeline:
+// bench-smoother [points]
+// A 1 Hz track with a few meters of noise is generated.
+
+
+static TelemetryTimelinePtr generate(int count) {
+	int i;
+
+	double lat, lon;
+
+	TelemetryTimelinePtr timeline = std::make_shared<TelemetryTimeline>();
+
+	srand(42);
+
+	for (i=0; i<count; i++) {
+		TelemetrySource::Point point;
+
+		// ~5 m/s on a large circle + ~3 m of noise
+		lat = 45.0 + 0.1 * sin(i * 1e-5) + (rand() / (double) RAND_MAX - 0.5) * 5e-5;
+		lon = 5.0 + 0.1 * cos(i * 1e-5) + (rand() / (double) RAND_MAX - 0.5) * 5e-5;
+
+		point.setType(TelemetryData::TypeMeasured);
+		point.setPosition((1595919600ULL + i) * 1000, lat, lon);
+
+		timeline->append(point);
+	}
+
+	return timeline;
+}
+
+
+int main(int argc, char *argv[]) {
+	size_t i;
+
+	double lat, lon;
+	double ms;
+
+	int count = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+	TelemetryTimelinePtr timeline = generate(count);
+
+	// Live filter
+	auto begin = std::chrono::steady_clock::now();
+
+	KalmanFilter kalman = alloc_filter_velocity2d(10.0);
+
+	for (i=0; i<timeline->size(); i++) {
+		::update_velocity2d(kalman, timeline->latitudes()[i], timeline->longitudes()[i], 1.0);
+		::get_lat_long(kalman, &lat, &lon);
+	}
+
+	free_filter(kalman);
+
+	auto end = std::chrono::steady_clock::now();
+
+	ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	printf("%-24s %8lu points %10.1f ms %12.0f points/s\n", "velocity2d", timeline->size(), ms, timeline->size() / (ms / 1e3));
+
+	// Batch smoother (segments distances included)
+	begin = std::chrono::steady_clock::now();
+
+	TelemetrySmoother::smooth(*timeline);
+
+	end = std::chrono::steady_clock::now();
+
+	ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	printf("%-24s %8lu points %10.1f ms %12.0f points/s\n", "RTS smoother", timeline->size(), ms, timeline->size() / (ms / 1e3));
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+
+#include "src/oiio.h"
+#include "src/glyphatlas.h"
+
+
+// Per string cost of widget text rendering, OIIO (text_size +
+// render_text_shadow) vs glyph atlas:
+// bench-text [font] [px] [shadow] [iterations]
+
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	const char *font = (argc > 1) ? argv[1] : "./assets/fonts/Helvetica.ttf";
+	int px = (argc > 2) ? atoi(argv[2]) : 48;
+	int shadow = (argc > 3) ? atoi(argv[3]) : 2;
+	int count = (argc > 4) ? atoi(argv[4]) : 500;
+
+	float color[4] = { 1.0, 1.0, 1.0, 1.0 };
+
+	OIIO::ImageBuf buf(OIIO::ImageSpec(400, 100, 4, OIIO::TypeDesc::UINT8));
+
+	// Sample of the values drawn by widgets
+	const char *values[] = {
+		"23 km/h",
+		"1:02:47",
+		"87 tr/min",
+		"142 bpm",
+		"12.34 km",
+	};
+
+	const int nvalues = sizeof(values) / sizeof(values[0]);
+
+	// OIIO
+	auto begin = std::chrono::steady_clock::now();
+
+	for (i=0; i<count; i++) {
+		const char *value = values[i % nvalues];
+
+		OIIO::ROI roi = OIIO::ImageBufAlgo::text_size(value, px, font);
+
+		OIIO::ImageBufAlgo::zero(buf);
+		OIIO::ImageBufAlgo::render_text_shadow(buf, 10 - roi.xbegin, 10 - roi.ybegin, value, px, font, color,
+			OIIO::ImageBufAlgo::TextAlignX::Left, OIIO::ImageBufAlgo::TextAlignY::Baseline, shadow);
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	printf("%-24s %8.3f ms / string\n", "render_text_shadow", std::chrono::duration<double, std::milli>(end - begin).count() / count);
+
+	// Glyph atlas (first call loads the face)
+	begin = std::chrono::steady_clock::now();
+
+	GlyphAtlasPtr atlas = GlyphAtlas::get(font, px, shadow);
+
+	if (atlas == NULL) {
+		fprintf(stderr, "Can't load '%s' font\n", font);
+		return 1;
+	}
+
+	for (i=0; i<count; i++) {
+		const char *value = values[i % nvalues];
+
+		OIIO::ROI roi = atlas->textSize(value);
+
+		OIIO::ImageBufAlgo::zero(buf);
+		atlas->draw(buf, 10 - roi.xbegin, 10 - roi.ybegin, value, color);
+	}
+
+	end = std::chrono::steady_clock::now();
+
+	printf("%-24s %8.3f ms / string\n", "GlyphAtlas", std::chrono::duration<double, std::milli>(end - begin).count() / count);
+
+	return 0;
+}
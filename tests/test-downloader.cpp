@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "src/downloader.h"
+
+
+// Download scheduler tests, against a local stand-in tile server:
+// test-downloader
+// Server paths:
+//   /tile/N  : 200 with an ETag, 304 if revalidated with the same ETag
+//   /flaky/N : 503 twice, then 200
+//   /down/N  : always 503
+//   /none/N  : 404
+
+
+class TileServer {
+public:
+	TileServer()
+		: connections_(0)
+		, in_flight_(0)
+		, max_in_flight_(0)
+		, not_modified_(0)
+		, fd_(-1)
+		, port_(0) {
+	}
+
+	~TileServer() {
+		if (fd_ != -1) {
+			::shutdown(fd_, SHUT_RDWR);
+			::close(fd_);
+		}
+
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	bool start(void) {
+		int on = 1;
+
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+
+		fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+
+		setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+
+		if ((::bind(fd_, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (::listen(fd_, 64) != 0))
+			return false;
+
+		getsockname(fd_, (struct sockaddr *) &addr, &len);
+		port_ = ntohs(addr.sin_port);
+
+		thread_ = std::thread(&TileServer::accept, this);
+
+		return true;
+	}
+
+	std::string url(const std::string &path) const {
+		return "http://127.0.0.1:" + std::to_string(port_) + path;
+	}
+
+	int requests(const std::string &path) {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		return requests_[path];
+	}
+
+	std::atomic<int> connections_;
+	std::atomic<int> in_flight_;
+	std::atomic<int> max_in_flight_;
+	std::atomic<int> not_modified_;
+
+private:
+	void accept(void) {
+		int fd;
+
+		while ((fd = ::accept(fd_, NULL, NULL)) >= 0) {
+			connections_++;
+
+			std::thread(&TileServer::serve, this, fd).detach();
+		}
+	}
+
+	void serve(int fd) {
+		ssize_t n;
+		size_t end;
+
+		char buf[4096];
+
+		std::string data;
+
+		for (;;) {
+			// Wait for a full request (no body)
+			while ((end = data.find("\r\n\r\n")) == std::string::npos) {
+				if ((n = ::read(fd, buf, sizeof(buf))) <= 0) {
+					::close(fd);
+					return;
+				}
+
+				data.append(buf, n);
+			}
+
+			std::string request = data.substr(0, end);
+			data.erase(0, end + 4);
+
+			std::string response = reply(request);
+
+			if (::write(fd, response.c_str(), response.length()) < 0) {
+				::close(fd);
+				return;
+			}
+		}
+	}
+
+	std::string reply(const std::string &request) {
+		int count;
+
+		std::string path = request.substr(4, request.find(' ', 4) - 4);
+		std::string etag = "\"v-" + path + "\"";
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			count = ++requests_[path];
+		}
+
+		// Slow server, to see requests in flight
+		in_flight_++;
+		max_in_flight_ = std::max((int) max_in_flight_, (int) in_flight_);
+		usleep(5000);
+		in_flight_--;
+
+		if (path.compare(0, 6, "/none/") == 0)
+			return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+
+		if ((path.compare(0, 6, "/down/") == 0) || ((path.compare(0, 7, "/flaky/") == 0) && (count <= 2)))
+			return "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+
+		if (request.find("If-None-Match: " + etag) != std::string::npos) {
+			not_modified_++;
+			return "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\n\r\n";
+		}
+
+		std::string body = "tile " + path;
+
+		return "HTTP/1.1 200 OK\r\nETag: " + etag + "\r\nContent-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+	}
+
+	int fd_;
+	int port_;
+
+	std::thread thread_;
+
+	std::mutex mutex_;
+	std::map<std::string, int> requests_;
+};
+
+
+static int results[3];
+
+static std::string last_etag;
+
+static int failures = 0;
+
+
+static void complete(Downloader::Result result, const std::string &etag, void *userdata) {
+	(void) userdata;
+
+	results[result]++;
+
+	last_etag = etag;
+}
+
+
+static void check(bool ok, const char *name) {
+	printf("%-48s %s\n", name, ok ? "PASS" : "FAIL");
+
+	if (!ok)
+		failures++;
+}
+
+
+static void run(struct event_base *evbase, Downloader *downloader) {
+	while (downloader->pending() > 0)
+		event_base_loop(evbase, EVLOOP_ONCE);
+}
+
+
+static bool exists(const std::string &filename) {
+	return (access(filename.c_str(), F_OK) == 0);
+}
+
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	std::string dir = "/tmp/test-downloader";
+
+	TileServer server;
+
+	(void) argc;
+	(void) argv;
+
+	if (system(("rm -rf " + dir + " && mkdir -p " + dir).c_str()) != 0)
+		return 1;
+
+	if (!server.start()) {
+		fprintf(stderr, "Can't start tile server\n");
+		return 1;
+	}
+
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	struct event_base *evbase = event_base_new();
+
+	Downloader *downloader = Downloader::create(evbase);
+
+	downloader->setMaxPerHost(2);
+	downloader->setRetries(3, 10);
+
+	// Bounded parallelism & connection reuse
+	for (i=0; i<50; i++)
+		downloader->download(server.url("/tile/" + std::to_string(i)), dir + "/tile_" + std::to_string(i) + ".png", complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultOk] == 50, "50 tiles downloaded");
+	check(server.max_in_flight_ <= 2, "at most 2 requests in flight");
+	check(server.connections_ <= 2, "connections reused");
+	check(exists(dir + "/tile_0.png") && exists(dir + "/tile_0.png.etag"), "tile & ETag saved");
+
+	// Revalidation
+	memset(results, 0, sizeof(results));
+
+	for (i=0; i<10; i++)
+		downloader->download(server.url("/tile/" + std::to_string(i)), dir + "/tile_" + std::to_string(i) + ".png", complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultNotModified] == 10, "10 tiles not modified (304)");
+	check(server.not_modified_ == 10, "revalidated with If-None-Match");
+
+	// Revalidation, validators given (no file)
+	memset(results, 0, sizeof(results));
+
+	downloader->download(server.url("/tile/0"), dir + "/stored.png", "\"v-/tile/0\"", 0, complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultNotModified] == 1, "stored tile not modified (304)");
+	check(last_etag == "\"v-/tile/0\"", "stored tile ETag returned");
+	check(!exists(dir + "/stored.png") && !exists(dir + "/stored.png.etag"), "stored tile no file");
+
+	// Retry with backoff
+	memset(results, 0, sizeof(results));
+
+	downloader->download(server.url("/flaky/1"), dir + "/flaky.png", complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultOk] == 1, "flaky tile downloaded");
+	check(server.requests("/flaky/1") == 3, "flaky tile retried twice");
+
+	// Retries exhausted
+	memset(results, 0, sizeof(results));
+
+	downloader->download(server.url("/down/1"), dir + "/down.png", complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultError] == 1, "down tile failure");
+	check(server.requests("/down/1") == 4, "down tile retried 3 times");
+	check(!exists(dir + "/down.png") && !exists(dir + "/down.png.part"), "no partial file");
+
+	// No retry
+	memset(results, 0, sizeof(results));
+
+	downloader->download(server.url("/none/1"), dir + "/none.png", complete, NULL, NULL);
+
+	run(evbase, downloader);
+
+	check(results[Downloader::ResultError] == 1, "missing tile failure");
+	check(server.requests("/none/1") == 1, "missing tile not retried");
+
+	delete downloader;
+
+	event_base_free(evbase);
+
+	curl_global_cleanup();
+
+	return (failures == 0) ? 0 : 1;
+}
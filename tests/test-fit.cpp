@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+
+#include "src/telemetry/gpx.h"
+#include "src/telemetry/fit.h"
+
+
+// FIT telemetry source tests:
+// test-fit [tools directory, default: tools]
+// tools/data.fit is the tools/data.gpx ride encoded as FIT, with compressed
+// timestamp headers (2 records out of 3) & heartrate / power fields left
+// invalid (not in the GPX). Both files must give the same points.
+
+
+static int failures = 0;
+
+
+static void check(bool ok, const char *name) {
+	printf("%-48s %s\n", name, ok ? "PASS" : "FAIL");
+
+	if (!ok)
+		failures++;
+}
+
+
+static bool same(const TelemetrySource::Point &a, const TelemetrySource::Point &b, TelemetryData::Data type) {
+	return (a.hasValue(type) == b.hasValue(type));
+}
+
+
+int main(int argc, char *argv[]) {
+	int count = 0;
+	int timestamps = 0, positions = 0, elevations = 0;
+	int cadences = 0, temperatures = 0, heartrates = 0, powers = 0;
+
+	bool eof_gpx, eof_fit;
+
+	FILE *fp;
+
+	std::string dir = (argc > 1) ? argv[1] : "tools";
+	std::string truncated = "/tmp/test-fit-truncated.fit";
+
+	TelemetrySource::Point a, b;
+
+	GPX gpx(dir + "/data.gpx");
+	FIT fit(dir + "/data.fit");
+
+	gpx.reset();
+	fit.reset();
+
+	// Same ride, point by point
+	for (;;) {
+		eof_gpx = (gpx.read(a) == TelemetrySource::DataEof);
+		eof_fit = (fit.read(b) == TelemetrySource::DataEof);
+
+		if (eof_gpx || eof_fit)
+			break;
+
+		count++;
+
+		if (a.timestamp() != b.timestamp())
+			timestamps++;
+
+		// FIT positions are semicircles (180 / 2^31 degree)
+		if ((fabs(a.latitude() - b.latitude()) > 1e-7) || (fabs(a.longitude() - b.longitude()) > 1e-7))
+			positions++;
+
+		// FIT elevation resolution is 0.2m
+		if (!same(a, b, TelemetryData::DataElevation) || (fabs(a.elevation() - b.elevation()) > 0.1))
+			elevations++;
+
+		if (!same(a, b, TelemetryData::DataCadence) || (a.cadence() != b.cadence()))
+			cadences++;
+
+		if (!same(a, b, TelemetryData::DataTemperature) || (a.temperature() != b.temperature()))
+			temperatures++;
+
+		if (!same(a, b, TelemetryData::DataHeartrate) || (b.hasValue(TelemetryData::DataHeartrate) && (a.heartrate() != b.heartrate())))
+			heartrates++;
+
+		if (!same(a, b, TelemetryData::DataPower) || (b.hasValue(TelemetryData::DataPower) && (a.power() != b.power())))
+			powers++;
+	}
+
+	check((count == 10498) && eof_gpx && eof_fit, "10498 points decoded");
+	check(timestamps == 0, "timestamps (compressed headers)");
+	check(positions == 0, "positions");
+	check(elevations == 0, "elevations");
+	check(cadences == 0, "cadences");
+	check(temperatures == 0, "temperatures");
+	check(heartrates == 0, "heartrates (invalid, none)");
+	check(powers == 0, "powers (invalid, none)");
+
+	// Reset, decoded again
+	fit.reset();
+
+	check((fit.read(b) == TelemetrySource::DataAgain) && (b.timestamp() == 1662273775000ULL), "first point after reset");
+
+	// Truncated file, the complete records only
+	{
+		std::string data;
+
+		if ((fp = fopen((dir + "/data.fit").c_str(), "rb")) != NULL) {
+			char buf[4096];
+			size_t n;
+
+			while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+				data.append(buf, n);
+
+			fclose(fp);
+		}
+
+		if ((fp = fopen(truncated.c_str(), "wb")) != NULL) {
+			fwrite(data.data(), 1, data.length() / 2, fp);
+			fclose(fp);
+		}
+	}
+
+	{
+		int n = 0;
+
+		FIT part(truncated);
+
+		part.reset();
+
+		while (part.read(b) != TelemetrySource::DataEof)
+			n++;
+
+		check((n > 0) && (n < count), "truncated file, partial decode");
+	}
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "src/tilestore.h"
+
+
+// Tile store tests:
+// test-tilestore
+// Store & lookup, journal & index reload, torn append, concurrent writers
+// (processes), directory layout import / export, accesses & eviction (LRU,
+// LFU) & compaction.
+
+
+static int failures = 0;
+
+
+static void check(bool ok, const char *name) {
+	printf("%-48s %s\n", name, ok ? "PASS" : "FAIL");
+
+	if (!ok)
+		failures++;
+}
+
+
+static std::string tile(int zoom, int x, int y) {
+	return "tile " + std::to_string(zoom) + "/" + std::to_string(x) + "/" + std::to_string(y);
+}
+
+
+static bool has(TileStore *store, int zoom, int x, int y, const std::string &data) {
+	const uint8_t *p;
+
+	TileStore::Entry entry;
+
+	if (!store->find(zoom, x, y, entry))
+		return false;
+
+	if ((p = store->data(entry)) == NULL)
+		return false;
+
+	return (std::string((const char *) p, entry.length) == data);
+}
+
+
+int main(int argc, char *argv[]) {
+	int i, n;
+	int status;
+
+	bool ok;
+
+	size_t count;
+	uint64_t bytes;
+
+	time_t accessed_at;
+
+	struct stat st;
+
+	FILE *fp;
+
+	TileStore *store;
+	TileStore::Entry entry;
+	TileStore::Stats stats;
+
+	std::string dir = "/tmp/test-tilestore";
+	std::string filename = dir + "/1.g2ts";
+
+	(void) argc;
+	(void) argv;
+
+	if (system(("rm -rf " + dir + " && mkdir -p " + dir).c_str()) != 0)
+		return 1;
+
+	// Store & lookup
+	store = TileStore::open(filename);
+
+	for (i=0; i<100; i++)
+		store->put(12, i, 2 * i, tile(12, i, 2 * i).data(), tile(12, i, 2 * i).length(), "\"e" + std::to_string(i) + "\"", 1000 + i);
+
+	check(store->count() == 100, "100 tiles stored");
+	check(has(store, 12, 42, 84, tile(12, 42, 84)), "tile data");
+	check(store->find(12, 42, 84, entry) && (store->etag(entry) == "\"e42\"") && (entry.fetched_at == 1042), "tile ETag & fetch time");
+	check(!store->find(12, 84, 42, entry), "missing tile");
+
+	// Replaced, revalidated
+	store->put(12, 1, 2, "new", 3, "", 2000);
+	store->touch(12, 2, 4, 3000);
+
+	check(has(store, 12, 1, 2, "new") && (store->count() == 100), "tile replaced");
+	check(store->find(12, 2, 4, entry) && (entry.fetched_at == 3000) && has(store, 12, 2, 4, tile(12, 2, 4)), "tile touched");
+	check(!store->touch(13, 0, 0, 3000), "missing tile not touched");
+
+	delete store;
+
+	// Journal read at open
+	store = TileStore::open(filename);
+
+	check((store->count() == 100) && has(store, 12, 1, 2, "new") && has(store, 12, 99, 198, tile(12, 99, 198)), "journal reloaded");
+
+	// Index
+	check(store->flush(true), "index written");
+
+	delete store;
+
+	store = TileStore::open(filename);
+
+	check((store->count() == 100) && has(store, 12, 1, 2, "new") && store->find(12, 2, 4, entry) && (entry.fetched_at == 3000), "index reloaded");
+
+	delete store;
+
+	// Torn append (writer crash)
+	fp = fopen(filename.c_str(), "ab");
+	fwrite("G2TR\xff\xff", 1, 6, fp);
+	fclose(fp);
+
+	store = TileStore::open(filename);
+
+	ok = (store != NULL) && (store->count() == 100);
+	ok = ok && store->put(14, 1, 1, tile(14, 1, 1).data(), tile(14, 1, 1).length(), "", 4000);
+
+	delete store;
+
+	store = TileStore::open(filename);
+
+	check(ok && (store->count() == 101) && has(store, 14, 1, 1, tile(14, 1, 1)), "torn append dropped");
+
+	delete store;
+
+	// Concurrent writers
+	for (n=0; n<4; n++) {
+		if (fork() == 0) {
+			store = TileStore::open(filename);
+
+			for (i=0; i<250; i++)
+				store->put(15, n, i, tile(15, n, i).data(), tile(15, n, i).length(), "", 5000);
+
+			store->flush();
+
+			delete store;
+
+			_exit(0);
+		}
+	}
+
+	while (wait(&status) > 0)
+		;
+
+	store = TileStore::open(filename);
+
+	ok = (store->count() == 1101);
+
+	for (n=0; ok && (n<4); n++) {
+		for (i=0; ok && (i<250); i++)
+			ok = has(store, 15, n, i, tile(15, n, i));
+	}
+
+	check(ok, "4 concurrent writers");
+
+	// Export & import
+	check(store->exportDir(dir + "/export", count) && (count == 1101), "1101 tiles exported");
+
+	delete store;
+
+	store = TileStore::open(dir + "/2.g2ts");
+
+	check(store->importDir(dir + "/export", count) && (count == 1101), "1101 tiles imported");
+	check((store->count() == 1101) && has(store, 12, 1, 2, "new") && has(store, 15, 3, 249, tile(15, 3, 249)), "imported tiles");
+	check(store->find(12, 42, 84, entry) && (store->etag(entry) == "\"e42\"") && (entry.fetched_at == 1042), "imported ETag & fetch time");
+
+	// Up to date, nothing imported
+	check(store->importDir(dir + "/export", count) && (count == 0), "import skips stored tiles");
+
+	delete store;
+
+	// Accesses & LRU eviction
+	store = TileStore::open(dir + "/3.g2ts");
+
+	for (i=0; i<10; i++)
+		store->put(10, i, i, tile(10, i, i).data(), tile(10, i, i).length(), "", 6000 + i);
+
+	store->access(10, 0, 0, true);
+	store->access(10, 1, 1, true);
+	store->access(10, 20, 20, false);
+
+	check(store->stats(stats) && (stats.tiles == 10) && (stats.hits == 2) && (stats.misses == 1), "tile accesses");
+
+	check(store->victim(CacheSettings::PolicyLRU, entry, accessed_at) && (entry.key == TileStore::key(10, 2, 2)) && (accessed_at == 6002), "LRU victim");
+
+	bytes = store->bytes();
+
+	check(store->evict(entry) && (store->count() == 9) && !store->find(10, 2, 2, entry) && (store->bytes() == bytes - TileStore::storedSize(entry)), "LRU victim evicted");
+
+	for (i=3; i<10; i++) {
+		ok = store->victim(CacheSettings::PolicyLRU, entry, accessed_at) && (entry.key == TileStore::key(10, i, i)) && store->evict(entry);
+
+		if (!ok)
+			break;
+	}
+
+	check(ok && store->victim(CacheSettings::PolicyLRU, entry, accessed_at) && (entry.key == TileStore::key(10, 0, 0)), "LRU order, accessed tiles last");
+
+	delete store;
+
+	// Evicted tile, reopen
+	store = TileStore::open(dir + "/3.g2ts");
+
+	check((store->count() == 2) && has(store, 10, 1, 1, tile(10, 1, 1)) && !store->find(10, 5, 5, entry), "evictions reloaded");
+
+	delete store;
+
+	// LFU eviction, frequently used tile kept
+	store = TileStore::open(dir + "/4.g2ts");
+
+	for (i=0; i<3; i++)
+		store->put(10, i, i, tile(10, i, i).data(), tile(10, i, i).length(), "", 7000 + i);
+
+	for (i=0; i<4; i++)
+		store->access(10, 0, 0, true);
+
+	store->access(10, 1, 1, true);
+
+	check(store->victim(CacheSettings::PolicyLFU, entry, accessed_at) && (entry.key == TileStore::key(10, 2, 2)), "LFU victim");
+
+	delete store;
+
+	// Evicted indexed tiles (holes) & compaction
+	store = TileStore::open(dir + "/5.g2ts");
+
+	std::string big(64 * 1024, 'x');
+
+	for (i=0; i<64; i++)
+		store->put(11, i, i, big.data(), big.length(), "", 8000 + i);
+
+	store->flush(true);
+
+	for (i=0; i<48; i++) {
+		if (!store->victim(CacheSettings::PolicyLRU, entry, accessed_at) || !store->evict(entry))
+			break;
+	}
+
+	check((i == 48) && (store->count() == 16) && store->stats(stats) && (stats.bytes == store->bytes()), "48 indexed tiles evicted");
+	check(stats.disk < 24 * big.length(), "evicted tiles disk space freed");
+
+	check(store->compact() && (stat(store->filename().c_str(), &st) == 0) && ((size_t) st.st_size < 17 * big.length()), "store compacted");
+
+	ok = (store->count() == 16) && store->victim(CacheSettings::PolicyLRU, entry, accessed_at) && (entry.key == TileStore::key(11, 48, 48));
+
+	for (i=48; ok && (i<64); i++)
+		ok = has(store, 11, i, i, big);
+
+	delete store;
+
+	store = TileStore::open(dir + "/5.g2ts");
+
+	check(ok && (store->count() == 16) && has(store, 11, 63, 63, big), "compacted tiles & accesses");
+
+	delete store;
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -48,7 +48,10 @@ static const struct option options[] = {
 	{ "map-source",            required_argument, 0, 0 },
 	{ "map-factor",            required_argument, 0, 0 },
 	{ "map-zoom",              required_argument, 0, 0 },
+	{ "map-downloads",         required_argument, 0, 0 },
 	{ "map-list",              no_argument,       0, 0 },
+	{ "cache-size",            required_argument, 0, 0 },
+	{ "cache-policy",          required_argument, 0, 0 },
 	{ "gpx-from",              required_argument, 0, 0 },
 	{ "gpx-to",                required_argument, 0, 0 },
 	{ "extract-format",        required_argument, 0, 'f' },
@@ -56,6 +59,8 @@ static const struct option options[] = {
 	{ "telemetry-method",      required_argument, 0, 0 },
 	{ "telemetry-method-list", no_argument,       0, 0 },
 	{ "telemetry-rate",        required_argument, 0, 0 },
+	{ "telemetry-distance",    required_argument, 0, 0 },
+	{ "telemetry-interpolation", required_argument, 0, 0 },
 	{ "video-codec",           optional_argument, 0, 0 },
 	{ "video-hwdevice",        optional_argument, 0, 0 },
 	{ "video-preset",          required_argument, 0, 0 },
@@ -63,6 +68,8 @@ static const struct option options[] = {
 	{ "video-bitrate",         required_argument, 0, 0 },
 	{ "video-min-bitrate",     required_argument, 0, 0 },
 	{ "video-max-bitrate",     required_argument, 0, 0 },
+	{ "video-threads",         required_argument, 0, 0 },
+	{ "video-yuv",             no_argument,       0, 0 },
 	{ 0,                       0,                 0, 0 }
 };
 
@@ -84,6 +91,8 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t- f, --extract-format=name     : Extract format (dump, gpx)" << std::endl;
 	std::cout << "\t-    --telemetry-method=method : Telemetry interpolate method (none, sample, linear...)" << std::endl;
 	std::cout << "\t-    --telemetry-rate          : Telemetry rate (refresh each second) (default: 1))" << std::endl;
+	std::cout << "\t-    --telemetry-distance=mode : Distance computation (geodesic, fast) (default: geodesic)" << std::endl;
+	std::cout << "\t-    --telemetry-interpolation=mode : Per frame interpolation (none, linear, spline) (default: none)" << std::endl;
 //	std::cout << "\t- r, --rate                    : Frame per second (not implemented" << std::endl;
 	std::cout << "\t-    --offset                  : Add a time offset (in ms) (not required)" << std::endl;
 	std::cout << "\t-    --start-time              : Overwrite or set creation_time field" << std::endl;
@@ -91,7 +100,10 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t-    --map-factor              : Map factor (default: 1.0)" << std::endl;
 	std::cout << "\t-    --map-source              : Map source" << std::endl;
 	std::cout << "\t-    --map-zoom                : Map zoom" << std::endl;
+	std::cout << "\t-    --map-downloads           : Map tiles downloads in flight (default: 2)" << std::endl;
 	std::cout << "\t-    --map-list                : Dump supported map list" << std::endl;
+	std::cout << "\t-    --cache-size              : Map tiles cache size limit (in MB) (default: 0 = none)" << std::endl;
+	std::cout << "\t-    --cache-policy=policy     : Map tiles eviction (lru, lfu) (default: lru)" << std::endl;
 	std::cout << "\t-    --path-thick              : Path thick (default: 3.0)" << std::endl;
 	std::cout << "\t-    --path-border             : Path border (default: 1.4)" << std::endl;
 	std::cout << "\t- v, --verbose                 : Show trace" << std::endl;
@@ -110,11 +122,17 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t-    --video-bitrate           : Video encoder bitrate" << std::endl;
 	std::cout << "\t-    --video-min-bitrate       : Video encoder min bitrate" << std::endl;
 	std::cout << "\t-    --video-max-bitrate       : Video encoder max bitrate" << std::endl;
+	std::cout << "\t-    --video-threads           : Video rendering threads (default: 0 = auto, 1 = serial)" << std::endl;
+	std::cout << "\t-    --video-yuv               : Draw overlay in YUV (no RGBA conversion)" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Command:" << std::endl;
 	std::cout << "\t extract: Extract GPS sensor data from media stream" << std::endl;
 	std::cout << "\t sync   : Synchronize GoPro stream timestamp with embedded GPS" << std::endl;
 	std::cout << "\t clear  : Clear cache" << std::endl;
+	std::cout << "\t import : Import map tiles directories in cache" << std::endl;
+	std::cout << "\t export : Export map tiles from cache to output directory" << std::endl;
+	std::cout << "\t cache stats: Dump map tiles cache size & hit ratio by map source" << std::endl;
+	std::cout << "\t cache prune: Evict map tiles over the cache size limit" << std::endl;
 	std::cout << "\t map    : Build map from gpx data" << std::endl;
 	std::cout << "\t track  : Build map with track from gpx data" << std::endl;
 	std::cout << "\t compute: Compute telemetry data from gpx, csv... data" << std::endl;
@@ -318,6 +336,7 @@ Map * GPX2Video::buildMap(void) {
 	mapSettings.setSource(settings().mapsource());
 	mapSettings.setZoom(settings().mapzoom());
 	mapSettings.setDivider(settings().mapfactor());
+	mapSettings.setMaxDownloads(settings().mapdownloads());
 	mapSettings.setBoundingBox(p1.latitude(), p1.longitude(), p2.latitude(), p2.longitude());
 	mapSettings.setPathThick(settings().paththick());
 	mapSettings.setPathBorder(settings().pathborder());
@@ -328,6 +347,17 @@ Map * GPX2Video::buildMap(void) {
 }
 
 
+Cache * GPX2Video::buildCache(void) {
+	CacheSettings cacheSettings;
+	cacheSettings.setMaxSize(settings().cachesize());
+	cacheSettings.setPolicy(settings().cachepolicy());
+
+	Cache *cache = Cache::create(*this, cacheSettings);
+
+	return cache;
+}
+
+
 Extractor * GPX2Video::buildExtractor(void) {
 	ExtractorSettings extractorSettings;
 	extractorSettings.setFormat(settings().extractFormat());
@@ -355,11 +385,20 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 
 	double map_factor = 1.0;
 
+	int map_downloads = 2;
+
+	uint64_t cache_size = 0;
+	CacheSettings::Policy cache_policy = CacheSettings::PolicyLRU;
+
 	double path_thick = 3.0;
 	double path_border = 1.4;
 
 	int telemetry_rate = 0; // By default, no change
 
+	TelemetrySettings::Distance telemetry_distance = TelemetrySettings::DistanceGeodesic;
+
+	TelemetrySettings::Interpolation telemetry_interpolation = TelemetrySettings::InterpolationNone;
+
 	// Video encoder settings
 	ExportCodec::Codec video_codec = ExportCodec::CodecH264;
 	int32_t video_crf = -2; // Valid value are -1 and positive value
@@ -368,6 +407,8 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 	int64_t video_bit_rate = 2 * 1000 * 1000 * 8;		// 16MB
 	int64_t video_min_bit_rate = 0;						// 0
 	int64_t video_max_bit_rate = 2 * 1000 * 1000 * 16;	// 32MB
+	int video_threads = 0;								// Auto
+	bool video_yuv = false;
 
 	const char *s;
 
@@ -435,6 +476,22 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			else if (s && !strcmp(s, "map-zoom")) {
 				map_zoom = atoi(optarg);
 			}
+			else if (s && !strcmp(s, "map-downloads")) {
+				map_downloads = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "cache-size")) {
+				cache_size = strtoull(optarg, NULL, 10) << 20;
+			}
+			else if (s && !strcmp(s, "cache-policy")) {
+				if (!strcmp(optarg, "lru"))
+					cache_policy = CacheSettings::PolicyLRU;
+				else if (!strcmp(optarg, "lfu"))
+					cache_policy = CacheSettings::PolicyLFU;
+				else {
+					std::cout << name << ": cache policy '" << optarg << "' unknown" << std::endl;
+					return -1;
+				}
+			}
 			else if (s && !strcmp(s, "map-source")) {
 				map_source = (MapSettings::Source) atoi(optarg);
 			}
@@ -467,6 +524,28 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			else if (s && !strcmp(s, "telemetry-rate")) {
 				telemetry_rate = atoi(optarg);
 			}
+			else if (s && !strcmp(s, "telemetry-distance")) {
+				if (!strcmp(optarg, "fast"))
+					telemetry_distance = TelemetrySettings::DistanceFast;
+				else if (!strcmp(optarg, "geodesic"))
+					telemetry_distance = TelemetrySettings::DistanceGeodesic;
+				else {
+					std::cout << "Telemetry distance mode '" << optarg << "' unknown" << std::endl;
+					return -1;
+				}
+			}
+			else if (s && !strcmp(s, "telemetry-interpolation")) {
+				if (!strcmp(optarg, "none"))
+					telemetry_interpolation = TelemetrySettings::InterpolationNone;
+				else if (!strcmp(optarg, "linear"))
+					telemetry_interpolation = TelemetrySettings::InterpolationLinear;
+				else if (!strcmp(optarg, "spline"))
+					telemetry_interpolation = TelemetrySettings::InterpolationSpline;
+				else {
+					std::cout << "Telemetry interpolation mode '" << optarg << "' unknown" << std::endl;
+					return -1;
+				}
+			}
 			else if (s && !strcmp(s, "video-codec")) {
 				if (optarg == NULL) {
 					std::cout << std::endl;
@@ -558,6 +637,12 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			else if (s && !strcmp(s, "video-max-bitrate")) {
 				video_max_bit_rate = atoll(optarg);
 			}
+			else if (s && !strcmp(s, "video-threads")) {
+				video_threads = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "video-yuv")) {
+				video_yuv = true;
+			}
 			else {
 				std::cout << "option " << s;
 				if (optarg)
@@ -639,6 +724,14 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 		else if (!strcmp(argv[0], "clear")) {
 			setCommand(GPX2Video::CommandClear);
 		}
+		else if (!strcmp(argv[0], "import")) {
+			setCommand(GPX2Video::CommandImport);
+		}
+		else if (!strcmp(argv[0], "export")) {
+			setCommand(GPX2Video::CommandExport);
+
+			outputfile_required = true;
+		}
 		else if (!strcmp(argv[0], "map")) {
 			setCommand(GPX2Video::CommandMap);
 
@@ -676,6 +769,18 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			return -1;
 		}
 	}
+	else if ((argc == 2) && !strcmp(argv[0], "cache")) {
+		if (!strcmp(argv[1], "stats")) {
+			setCommand(GPX2Video::CommandStats);
+		}
+		else if (!strcmp(argv[1], "prune")) {
+			setCommand(GPX2Video::CommandPrune);
+		}
+		else {
+			std::cout << name << ": command 'cache " << argv[1] << "' unknown" << std::endl;
+			return -1;
+		}
+	}
 	else {
 		setCommand(GPX2Video::CommandVideo);
 			
@@ -736,6 +841,9 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 		map_zoom,
 		max_duration_ms,
 		map_source,
+		map_downloads,
+		cache_size,
+		cache_policy,
 		path_thick,
 		path_border,
 		gpx_from,
@@ -743,13 +851,17 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 		extract_format,
 		telemetry_method,
 		telemetry_rate,
+		telemetry_distance,
+		telemetry_interpolation,
 		video_codec,
 		video_hw_device,
 		video_preset,
 		video_crf,
 		video_bit_rate,
 		video_min_bit_rate,
-		video_max_bit_rate)
+		video_max_bit_rate,
+		video_threads,
+		video_yuv)
 	);
 
 	return 0;
@@ -833,14 +945,18 @@ int main(int argc, char *argv[], char *envp[]) {
 		break;
 
 	case GPX2Video::CommandClear:
+	case GPX2Video::CommandImport:
+	case GPX2Video::CommandExport:
+	case GPX2Video::CommandStats:
+	case GPX2Video::CommandPrune:
 		// Create cache task
-		cache = Cache::create(app);
+		cache = app.buildCache();
 		app.append(cache);
 		break;
 
 	case GPX2Video::CommandMap:
 		// Create cache directories
-		cache = Cache::create(app);
+		cache = app.buildCache();
 		app.append(cache);
 
 		// Create gpx2video map task
@@ -866,7 +982,7 @@ int main(int argc, char *argv[], char *envp[]) {
 
 	case GPX2Video::CommandTrack:
 		// Create cache directories
-		cache = Cache::create(app);
+		cache = app.buildCache();
 		app.append(cache);
 
 		// Create gpx2video map task
@@ -895,7 +1011,8 @@ int main(int argc, char *argv[], char *envp[]) {
 			TelemetrySettings settings(
 					app.settings().telemetryMethod(),
 					app.settings().telemetryRate(),
-					TelemetrySettings::FormatCSV);
+					TelemetrySettings::FormatCSV,
+					app.settings().telemetryDistance());
 
 			telemetry = Telemetry::create(app, settings);
 			app.append(telemetry);
@@ -913,10 +1030,13 @@ int main(int argc, char *argv[], char *envp[]) {
 			// Telemetry settings
 			TelemetrySettings telemetrySettings(
 					app.settings().telemetryMethod(),
-					app.settings().telemetryRate());
+					app.settings().telemetryRate(),
+					TelemetrySettings::FormatAuto,
+					app.settings().telemetryDistance(),
+					app.settings().telemetryInterpolation());
 
 			// Create cache directories
-			cache = Cache::create(app);
+			cache = app.buildCache();
 			app.append(cache);
 
 			// Create gpx2video timesync task
@@ -950,10 +1070,13 @@ int main(int argc, char *argv[], char *envp[]) {
 			// Telemetry settings
 			TelemetrySettings telemetrySettings(
 					app.settings().telemetryMethod(),
-					app.settings().telemetryRate());
+					app.settings().telemetryRate(),
+					TelemetrySettings::FormatAuto,
+					app.settings().telemetryDistance(),
+					app.settings().telemetryInterpolation());
 
 			// Create cache directories
-			cache = Cache::create(app);
+			cache = app.buildCache();
 			app.append(cache);
 
 			// Create gpx2video timesync task
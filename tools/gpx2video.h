@@ -12,12 +12,14 @@
 #include "media.h"
 #include "exportcodec.h"
 #include "mapsettings.h"
+#include "cachesettings.h"
 #include "extractorsettings.h"
 #include "telemetrysettings.h"
 #include "application.h"
 
 
 class Map;
+class Cache;
 class Extractor;
 
 
@@ -38,6 +40,9 @@ public:
 			int map_zoom=8, 
 			int max_duration_ms=0,
 			MapSettings::Source map_source=MapSettings::SourceOpenStreetMap,
+			int map_downloads=2,
+			uint64_t cache_size=0,
+			CacheSettings::Policy cache_policy=CacheSettings::PolicyLRU,
 			double path_thick=3.0,
 			double path_border=1.4,
 			std::string from="",
@@ -45,13 +50,17 @@ public:
 			ExtractorSettings::Format extract_format=ExtractorSettings::FormatDump,
 			TelemetrySettings::Method telemetry_method=TelemetrySettings::MethodNone,
 			int telemetry_rate=0,
+			TelemetrySettings::Distance telemetry_distance=TelemetrySettings::DistanceGeodesic,
+			TelemetrySettings::Interpolation telemetry_interpolation=TelemetrySettings::InterpolationNone,
 			ExportCodec::Codec video_codec=ExportCodec::CodecH264,
 			std::string video_hw_device="",
 			std::string video_preset="medium",
 			int32_t video_crf=-1,
 			int64_t video_bit_rate=0,
 			int64_t video_min_bit_rate=0,
-			int64_t video_max_bit_rate=0)
+			int64_t video_max_bit_rate=0,
+			int video_threads=0,
+			bool video_yuv=false)
 			: GPXApplication::Settings(
 					gpx_file, output_file,
 					from, to, 
@@ -59,7 +68,10 @@ public:
 					max_duration_ms)
 			, TelemetrySettings(
 					telemetry_method, 
-					telemetry_rate)
+					telemetry_rate,
+					TelemetrySettings::FormatAuto,
+					telemetry_distance,
+					telemetry_interpolation)
 			, RendererSettings(
 					media_file, layout_file,
 					time_factor_auto,
@@ -70,12 +82,17 @@ public:
 					video_crf,
 					video_bit_rate,
 					video_min_bit_rate,
-					video_max_bit_rate)
+					video_max_bit_rate,
+					video_threads,
+					video_yuv)
 			, rate_(rate)
 			, start_time_(start_time)
 			, map_factor_(map_factor)
 			, map_zoom_(map_zoom)
 			, map_source_(map_source)
+			, map_downloads_(map_downloads)
+			, cache_size_(cache_size)
+			, cache_policy_(cache_policy)
 			, path_thick_(path_thick)
 			, path_border_(path_border)
 	   		, extract_format_(extract_format) {
@@ -117,6 +134,18 @@ public:
 			return map_zoom_;
 		}
 
+		const int& mapdownloads(void) const {
+			return map_downloads_;
+		}
+
+		const uint64_t& cachesize(void) const {
+			return cache_size_;
+		}
+
+		const CacheSettings::Policy& cachepolicy(void) const {
+			return cache_policy_;
+		}
+
 	private:
 		int rate_;
 		std::string start_time_;
@@ -124,6 +153,10 @@ public:
 		double map_factor_;
 		int map_zoom_;
 		MapSettings::Source map_source_;
+		int map_downloads_;
+
+		uint64_t cache_size_;
+		CacheSettings::Policy cache_policy_;
 
 		double path_thick_;
 		double path_border_;
@@ -145,6 +178,7 @@ public:
 	MediaContainer * media(void);
 	int setDefaultStartTime(void);
 	Map * buildMap(void);
+	Cache * buildCache(void);
 	Extractor * buildExtractor(void);
 
 private:
@@ -19,6 +19,7 @@ extern "C" {
 #include "log.h"
 #include "version.h"
 #include "telemetry.h"
+#include "telemetrycache.h"
 #include "gpxtools.h"
 
 
@@ -30,9 +31,12 @@ static const struct option options[] = {
 	{ "quiet",                 no_argument,       0, 'q' },
 	{ "input",                 required_argument, 0, 'i' },
 	{ "output",                required_argument, 0, 'o' },
+	{ "from",                  required_argument, 0, 0 },
+	{ "to",                    required_argument, 0, 0 },
 	{ "telemetry-method",      required_argument, 0, 0 },
 	{ "telemetry-method-list", no_argument,       0, 0 },
 	{ "telemetry-rate",        required_argument, 0, 'r' },
+	{ "telemetry-distance",    required_argument, 0, 0 },
 	{ 0,                       0,                 0, 0 }
 };
 
@@ -40,6 +44,7 @@ static void print_usage(const std::string &name) {
 	log_call();
 
 	std::cout << "Usage: " << name << "%s [-v] -i input-file -o output-file command" << std::endl;
+	std::cout << "       " << name << " [-v] cache input-file..." << std::endl;
 	std::cout << "       " << name << " -h" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Options:" << std::endl;
@@ -49,6 +54,7 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t-    --to                      : Set end (format: yyyy-mm-dd hh:mm:ss) (not required)" << std::endl;
 	std::cout << "\t-    --telemetry-method=method : Interpolate method (none, sample, linear...)" << std::endl;
 	std::cout << "\t-    --telemetry-rate=value    : Telemetry rate (refresh each second) (default: 1000))" << std::endl;
+	std::cout << "\t-    --telemetry-distance=mode : Distance computation (geodesic, fast) (default: geodesic)" << std::endl;
 	std::cout << "\t- v, --verbose                 : Show trace" << std::endl;
 	std::cout << "\t- q, --quiet                   : Quiet mode" << std::endl;
 	std::cout << "\t- h, --help                    : Show this help screen" << std::endl;
@@ -59,6 +65,7 @@ static void print_usage(const std::string &name) {
 	std::cout << "Command:" << std::endl;
 	std::cout << "\t convert: Convert telemetry data file" << std::endl;
 	std::cout << "\t compute: Compute telemetry data from gpx, csv... data" << std::endl;
+	std::cout << "\t cache: Build computed telemetry cache (.g2vt) of each input file, for the rendering" << std::endl;
 
 	return;
 }
@@ -120,6 +127,7 @@ int GPXTools::parseCommandLine(int argc, char *argv[]) {
 	std::string from;
 
 	TelemetrySettings::Method method = TelemetrySettings::MethodNone;
+	TelemetrySettings::Distance distance = TelemetrySettings::DistanceGeodesic;
 
 	const std::string name(argv[0]);
 
@@ -147,6 +155,16 @@ int GPXTools::parseCommandLine(int argc, char *argv[]) {
 			else if (s && !strcmp(s, "telemetry-rate")) {
 				rate = atoi(optarg);
 			}
+			else if (s && !strcmp(s, "telemetry-distance")) {
+				if (!strcmp(optarg, "fast"))
+					distance = TelemetrySettings::DistanceFast;
+				else if (!strcmp(optarg, "geodesic"))
+					distance = TelemetrySettings::DistanceGeodesic;
+				else {
+					std::cout << "Telemetry distance mode '" << optarg << "' unknown" << std::endl;
+					return -1;
+				}
+			}
 			else {
 				std::cout << "option " << s;
 				if (optarg)
@@ -192,7 +210,25 @@ int GPXTools::parseCommandLine(int argc, char *argv[]) {
 	gpx2video_log_debug_enable((verbose > 1));
 
 	// Check command
-	if (argc == 1) {
+	if ((argc >= 1) && !strcmp(argv[0], "cache")) {
+		setCommand(GPXTools::CommandCache);
+
+		if (!inputfile.empty())
+			files_.push_back(inputfile);
+
+		for (index=1; index<argc; index++)
+			files_.push_back(std::string(argv[index]));
+
+		if (files_.empty()) {
+			std::cout << name << ": 'cache' command requires input files" << std::endl;
+			return -1;
+		}
+
+		// Same default method as the renderer
+		if (method == TelemetrySettings::MethodNone)
+			method = TelemetrySettings::MethodSample;
+	}
+	else if (argc == 1) {
 		if (!strcmp(argv[0], "method")) {
 			setCommand(GPXTools::CommandMethod);
 		}
@@ -227,7 +263,8 @@ int GPXTools::parseCommandLine(int argc, char *argv[]) {
 		0,
 		0,
 		method,
-		rate)
+		rate,
+		distance)
 	);
 
 	return 0;
@@ -273,19 +310,34 @@ int main(int argc, char *argv[], char *envp[]) {
 			// Telemetry settings
 			TelemetrySettings settings(
 					app.settings().telemetryMethod(),
-					app.settings().telemetryRate());
+					app.settings().telemetryRate(),
+					TelemetrySettings::FormatAuto,
+					app.settings().telemetryDistance());
 
 			telemetry = Telemetry::create(app, settings);
 			app.append(telemetry);
 		}
 		break;
 
+	case GPXTools::CommandCache:
+		// Build each cache file, no task to run
+		for (const std::string &file : app.files()) {
+			if (!TelemetryCache::build(file,
+					app.settings().telemetryMethod(), app.settings().telemetryRate(),
+					app.settings().telemetryDistance(),
+					app.settings().from(), app.settings().to()))
+				log_error("Telemetry cache of '%s' failure", file.c_str());
+		}
+		goto exit;
+		break;
+
 	case GPXTools::CommandCompute: {
 			// Telemetry settings
 			TelemetrySettings settings(
 					app.settings().telemetryMethod(),
 					app.settings().telemetryRate(),
-					TelemetrySettings::FormatCSV);
+					TelemetrySettings::FormatCSV,
+					app.settings().telemetryDistance());
 
 			telemetry = Telemetry::create(app, settings);
 			app.append(telemetry);
@@ -25,7 +25,8 @@ public:
 			int offset=0,
 			int max_duration_ms=0,
 			TelemetrySettings::Method telemetry_method=TelemetrySettings::MethodNone,
-			int telemetry_rate=0)
+			int telemetry_rate=0,
+			TelemetrySettings::Distance telemetry_distance=TelemetrySettings::DistanceGeodesic)
 			: GPXApplication::Settings(
 					gpx_file, output_file,
 					from, to, 
@@ -33,7 +34,9 @@ public:
 					max_duration_ms)
 			, TelemetrySettings(
 					telemetry_method, 
-					telemetry_rate) {
+					telemetry_rate,
+					TelemetrySettings::FormatAuto,
+					telemetry_distance) {
 		}
 	};
 
@@ -45,8 +48,14 @@ public:
 
 	int parseCommandLine(int argc, char *argv[]);
 
+	const std::list<std::string>& files(void) const {
+		return files_;
+	}
+
 private:
 	Settings settings_;
+
+	std::list<std::string> files_;
 };
 
 #endif